@@ -1,6 +1,8 @@
 /*************************************************************/
 /*N psuedo devices driver                                    */
-/*interface with 4 pseudo memory devices using one driver    */
+/*interface with N pseudo memory devices using one driver    */
+/*devices count, size, permission and mode are set by the    */
+/*module parameters when the module is loaded                */
 /*************************************************************/
 
 /*header section*/
@@ -10,41 +12,189 @@
 #include <linux/device.h>
 #include <linux/kdev_t.h>
 #include <linux/uaccess.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/seqlock.h>
+#include <linux/wait.h>
+#include <linux/wait_bit.h>
+#include <linux/poll.h>
+#include <linux/uio.h>
+#include <linux/ktime.h>
+#include <linux/percpu.h>
+#include <linux/u64_stats_sync.h>
+#include <linux/log2.h>
+#include <linux/moduleparam.h>
+#include <linux/string.h>
+#include <linux/compat.h>
+#include <linux/nodemask.h>
+#include <linux/pfn_t.h>
+#include <linux/atomic.h>
+#include <linux/spinlock.h>
+#include <linux/topology.h>
+#include <linux/bitmap.h>
+#include "n_pseudo_ioctl.h"
+#include "pseudo_throttle.h"
+#include "pseudo_fifo.h"
 
+/*tracepoints are created once in the module that owns them*/
+#define CREATE_TRACE_POINTS
+#include "n_pseudo_trace.h"
 
-#define DEV0_MEM_SIZE           1024
-#define DEV1_MEM_SIZE           1024
-#define DEV2_MEM_SIZE           512
-#define DEV3_MEM_SIZE           512
 
-#define MINOR_NUM_START_NUMBER  0
-#define NUMBER_OF_DEVICES       4
+/*default devices, used when the module is loaded without parameters*/
+#define DEFAULT_NUMBER_OF_DEVICES   5
+#define DEFAULT_DEV_SIZES           "1K,1K,512,512,1K"
+#define DEFAULT_DEV_PERMS           "r,rw,w,rw,rw"
+#define DEFAULT_DEV_MODES           "flat,flat,flat,flat,fifo"
+#define DEFAULT_DEV_NODES           "any"
+
+#define MINOR_NUM_START_NUMBER      0
+#define MAX_NUMBER_OF_DEVICES       1024
+/*fifo devices size must be power of 2, the fifo indexes are unsigned int counters*/
+#define MAX_FIFO_MEM_SIZE           (1UL << 30)
+/*longest item in the module parameters lists*/
+#define PARAM_TOKEN_LEN             32
 
 /*device permission*/
 #define RONLY_PERMISSION        0b01
 #define WONLY_PERMISSION        0b10
 #define RW_PERMISSION           0b11
 
-/*devices pseudo memory*/
-static char device0_mem[DEV0_MEM_SIZE] = "This is a dummy data for the pseudo read-only memory device";
-static char device1_mem[DEV1_MEM_SIZE];
-static char device2_mem[DEV2_MEM_SIZE];
-static char device3_mem[DEV3_MEM_SIZE];
+/*device mode*/
+/*flat mode: the device is a seekable memory*/
+/*fifo mode: the device is a circular buffer, readers wait for data and writers wait for space*/
+/*ring mode: the device is a circular buffer in shared memory, user space moves the indexes  */
+/*in the mapped control page, the driver only wakes the side that sleeps in poll             */
+/*log mode: every write appends one record and every open file reads all records with its   */
+/*own cursor, writers overwrite the oldest records and never wait for the readers           */
+/*gen mode: reads return an endless generated pattern, the device memory is the template    */
+#define FLAT_MODE               0
+#define FIFO_MODE               1
+#define RING_MODE               2
+#define LOG_MODE                3
+#define GEN_MODE                4
+
+/*log records start with their length and are aligned to it, so a header never wraps*/
+#define LOG_HDR_SIZE            sizeof(u32)
+
+/*generated words are filled in a stack chunk and copied out from there*/
+#define GEN_CHUNK_WORDS         64
+
+/*device memory node, besides the node ids*/
+/*any: the pages come from the node of the cpu that loads the module*/
+/*interleave: the pages are spread round robin over the memory nodes */
+#define NUMA_ANY                NUMA_NO_NODE
+#define NUMA_INTERLEAVE         (-2)
+
+/*writers copy user data in chunks of this size, each chunk is updated atomically for readers*/
+#define WRITE_CHUNK_SIZE        PAGE_SIZE
+/*a reader falls back to the write lock if writers keep changing the memory under it*/
+#define MAX_READ_RETRIES        8
+
+/*large flat devices memory is allocated in PMD size chunks when it can, mmap maps a chunk with one PMD entry*/
+/*so a random access over a multi GB mapping needs one TLB entry per chunk instead of one per page        */
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+#define HUGE_ORDER              HPAGE_PMD_ORDER
+#else
+#define HUGE_ORDER              0
+#endif
+#define HUGE_NR_PAGES           (1UL << HUGE_ORDER)
+
+/*devices pseudo memory initial content*/
+#define DEV0_INIT_DATA          "This is a dummy data for the pseudo read-only memory device"
+
+/*per cpu statistics, every cpu updates its own copy without atomics and the copies are folded when read*/
+/*latency histograms are log2 buckets, bucket n counts operations that took [2^n, 2^(n+1)) ns*/
+#define LAT_HIST_BUCKETS        32
+
+enum dev_stat_item
+{
+    STAT_READS,
+    STAT_WRITES,
+    STAT_LLSEEKS,
+    STAT_BYTES_READ,
+    STAT_BYTES_WRITTEN,
+    STAT_SHORT_READS,
+    STAT_SHORT_WRITES,
+    STAT_EFAULT,
+    STAT_ENOMEM,
+    STAT_EINVAL,
+    STAT_OPENS,
+    /*log mode reads that found their records overwritten*/
+    STAT_OVERRUNS,
+    STAT_READ_LAT_HIST,
+    STAT_WRITE_LAT_HIST = STAT_READ_LAT_HIST + LAT_HIST_BUCKETS,
+    STAT_ITEMS_COUNT    = STAT_WRITE_LAT_HIST + LAT_HIST_BUCKETS
+};
+
+struct dev_stats
+{
+    u64 items[STAT_ITEMS_COUNT];
+    /*lets readers get consistent 64 bit values on 32 bit machines, it is empty on 64 bit machines*/
+    struct u64_stats_sync syncp;
+};
 
 /*device private data*/
 struct dev_priv_data
 {
+        /*device memory, pages allocated on the device node and mapped with vmap*/
+        /*the mapping is virtually contiguous, so copies can cross page boundaries*/
+        /*mmap maps the pages array to user space                                 */
         char* data_buffer;
+        struct page **pages;
+        unsigned long nr_pages;
+        /*huge chunks in the pages array, every chunk fills HUGE_NR_PAGES entries starting with its head page*/
+        unsigned long nr_huge;
+        /*a node id, NUMA_ANY or NUMA_INTERLEAVE*/
+        int numa_node;
+        const char* init_data;
         size_t size;
-        const char* ID;
         /*firs bit for read permission and second bit for write permission*/
         /* example: 0b11 means RW permission                             */
         int permission;
+        int mode;
+        /*writers are serialized by write_lock, readers dont take any lock*/
+        /*they copy the memory and retry if mem_seq shows that a writer changed it meanwhile*/
+        struct mutex write_lock;
+        seqcount_mutex_t mem_seq;
+        /*copy_from_user can sleep so it can not run inside the write section, user data is copied here first*/
+        char* bounce_buffer;
+        /*fifo mode state, the fifo helpers are shared with the other driver, see pseudo_fifo.h*/
+        /*readers and writers have separate locks, so a producer and a consumer never wait for each other*/
+        struct pseudo_fifo fifo;
+        struct mutex read_lock;
+        wait_queue_head_t read_queue;
+        wait_queue_head_t write_queue;
+        /*ring mode control page, the first page of the device memory, user space owns the indexes*/
+        struct n_pseudo_ring_ctrl *ring_ctrl;
+        /*log mode state, byte positions that run freely and are masked with size-1*/
+        /*head is the end of the newest record and tail the start of the oldest one*/
+        /*both are moved by the writer under write_lock, readers dont take any lock*/
+        unsigned long log_head;
+        unsigned long log_tail;
+        /*one bit per header slot, set where a record starts, the slots inside a record are clear*/
+        /*aio and io_uring pass any position to read, the bit tells if it is a record start      */
+        unsigned long *log_starts;
+        /*a record is copied from the user here first, so a faulting write leaves the log as it was*/
+        char *log_bounce;
+        /*gen mode configuration, set through sysfs or ioctl and read by the readers without a lock*/
+        int gen_pattern;
+        u32 gen_flags;
+        u64 gen_rate;
+        /*the tat of the rate limit, the time in ns the next read may start, only used when gen_rate is set*/
+        spinlock_t gen_lock;
+        u64 gen_tat;
+        /*one pre-filled prng buffer per possible cpu, on the node of the cpu*/
+        char **gen_prefill;
+        /*per cpu statistics, exported in the stats directory of the device in sysfs*/
+        struct dev_stats __percpu *stats;
         struct cdev dev_cdev;
         struct device *dev_ptr;
 };
 
-/*driver data, data used by the driver to access all 4 devices*/
+/*driver data, data used by the driver to access all devices*/
 struct drv_priv_data
 {
     /*number of devices*/
@@ -54,295 +204,2014 @@ struct drv_priv_data
 
     struct class *dev_class;
     
-    struct dev_priv_data devs_data[NUMBER_OF_DEVICES];
+    /*allocated when the module is loaded, one entry per device*/
+    struct dev_priv_data *devs_data;
 };
 
-struct drv_priv_data drv_data = {
-    .dev_count = NUMBER_OF_DEVICES,
-    .devs_data =
-    {
-        [0] = 
-        {
-            .data_buffer = device0_mem,
-            .size        = DEV1_MEM_SIZE,
-            .ID          = "1024_BYTE_RONLY_MEM",
-            .permission  = RONLY_PERMISSION
-        },
-        [1] = 
-        {
-            .data_buffer = device1_mem,
-            .size        = DEV2_MEM_SIZE,
-            .ID          = "1024_BYTE_RW_MEM ",
-            .permission  = RW_PERMISSION
-        },
-        [2] = 
-        {
-            .data_buffer = device2_mem,
-            .size        = DEV3_MEM_SIZE,
-            .ID          = "512_BYTE_WONLY_MEM",
-            .permission  = WONLY_PERMISSION
-        },
-        [3] = 
-        {
-            .data_buffer = device3_mem,
-            .size        = DEV4_MEM_SIZE,
-            .ID          = "512_BYTE_RW_MEM",
-            .permission  = RW_PERMISSION
-        }
-    }
+struct drv_priv_data drv_data;
+
+/*module parameters*/
+/*every list has one item per device, a list shorter than ndevices repeats its last item*/
+/*example: insmod n_pseudo_devices.ko ndevices=200 dev_sizes=4K,64M dev_perms=rw dev_modes=flat*/
+static unsigned int ndevices = DEFAULT_NUMBER_OF_DEVICES;
+module_param(ndevices, uint, 0444);
+MODULE_PARM_DESC(ndevices, "number of devices, up to 1024");
+
+static char *dev_sizes = DEFAULT_DEV_SIZES;
+module_param(dev_sizes, charp, 0444);
+MODULE_PARM_DESC(dev_sizes, "comma separated devices memory size, K/M/G suffixes are accepted");
+
+static char *dev_perms = DEFAULT_DEV_PERMS;
+module_param(dev_perms, charp, 0444);
+MODULE_PARM_DESC(dev_perms, "comma separated devices permission: r, w or rw");
+
+static char *dev_modes = DEFAULT_DEV_MODES;
+module_param(dev_modes, charp, 0444);
+MODULE_PARM_DESC(dev_modes, "comma separated devices mode: flat, fifo, ring, log or gen");
+
+/*example: insmod n_pseudo_devices.ko ndevices=3 dev_sizes=1G dev_nodes=0,1,interleave*/
+static char *dev_nodes = DEFAULT_DEV_NODES;
+module_param(dev_nodes, charp, 0444);
+MODULE_PARM_DESC(dev_nodes, "comma separated devices memory node: any, interleave or a node id");
+
+/*the mmap benchmarks compare huge and small pages with this parameter*/
+static bool huge_pages = true;
+module_param(huge_pages, bool, 0444);
+MODULE_PARM_DESC(huge_pages, "allocate the flat devices memory in PMD size chunks when possible");
+
+static const char * const perm_names[] = {
+    [RONLY_PERMISSION] = "r",
+    [WONLY_PERMISSION] = "w",
+    [RW_PERMISSION]    = "rw"
+};
+
+static const char * const mode_names[] = {
+    [FLAT_MODE] = "flat",
+    [FIFO_MODE] = "fifo",
+    [RING_MODE] = "ring",
+    [LOG_MODE]  = "log",
+    [GEN_MODE]  = "gen"
+};
+
+static const char * const gen_pattern_names[] = {
+    [N_PSEUDO_GEN_ZERO]     = "zero",
+    [N_PSEUDO_GEN_COUNTER]  = "counter",
+    [N_PSEUDO_GEN_PRNG]     = "prng",
+    [N_PSEUDO_GEN_TEMPLATE] = "template"
 };
+
 /*file operations*/
 loff_t pseudo_llseek (struct file *file_ptr, loff_t offset, int whence);
-ssize_t pseudo_read (struct file *file_ptr, char __user *buffer, size_t count, loff_t *f_pos);
-ssize_t pseudo_write (struct file *file_ptr, const char __user *buffer, size_t count, loff_t *f_pos);\
+ssize_t pseudo_read_iter (struct kiocb *iocb, struct iov_iter *to);
+ssize_t pseudo_write_iter (struct kiocb *iocb, struct iov_iter *from);
 int pseudo_open (struct inode *inode_ptr, struct file *file_ptr);
 int pseudo_release (struct inode *inode_ptr, struct file *file_ptr);
+int pseudo_mmap (struct file *file_ptr, struct vm_area_struct *vma);
+__poll_t pseudo_poll (struct file *file_ptr, struct poll_table_struct *wait);
+long pseudo_ioctl (struct file *file_ptr, unsigned int cmd, unsigned long arg);
+vm_fault_t pseudo_vm_fault (struct vm_fault *vmf);
+vm_fault_t pseudo_vm_huge_fault (struct vm_fault *vmf, unsigned int order);
 
 
 int check_file_permission(int device_permission, fmode_t mode);
+void param_token(const char *list, int index, char *token, size_t len);
+int param_lookup(const char * const *names, int count, const char *token);
+int parse_dev_params(void);
+int parse_numa_node(const char *token);
+int mem_alloc(struct dev_priv_data *data_ptr);
+void mem_free(struct dev_priv_data *data_ptr);
+int stats_error_item(long err);
+void stats_account_op(struct dev_priv_data *data_ptr, int op_item, long ret);
+void stats_account_io(struct dev_priv_data *data_ptr, bool is_read, ssize_t ret, size_t count, u64 latency_ns);
+u64 stats_fold_item(struct dev_priv_data *data_ptr, int item);
+ssize_t stats_show_hist(struct device *dev, char *buf, int first_item);
+ssize_t mem_read_iter(struct kiocb *iocb, struct dev_priv_data *data_ptr, struct iov_iter *to);
+ssize_t mem_write_iter(struct kiocb *iocb, struct dev_priv_data *data_ptr, struct iov_iter *from);
+ssize_t copy_mem_to_iter(struct kiocb *iocb, struct dev_priv_data *data_ptr, struct iov_iter *to, loff_t pos, size_t count);
+ssize_t copy_mem_from_iter(struct kiocb *iocb, struct dev_priv_data *data_ptr, struct iov_iter *from, loff_t pos, size_t count);
+size_t copy_mem_from_iter_locked(struct dev_priv_data *data_ptr, struct iov_iter *from, loff_t pos, size_t count);
+long ioctl_batch(struct file *file_ptr, struct dev_priv_data *data_ptr, struct n_pseudo_io_batch __user *user_batch);
+ssize_t batch_desc_run(struct file *file_ptr, struct dev_priv_data *data_ptr, struct n_pseudo_io_desc *desc);
+void ring_init(struct dev_priv_data *data_ptr);
+__poll_t ring_poll(struct file *file_ptr, struct dev_priv_data *data_ptr, struct poll_table_struct *wait);
+long ring_kick(struct dev_priv_data *data_ptr);
+void log_copy_from(struct dev_priv_data *data_ptr, unsigned long pos, void *dst, size_t len);
+ssize_t log_read(struct kiocb *iocb, struct dev_priv_data *data_ptr, struct iov_iter *to);
+ssize_t log_write(struct kiocb *iocb, struct dev_priv_data *data_ptr, struct iov_iter *from);
+loff_t log_llseek(struct file *file_ptr, struct dev_priv_data *data_ptr, loff_t offset, int whence);
+__poll_t log_poll(struct file *file_ptr, struct dev_priv_data *data_ptr, struct poll_table_struct *wait);
+int gen_init(struct dev_priv_data *data_ptr);
+void gen_free(struct dev_priv_data *data_ptr);
+int gen_configure(struct dev_priv_data *data_ptr, const struct n_pseudo_gen_config *config);
+long ioctl_gen(struct file *file_ptr, struct dev_priv_data *data_ptr, unsigned int cmd, struct n_pseudo_gen_config __user *user_config);
+u64 gen_prng_word(u64 index);
+void gen_fill(int pattern, u64 *words, u64 first, unsigned int nr);
+size_t gen_copy_repeat(const char *buf, size_t period, loff_t pos, size_t count, struct iov_iter *to);
+size_t gen_copy_words(int pattern, loff_t pos, size_t count, struct iov_iter *to);
+int gen_throttle(struct kiocb *iocb, struct dev_priv_data *data_ptr, size_t count);
+ssize_t gen_read(struct kiocb *iocb, struct dev_priv_data *data_ptr, struct iov_iter *to);
 
 /*file_operations struct*/
 struct file_operations pseudo_fops = {
-    .open       = pseudo_open,
-    .release    = pseudo_release,
-    .read       = pseudo_read,
-    .write      = pseudo_write,
-    .llseek     = pseudo_llseek,
-    .owner      = THIS_MODULE
+    .open           = pseudo_open,
+    .release        = pseudo_release,
+    .read_iter      = pseudo_read_iter,
+    .write_iter     = pseudo_write_iter,
+    .llseek         = pseudo_llseek,
+    .mmap           = pseudo_mmap,
+    .poll           = pseudo_poll,
+    .unlocked_ioctl = pseudo_ioctl,
+    /*the ioctl structures have the same layout for 32 and 64 bit processes*/
+    .compat_ioctl   = compat_ptr_ioctl,
+    /*shared mappings get an address aligned like their file offset, so the huge chunks fit PMD entries*/
+    .get_unmapped_area = thp_get_unmapped_area,
+    .owner          = THIS_MODULE
 };
 
-/*code section*/
-static int __init pseudo_init(void)
+/*shared mappings insert the device pages on fault*/
+static const struct vm_operations_struct pseudo_vm_ops = {
+    .fault          = pseudo_vm_fault,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+    .huge_fault     = pseudo_vm_huge_fault,
+#endif
+};
+
+/*statistics section*/
+int stats_error_item(long err)
 {
-    int err;
-    int itr;
-    /*allocate device number*/
-    err = alloc_chrdev_region(&drv_data.dev_num, MINOR_NUM_START_NUMBER, NUMBER_OF_DEVICES, "n pseudo memory devices");
-    if(err <0)
+    switch(err)
     {
-        pr_err("chrdev alloc failed\n");
-        goto alloc_fail;
+        case -EFAULT:
+            return STAT_EFAULT;
+        case -ENOMEM:
+            return STAT_ENOMEM;
+        case -EINVAL:
+            return STAT_EINVAL;
+        case -EPIPE:
+            return STAT_OVERRUNS;
+        default:
+            return -1;
     }
-    pr_info("start module intialization \n");
+}
 
-    /*create device class*/
-    drv_data.dev_class = class_create("n_pseudo_char_class");
+void stats_account_op(struct dev_priv_data *data_ptr, int op_item, long ret)
+{
+    struct dev_stats *stats;
+    int err_item = stats_error_item(ret);
 
-    /*if class creation failed, it doesnt return null, it returns pointer to error code*/
-    if(IS_ERR(drv_data.dev_class))
-    {
-        pr_err("class creation failed\n");
-        err = PTR_ERR(drv_data.dev_class);
-        goto unreg_dev;
-    }
-    
-    for(itr=0; itr<NUMBER_OF_DEVICES; itr++)
-    {
-        pr_info("major:%d,minor:%d\n", MAJOR(drv_data.dev_num+itr), MINOR(drv_data.dev_num+itr));
+    /*get_cpu_ptr disables preemption, so this cpu copy has only one writer*/
+    stats = get_cpu_ptr(data_ptr->stats);
+    u64_stats_update_begin(&stats->syncp);
 
-        /*intialize cdev struct*/
-        cdev_init(&drv_data.devs_data[itr].dev_cdev, &pseudo_fops);
-        
-        /*cdev_init clears all cdev struct elements, so you need to intialize owner after cdev_init*/
-        drv_data.devs_data[itr].dev_cdev.owner = THIS_MODULE;
+    stats->items[op_item]++;
+    if(err_item >= 0)
+        stats->items[err_item]++;
 
-        /*register the device in VFS*/
-        err = cdev_add(&drv_data.devs_data[itr].dev_cdev, drv_data.dev_num+itr, 1);
-        if(err <0)
+    u64_stats_update_end(&stats->syncp);
+    put_cpu_ptr(data_ptr->stats);
+}
+
+void stats_account_io(struct dev_priv_data *data_ptr, bool is_read, ssize_t ret, size_t count, u64 latency_ns)
+{
+    struct dev_stats *stats;
+    int err_item = stats_error_item(ret);
+    int bucket = 0;
+
+    if(latency_ns > 0)
+        bucket = min_t(int, ilog2(latency_ns), LAT_HIST_BUCKETS - 1);
+
+    /*get_cpu_ptr disables preemption, so this cpu copy has only one writer*/
+    stats = get_cpu_ptr(data_ptr->stats);
+    u64_stats_update_begin(&stats->syncp);
+
+    if(is_read)
+    {
+        stats->items[STAT_READS]++;
+        stats->items[STAT_READ_LAT_HIST + bucket]++;
+        if(ret >= 0)
         {
-            pr_err("device registration failed\n");
-            goto cdev_del;
+            stats->items[STAT_BYTES_READ] += ret;
+            if((size_t)ret < count)
+                stats->items[STAT_SHORT_READS]++;
         }
     }
-    for(int itr=0; itr<NUMBER_OF_DEVICES; itr++)
+    else
     {
-        /*create device files*/
-        drv_data.devs_data[itr].dev_ptr = device_create(drv_data.dev_class, NULL, drv_data.dev_num+itr, NULL, "pseudo_char_dev:%d",itr);
-        
-        if(IS_ERR(drv_data.devs_data[itr].dev_ptr))
+        stats->items[STAT_WRITES]++;
+        stats->items[STAT_WRITE_LAT_HIST + bucket]++;
+        if(ret >= 0)
         {
-            pr_err("device creation failed\n");
-            err = PTR_ERR(drv_data.devs_data[itr].dev_ptr);
-            goto dev_del;
+            stats->items[STAT_BYTES_WRITTEN] += ret;
+            if((size_t)ret < count)
+                stats->items[STAT_SHORT_WRITES]++;
         }
+    }
+
+    if(err_item >= 0)
+        stats->items[err_item]++;
+
+    u64_stats_update_end(&stats->syncp);
+    put_cpu_ptr(data_ptr->stats);
+}
+
+u64 stats_fold_item(struct dev_priv_data *data_ptr, int item)
+{
+    struct dev_stats *stats;
+    unsigned int start;
+    u64 total = 0;
+    u64 value;
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+    {
+        stats = per_cpu_ptr(data_ptr->stats, cpu);
+        do
+        {
+            start = u64_stats_fetch_begin(&stats->syncp);
+            value = stats->items[item];
+        } while(u64_stats_fetch_retry(&stats->syncp, start));
 
+        total += value;
     }
 
-    
-    pr_info("module intialization done without errors\n");
-    
-    return err;
+    return total;
+}
 
-dev_del:
-    for(;itr>=0;itr--)
-        device_destroy(drv_data.dev_class, drv_data.dev_num+itr);
-    
-    /*reset the iterator to be used in cdev_del*/
-    itr = NUMBER_OF_DEVICES-1;
+/*sysfs interface, the files are in the stats directory of every device*/
+#define DEV_STAT_ATTR(_name, _item)                                                             \
+static ssize_t _name##_show(struct device *dev, struct device_attribute *attr, char *buf)       \
+{                                                                                               \
+    return sysfs_emit(buf, "%llu\n", stats_fold_item(dev_get_drvdata(dev), _item));            \
+}                                                                                               \
+static DEVICE_ATTR_RO(_name)
 
-cdev_del:
-    for(;itr>=0;itr--)
-        cdev_del(&drv_data.devs_data[itr].dev_cdev);
+DEV_STAT_ATTR(reads, STAT_READS);
+DEV_STAT_ATTR(writes, STAT_WRITES);
+DEV_STAT_ATTR(llseeks, STAT_LLSEEKS);
+DEV_STAT_ATTR(bytes_read, STAT_BYTES_READ);
+DEV_STAT_ATTR(bytes_written, STAT_BYTES_WRITTEN);
+DEV_STAT_ATTR(short_reads, STAT_SHORT_READS);
+DEV_STAT_ATTR(short_writes, STAT_SHORT_WRITES);
+DEV_STAT_ATTR(efault, STAT_EFAULT);
+DEV_STAT_ATTR(enomem, STAT_ENOMEM);
+DEV_STAT_ATTR(einval, STAT_EINVAL);
+DEV_STAT_ATTR(opens, STAT_OPENS);
+DEV_STAT_ATTR(overruns, STAT_OVERRUNS);
 
-    class_destroy(drv_data.dev_class);
+/*histogram files print one count per log2 bucket, starting with the [1, 2) ns bucket*/
+ssize_t stats_show_hist(struct device *dev, char *buf, int first_item)
+{
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+    ssize_t len = 0;
+    int bucket;
 
-unreg_dev:
-    /*dealloc device number*/
-    unregister_chrdev_region(drv_data.dev_num, NUMBER_OF_DEVICES);
+    for(bucket=0; bucket<LAT_HIST_BUCKETS; bucket++)
+        len += sysfs_emit_at(buf, len, "%llu%c", stats_fold_item(data_ptr, first_item + bucket),
+                             (bucket == LAT_HIST_BUCKETS - 1) ? '\n' : ' ');
 
-alloc_fail:
-    pr_info("module intialization failed\n");
-    return err;
+    return len;
+}
 
+static ssize_t read_latency_hist_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    return stats_show_hist(dev, buf, STAT_READ_LAT_HIST);
 }
+static DEVICE_ATTR_RO(read_latency_hist);
 
-static void __exit pseudo_deinit(void)
+static ssize_t write_latency_hist_show(struct device *dev, struct device_attribute *attr, char *buf)
 {
-	pr_info("unload pseudo char driver\n");
+    return stats_show_hist(dev, buf, STAT_WRITE_LAT_HIST);
+}
+static DEVICE_ATTR_RO(write_latency_hist);
 
-    for(int itr=0;itr<NUMBER_OF_DEVICES;itr++)
-    {
-        device_destroy(drv_data.dev_class, drv_data.dev_num+itr);
-        cdev_del(&drv_data.devs_data[itr].dev_cdev);
-    }
-    class_destroy(drv_data.dev_class);
-    
-    /*dealloc device number*/
-    unregister_chrdev_region(drv_data.dev_num, NUMBER_OF_DEVICES);
+static struct attribute *dev_stats_attrs[] = {
+    &dev_attr_reads.attr,
+    &dev_attr_writes.attr,
+    &dev_attr_llseeks.attr,
+    &dev_attr_bytes_read.attr,
+    &dev_attr_bytes_written.attr,
+    &dev_attr_short_reads.attr,
+    &dev_attr_short_writes.attr,
+    &dev_attr_efault.attr,
+    &dev_attr_enomem.attr,
+    &dev_attr_einval.attr,
+    &dev_attr_opens.attr,
+    &dev_attr_overruns.attr,
+    &dev_attr_read_latency_hist.attr,
+    &dev_attr_write_latency_hist.attr,
+    NULL
+};
+
+static const struct attribute_group dev_stats_group = {
+    .name  = "stats",
+    .attrs = dev_stats_attrs,
+};
 
+/*device configuration, read only files in the device directory*/
+static ssize_t size_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%zu\n", data_ptr->size);
 }
+static DEVICE_ATTR_RO(size);
 
-int pseudo_open (struct inode *inode_ptr, struct file *file_ptr)
+static ssize_t permission_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%s\n", perm_names[data_ptr->permission]);
+}
+static DEVICE_ATTR_RO(permission);
+
+static ssize_t mode_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%s\n", mode_names[data_ptr->mode]);
+}
+static DEVICE_ATTR_RO(mode);
+
+static ssize_t numa_node_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+
+    if(data_ptr->numa_node == NUMA_ANY)
+        return sysfs_emit(buf, "any\n");
+
+    if(data_ptr->numa_node == NUMA_INTERLEAVE)
+        return sysfs_emit(buf, "interleave\n");
+
+    return sysfs_emit(buf, "%d\n", data_ptr->numa_node);
+}
+static DEVICE_ATTR_RO(numa_node);
+
+/*where the pages really are, the allocation falls back to other nodes when the node is full*/
+/*one N<node>=<pages> item per memory node*/
+static ssize_t numa_pages_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+    unsigned long *counts;
+    unsigned long itr;
+    ssize_t len = 0;
+    int node;
+
+    counts = kcalloc(nr_node_ids, sizeof(*counts), GFP_KERNEL);
+    if(counts == NULL)
+        return -ENOMEM;
+
+    for(itr=0; itr<data_ptr->nr_pages; itr++)
+        counts[page_to_nid(data_ptr->pages[itr])]++;
+
+    for_each_node_state(node, N_MEMORY)
+        len += sysfs_emit_at(buf, len, "%sN%d=%lu", (len == 0) ? "" : " ", node, counts[node]);
+    len += sysfs_emit_at(buf, len, "\n");
+
+    kfree(counts);
+    return len;
+}
+static DEVICE_ATTR_RO(numa_pages);
+
+static ssize_t huge_pages_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%lu\n", data_ptr->nr_huge);
+}
+static DEVICE_ATTR_RO(huge_pages);
+
+static struct attribute *dev_config_attrs[] = {
+    &dev_attr_size.attr,
+    &dev_attr_permission.attr,
+    &dev_attr_mode.attr,
+    &dev_attr_numa_node.attr,
+    &dev_attr_numa_pages.attr,
+    &dev_attr_huge_pages.attr,
+    NULL
+};
+
+static const struct attribute_group dev_config_group = {
+    .attrs = dev_config_attrs,
+};
+
+/*generator configuration, writable files in the generator directory of gen devices*/
+/*every store keeps the other settings, so it goes through the same path as the ioctl*/
+static ssize_t gen_pattern_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%s\n", gen_pattern_names[READ_ONCE(data_ptr->gen_pattern)]);
+}
+
+static ssize_t gen_pattern_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
 {
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+    struct n_pseudo_gen_config config;
+    int pattern;
     int err;
-    int minor_num;
-    struct dev_priv_data *dev_data;
 
-    pr_info("pseudo_open method called:\n");
+    pattern = sysfs_match_string(gen_pattern_names, buf);
+    if(pattern < 0)
+        return pattern;
 
-    minor_num = MINOR(inode_ptr->i_rdev);
-    pr_info("minor number:%d:\n", minor_num);
-    
-    /*extract pointer to device data using cdev*/
-    dev_data = container_of(inode_ptr->i_cdev, struct dev_priv_data, dev_cdev);
+    config.pattern = pattern;
+    config.flags   = READ_ONCE(data_ptr->gen_flags);
+    config.rate    = READ_ONCE(data_ptr->gen_rate);
 
-    /*update file private data pointer with the device data pointer*/
-    file_ptr->private_data = dev_data;
+    err = gen_configure(data_ptr, &config);
+    return (err < 0) ? err : count;
+}
+static DEVICE_ATTR(pattern, 0644, gen_pattern_show, gen_pattern_store);
 
-    /*check if the requested permission compatable with device permission*/
-    err = check_file_permission(dev_data->permission, file_ptr->f_mode);
-    
-    if(err == 0)
-    {
-        pr_info("file opened successfully\n");
-    }
-    else
-    {
-        pr_info("file open failed\n");
-    }
-	return err;
+static ssize_t gen_rate_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%llu\n", READ_ONCE(data_ptr->gen_rate));
 }
-int pseudo_release (struct inode *inode_ptr, struct file *file_ptr)
+
+static ssize_t gen_rate_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
 {
-    pr_info("pseudo_release method called:\n");
-	return 0;
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+    struct n_pseudo_gen_config config;
+    int err;
+
+    config.pattern = READ_ONCE(data_ptr->gen_pattern);
+    config.flags   = READ_ONCE(data_ptr->gen_flags);
+
+    err = kstrtou64(buf, 0, &config.rate);
+    if(err < 0)
+        return err;
+
+    err = gen_configure(data_ptr, &config);
+    return (err < 0) ? err : count;
 }
+static DEVICE_ATTR(rate, 0644, gen_rate_show, gen_rate_store);
 
-ssize_t pseudo_read (struct file *file_ptr, char __user *buffer, size_t count, loff_t *f_pos)
+static ssize_t gen_prefill_show(struct device *dev, struct device_attribute *attr, char *buf)
 {
-    struct dev_priv_data *data_ptr = (struct dev_priv_data *)file_ptr->private_data;
-    size_t size = data_ptr->size;
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%d\n", !!(READ_ONCE(data_ptr->gen_flags) & N_PSEUDO_GEN_PREFILL));
+}
 
-    pr_info("pseudo_read method called, count:%zu, file position:%lld\n", count, *f_pos);
+static ssize_t gen_prefill_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+    struct n_pseudo_gen_config config;
+    bool prefill;
+    int err;
 
-    /*if the count exeeds the memory size truncate the count*/
-    if((count + *f_pos) > size)
-        count = size - *f_pos;
-    
-    /*copy data, note that this code is not thread safe*/
-    if(copy_to_user(buffer, data_ptr->data_buffer+(*f_pos), count) > 0)
-        return -EFAULT;
+    err = kstrtobool(buf, &prefill);
+    if(err < 0)
+        return err;
 
-    /*update file position*/
-    *f_pos = *f_pos + count;
+    config.pattern = READ_ONCE(data_ptr->gen_pattern);
+    config.flags   = READ_ONCE(data_ptr->gen_flags) & ~N_PSEUDO_GEN_PREFILL;
+    config.rate    = READ_ONCE(data_ptr->gen_rate);
+    if(prefill)
+        config.flags |= N_PSEUDO_GEN_PREFILL;
 
-    pr_info("number of bytes have been read%zu, file position:%lld\n", count, *f_pos);
-	return count;
+    err = gen_configure(data_ptr, &config);
+    return (err < 0) ? err : count;
 }
+static DEVICE_ATTR(prefill, 0644, gen_prefill_show, gen_prefill_store);
+
+static struct attribute *dev_gen_attrs[] = {
+    &dev_attr_pattern.attr,
+    &dev_attr_rate.attr,
+    &dev_attr_prefill.attr,
+    NULL
+};
 
-ssize_t pseudo_write (struct file *file_ptr, const char __user *buffer, size_t count, loff_t *f_pos)
+static umode_t dev_gen_visible(struct kobject *kobj, struct attribute *attr, int index)
 {
-    struct dev_priv_data *data_ptr = (struct dev_priv_data *)file_ptr->private_data;
-    size_t size = data_ptr->size;
+    struct dev_priv_data *data_ptr = dev_get_drvdata(kobj_to_dev(kobj));
+
+    return (data_ptr->mode == GEN_MODE) ? attr->mode : 0;
+}
+
+static const struct attribute_group dev_gen_group = {
+    .name       = "generator",
+    .attrs      = dev_gen_attrs,
+    .is_visible = dev_gen_visible,
+};
+
+static const struct attribute_group *dev_attr_groups[] = {
+    &dev_config_group,
+    &dev_stats_group,
+    &dev_gen_group,
+    NULL
+};
 
-	pr_info("pseudo_write method called, count:%zu, file position:%lld\n", count, *f_pos);
+/*module parameters section*/
+/*copy the item at index from a comma separated list, the last item is used for indexes beyond the list end*/
+void param_token(const char *list, int index, char *token, size_t len)
+{
+    const char *start = list;
+    const char *comma;
 
-    if(*f_pos == size)
+    while(index > 0)
     {
-        /*EOF*/
-        pr_info("no space left\n");
-        return -ENOMEM;
+        comma = strchr(start, ',');
+        if(comma == NULL)
+            break;
+
+        start = comma + 1;
+        index--;
     }
-    
-    /*if the count exeeds the memory size truncate the count*/
-    if((count + *f_pos) > size)
-        count = size - *f_pos;
-    
-    /*copy data, note that this code is not thread safe*/
-    if(copy_from_user(data_ptr->data_buffer+(*f_pos), buffer, count) > 0)
-        return -EFAULT;
 
-    /*update file position*/
-    *f_pos = *f_pos + count;
-        
-    pr_info("number of bytes have been written%zu, file position:%lld\n", count, *f_pos);
-	return count;
+    comma = strchrnul(start, ',');
+    strscpy(token, start, min_t(size_t, len, comma - start + 1));
 }
 
-loff_t pseudo_llseek (struct file *file_ptr, loff_t offset, int whence)
+int param_lookup(const char * const *names, int count, const char *token)
 {
-    struct dev_priv_data *data_ptr = (struct dev_priv_data *)file_ptr->private_data;
-    size_t size = data_ptr->size;
-    loff_t new_pos;
+    int itr;
 
-    pr_info("pseudo_llseek method called, current f_pos:%lld\n", file_ptr->f_pos);
-    
-    switch (whence)
+    for(itr=0; itr<count; itr++)
     {
-        case SEEK_SET:
-            /*return error if the file position will go beyond file memory or if it will be <0*/
-            if((offset > size) || (offset < 0))
-                return -EINVAL;
+        if((names[itr] != NULL) && (strcmp(names[itr], token) == 0))
+            return itr;
+    }
 
-            file_ptr->f_pos = offset;
-        break;
+    return -EINVAL;
+}
 
-        case SEEK_CUR:
-            new_pos = file_ptr->f_pos +offset;
-            
-            /*return error if the file position will go beyond file memory or if it will be <0*/
-            if( (new_pos > size) || (new_pos < 0) )
-                return -EINVAL;
-
-            file_ptr->f_pos = new_pos;
-        break;
-        
-        case SEEK_END:
-            new_pos = size + offset;
+int parse_dev_params(void)
+{
+    struct dev_priv_data *data_ptr;
+    char token[PARAM_TOKEN_LEN];
+    unsigned long long size;
+    char *end;
+    int itr;
 
-            /*return error if the file position will go beyond file memory or if it will be <0*/
-            if( (new_pos > size) || (new_pos < 0) )
-                return -EINVAL;
+    for(itr=0; itr<drv_data.dev_count; itr++)
+    {
+        data_ptr = &drv_data.devs_data[itr];
 
-            file_ptr->f_pos = new_pos;
-        break;
-        
-        default:
+        param_token(dev_sizes, itr, token, sizeof(token));
+        size = memparse(token, &end);
+        /*the size must fit size_t on 32 bit machines too*/
+        if((*end != '\0') || (size == 0) || (size != (size_t)size))
+        {
+            pr_err("device %d: invalid size %s\n", itr, token);
             return -EINVAL;
-        break;
-    }
-    pr_info("new f_pos:%lld\n", file_ptr->f_pos);
-	return file_ptr->f_pos;
+        }
+        data_ptr->size = size;
+
+        param_token(dev_perms, itr, token, sizeof(token));
+        data_ptr->permission = param_lookup(perm_names, ARRAY_SIZE(perm_names), token);
+        if(data_ptr->permission < 0)
+        {
+            pr_err("device %d: invalid permission %s\n", itr, token);
+            return -EINVAL;
+        }
+
+        param_token(dev_modes, itr, token, sizeof(token));
+        data_ptr->mode = param_lookup(mode_names, ARRAY_SIZE(mode_names), token);
+        if(data_ptr->mode < 0)
+        {
+            pr_err("device %d: invalid mode %s\n", itr, token);
+            return -EINVAL;
+        }
+
+        param_token(dev_nodes, itr, token, sizeof(token));
+        data_ptr->numa_node = parse_numa_node(token);
+        if(data_ptr->numa_node == -EINVAL)
+        {
+            pr_err("device %d: invalid node %s, it must be any, interleave or a node with memory\n", itr, token);
+            return -EINVAL;
+        }
+
+        /*fifo indexes are masked with size-1*/
+        if((data_ptr->mode == FIFO_MODE) && (!is_power_of_2(data_ptr->size) || (data_ptr->size > MAX_FIFO_MEM_SIZE)))
+        {
+            pr_err("device %d: fifo size must be power of 2 up to %lu\n", itr, MAX_FIFO_MEM_SIZE);
+            return -EINVAL;
+        }
+
+        /*log positions are masked with size-1, the headers alignment needs at least one header per record*/
+        if((data_ptr->mode == LOG_MODE) && (!is_power_of_2(data_ptr->size) || (data_ptr->size < 2 * LOG_HDR_SIZE) ||
+           (data_ptr->size > MAX_FIFO_MEM_SIZE)))
+        {
+            pr_err("device %d: log size must be power of 2 up to %lu\n", itr, MAX_FIFO_MEM_SIZE);
+            return -EINVAL;
+        }
+
+        /*the ring data is whole pages after the control page, and both sides write their index*/
+        if((data_ptr->mode == RING_MODE) && (!is_power_of_2(data_ptr->size) || (data_ptr->size < PAGE_SIZE) ||
+           (data_ptr->size > MAX_FIFO_MEM_SIZE) || (data_ptr->permission != RW_PERMISSION)))
+        {
+            pr_err("device %d: ring must be rw and its size power of 2 from %lu up to %lu\n", itr, PAGE_SIZE, MAX_FIFO_MEM_SIZE);
+            return -EINVAL;
+        }
+    }
+
+    /*the first device keeps its dummy data*/
+    if(drv_data.devs_data[0].mode == FLAT_MODE)
+        drv_data.devs_data[0].init_data = DEV0_INIT_DATA;
+
+    return 0;
+}
+
+/*node id, NUMA_ANY or NUMA_INTERLEAVE, EINVAL for unknown tokens and nodes without memory*/
+int parse_numa_node(const char *token)
+{
+    int node;
+
+    if(strcmp(token, "any") == 0)
+        return NUMA_ANY;
+
+    if(strcmp(token, "interleave") == 0)
+        return NUMA_INTERLEAVE;
+
+    if(kstrtoint(token, 0, &node) || (node < 0) || (node >= nr_node_ids) || !node_state(node, N_MEMORY))
+        return -EINVAL;
+
+    return node;
+}
+
+/*memory section*/
+/*the pages are allocated one by one on the device node, so large devices dont need contiguous memory*/
+/*alloc_pages_node prefers the node and falls back to the other nodes, numa_pages shows the result */
+int mem_alloc(struct dev_priv_data *data_ptr)
+{
+    bool interleave = (data_ptr->numa_node == NUMA_INTERLEAVE);
+    int node = interleave ? NUMA_NO_NODE : data_ptr->numa_node;
+    struct page *page;
+    unsigned long itr;
+    unsigned long sub;
+
+    /*ring devices have the control page in front of the data*/
+    data_ptr->nr_pages = DIV_ROUND_UP(data_ptr->size, PAGE_SIZE) + ((data_ptr->mode == RING_MODE) ? 1 : 0);
+
+    /*the array is read on every mmap, keep it on the node of the pages*/
+    data_ptr->pages = kvzalloc_node(array_size(data_ptr->nr_pages, sizeof(*data_ptr->pages)), GFP_KERNEL, node);
+    if(data_ptr->pages == NULL)
+        return -ENOMEM;
+
+    for(itr=0; itr<data_ptr->nr_pages; itr++)
+    {
+        /*interleaved devices move to the next memory node with every page or huge chunk*/
+        /*the first call returns the first node                                         */
+        if(interleave)
+            node = next_node_in(node, node_states[N_MEMORY]);
+
+        /*every PMD aligned range of a flat device tries a huge chunk first, fifo devices are never mapped*/
+        if(huge_pages && (HUGE_ORDER > 0) && (data_ptr->mode == FLAT_MODE) &&
+           IS_ALIGNED(itr, HUGE_NR_PAGES) && (data_ptr->nr_pages - itr >= HUGE_NR_PAGES))
+        {
+            /*no reclaim retries and no warning, the range falls back to small pages when memory is fragmented*/
+            page = alloc_pages_node(node, GFP_HIGHUSER | __GFP_ZERO | __GFP_COMP | __GFP_NORETRY | __GFP_NOWARN, HUGE_ORDER);
+            if(page != NULL)
+            {
+                for(sub=0; sub<HUGE_NR_PAGES; sub++)
+                    data_ptr->pages[itr + sub] = nth_page(page, sub);
+
+                data_ptr->nr_huge++;
+                itr += HUGE_NR_PAGES - 1;
+                cond_resched();
+                continue;
+            }
+        }
+
+        data_ptr->pages[itr] = alloc_pages_node(node, GFP_HIGHUSER | __GFP_ZERO, 0);
+        if(data_ptr->pages[itr] == NULL)
+            return -ENOMEM;
+
+        cond_resched();
+    }
+
+    /*one kernel mapping for the whole device, the memory functions use it like a buffer*/
+    data_ptr->data_buffer = vmap(data_ptr->pages, data_ptr->nr_pages, VM_MAP, PAGE_KERNEL);
+    if(data_ptr->data_buffer == NULL)
+        return -ENOMEM;
+
+    if(data_ptr->mode == LOG_MODE)
+    {
+        data_ptr->log_starts = bitmap_zalloc(data_ptr->size / LOG_HDR_SIZE, GFP_KERNEL);
+        if(data_ptr->log_starts == NULL)
+            return -ENOMEM;
+
+        /*the largest record fills the log without its header*/
+        data_ptr->log_bounce = kvmalloc(data_ptr->size - LOG_HDR_SIZE, GFP_KERNEL);
+        if(data_ptr->log_bounce == NULL)
+            return -ENOMEM;
+    }
+
+    return 0;
+}
+
+/*frees what mem_alloc allocated, also after a partial allocation*/
+void mem_free(struct dev_priv_data *data_ptr)
+{
+    unsigned long itr;
+
+    bitmap_free(data_ptr->log_starts);
+    data_ptr->log_starts = NULL;
+
+    kvfree(data_ptr->log_bounce);
+    data_ptr->log_bounce = NULL;
+
+    if(data_ptr->data_buffer != NULL)
+        vunmap(data_ptr->data_buffer);
+    data_ptr->data_buffer = NULL;
+
+    if(data_ptr->pages == NULL)
+        return;
+
+    for(itr=0; itr<data_ptr->nr_pages; itr++)
+    {
+        if(data_ptr->pages[itr] == NULL)
+            continue;
+
+        /*a huge chunk is freed once through its head page*/
+        if(PageHead(data_ptr->pages[itr]))
+        {
+            __free_pages(data_ptr->pages[itr], HUGE_ORDER);
+            itr += HUGE_NR_PAGES - 1;
+        }
+        else
+        {
+            __free_page(data_ptr->pages[itr]);
+        }
+    }
+
+    kvfree(data_ptr->pages);
+    data_ptr->pages = NULL;
+}
+
+/*code section*/
+static int __init pseudo_init(void)
+{
+    int node;
+    int err;
+    int itr;
+    int cpu;
+
+    if((ndevices == 0) || (ndevices > MAX_NUMBER_OF_DEVICES))
+    {
+        pr_err("ndevices must be in the range 1-%d\n", MAX_NUMBER_OF_DEVICES);
+        err = -EINVAL;
+        goto alloc_fail;
+    }
+    drv_data.dev_count = ndevices;
+
+    /*devices data is allocated dynamically, it grows with the devices count instead of being in .bss*/
+    drv_data.devs_data = kcalloc(drv_data.dev_count, sizeof(*drv_data.devs_data), GFP_KERNEL);
+    if(drv_data.devs_data == NULL)
+    {
+        pr_err("devices data allocation failed\n");
+        err = -ENOMEM;
+        goto alloc_fail;
+    }
+
+    err = parse_dev_params();
+    if(err < 0)
+        goto free_devs;
+
+    /*allocate device number*/
+    err = alloc_chrdev_region(&drv_data.dev_num, MINOR_NUM_START_NUMBER, drv_data.dev_count, "n pseudo memory devices");
+    if(err <0)
+    {
+        pr_err("chrdev alloc failed\n");
+        goto free_devs;
+    }
+    pr_info("start module intialization \n");
+
+    /*allocate devices memory, zeroed pages on the device node that can be mapped by pseudo_mmap*/
+    for(itr=0; itr<drv_data.dev_count; itr++)
+    {
+        err = mem_alloc(&drv_data.devs_data[itr]);
+        if(err < 0)
+        {
+            pr_err("device %d memory allocation failed, size:%zu\n", itr, drv_data.devs_data[itr].size);
+            goto free_mem;
+        }
+
+        if(drv_data.devs_data[itr].mode == RING_MODE)
+            ring_init(&drv_data.devs_data[itr]);
+
+        if(drv_data.devs_data[itr].mode == GEN_MODE)
+        {
+            err = gen_init(&drv_data.devs_data[itr]);
+            if(err < 0)
+            {
+                pr_err("device %d generator buffers allocation failed\n", itr);
+                goto free_mem;
+            }
+        }
+
+        if(drv_data.devs_data[itr].init_data != NULL)
+            strscpy(drv_data.devs_data[itr].data_buffer, drv_data.devs_data[itr].init_data, drv_data.devs_data[itr].size);
+
+        /*the bounce buffer of an interleaved device can be on any node*/
+        node = drv_data.devs_data[itr].numa_node;
+        drv_data.devs_data[itr].bounce_buffer = kmalloc_node(WRITE_CHUNK_SIZE, GFP_KERNEL, (node == NUMA_INTERLEAVE) ? NUMA_NO_NODE : node);
+        if(drv_data.devs_data[itr].bounce_buffer == NULL)
+        {
+            pr_err("device bounce buffer allocation failed\n");
+            err = -ENOMEM;
+            goto free_mem;
+        }
+
+        drv_data.devs_data[itr].stats = alloc_percpu(struct dev_stats);
+        if(drv_data.devs_data[itr].stats == NULL)
+        {
+            pr_err("device statistics allocation failed\n");
+            err = -ENOMEM;
+            goto free_mem;
+        }
+        for_each_possible_cpu(cpu)
+            u64_stats_init(&per_cpu_ptr(drv_data.devs_data[itr].stats, cpu)->syncp);
+
+        mutex_init(&drv_data.devs_data[itr].write_lock);
+        seqcount_mutex_init(&drv_data.devs_data[itr].mem_seq, &drv_data.devs_data[itr].write_lock);
+        mutex_init(&drv_data.devs_data[itr].read_lock);
+        init_waitqueue_head(&drv_data.devs_data[itr].read_queue);
+        init_waitqueue_head(&drv_data.devs_data[itr].write_queue);
+    }
+
+    /*create device class*/
+    drv_data.dev_class = class_create("n_pseudo_char_class");
+
+    /*if class creation failed, it doesnt return null, it returns pointer to error code*/
+    if(IS_ERR(drv_data.dev_class))
+    {
+        pr_err("class creation failed\n");
+        err = PTR_ERR(drv_data.dev_class);
+        goto free_mem;
+    }
+    
+    for(itr=0; itr<drv_data.dev_count; itr++)
+    {
+        /*debug level, printing hundreds of lines on a serial console would dominate the load time*/
+        pr_debug("major:%d,minor:%d\n", MAJOR(drv_data.dev_num+itr), MINOR(drv_data.dev_num+itr));
+
+        /*intialize cdev struct*/
+        cdev_init(&drv_data.devs_data[itr].dev_cdev, &pseudo_fops);
+        
+        /*cdev_init clears all cdev struct elements, so you need to intialize owner after cdev_init*/
+        drv_data.devs_data[itr].dev_cdev.owner = THIS_MODULE;
+
+        /*register the device in VFS*/
+        err = cdev_add(&drv_data.devs_data[itr].dev_cdev, drv_data.dev_num+itr, 1);
+        if(err <0)
+        {
+            pr_err("device registration failed\n");
+            goto cdev_del;
+        }
+    }
+    for(itr=0; itr<drv_data.dev_count; itr++)
+    {
+        /*create device files*/
+        drv_data.devs_data[itr].dev_ptr = device_create_with_groups(drv_data.dev_class, NULL, drv_data.dev_num+itr, &drv_data.devs_data[itr], dev_attr_groups, "pseudo_char_dev:%d",itr);
+        
+        if(IS_ERR(drv_data.devs_data[itr].dev_ptr))
+        {
+            pr_err("device creation failed\n");
+            err = PTR_ERR(drv_data.devs_data[itr].dev_ptr);
+            goto dev_del;
+        }
+
+    }
+
+    
+    pr_info("module intialization done without errors\n");
+    
+    return err;
+
+dev_del:
+    for(;itr>=0;itr--)
+        device_destroy(drv_data.dev_class, drv_data.dev_num+itr);
+    
+    /*reset the iterator to be used in cdev_del*/
+    itr = drv_data.dev_count-1;
+
+cdev_del:
+    for(;itr>=0;itr--)
+        cdev_del(&drv_data.devs_data[itr].dev_cdev);
+
+    class_destroy(drv_data.dev_class);
+
+free_mem:
+    /*mem_free, gen_free, kfree and free_percpu ignore NULL pointers, so it is safe to free all buffers*/
+    for(itr=0; itr<drv_data.dev_count; itr++)
+    {
+        mem_free(&drv_data.devs_data[itr]);
+        gen_free(&drv_data.devs_data[itr]);
+        kfree(drv_data.devs_data[itr].bounce_buffer);
+        drv_data.devs_data[itr].bounce_buffer = NULL;
+        free_percpu(drv_data.devs_data[itr].stats);
+        drv_data.devs_data[itr].stats = NULL;
+    }
+
+    /*dealloc device number*/
+    unregister_chrdev_region(drv_data.dev_num, drv_data.dev_count);
+
+free_devs:
+    kfree(drv_data.devs_data);
+    drv_data.devs_data = NULL;
+
+alloc_fail:
+    pr_info("module intialization failed\n");
+    return err;
+
+}
+
+static void __exit pseudo_deinit(void)
+{
+	pr_info("unload pseudo char driver\n");
+
+    for(int itr=0;itr<drv_data.dev_count;itr++)
+    {
+        device_destroy(drv_data.dev_class, drv_data.dev_num+itr);
+        cdev_del(&drv_data.devs_data[itr].dev_cdev);
+        mem_free(&drv_data.devs_data[itr]);
+        gen_free(&drv_data.devs_data[itr]);
+        kfree(drv_data.devs_data[itr].bounce_buffer);
+        free_percpu(drv_data.devs_data[itr].stats);
+    }
+    class_destroy(drv_data.dev_class);
+    
+    /*dealloc device number*/
+    unregister_chrdev_region(drv_data.dev_num, drv_data.dev_count);
+
+    kfree(drv_data.devs_data);
+
+}
+
+int pseudo_open (struct inode *inode_ptr, struct file *file_ptr)
+{
+    int err;
+    int minor_num;
+    struct dev_priv_data *dev_data;
+
+    minor_num = MINOR(inode_ptr->i_rdev);
+    
+    /*extract pointer to device data using cdev*/
+    dev_data = container_of(inode_ptr->i_cdev, struct dev_priv_data, dev_cdev);
+
+    /*update file private data pointer with the device data pointer*/
+    file_ptr->private_data = dev_data;
+
+    /*check if the requested permission compatable with device permission*/
+    err = check_file_permission(dev_data->permission, file_ptr->f_mode);
+    
+    if(err == 0)
+    {
+        /*fifo and ring devices are streams, the file position is not used and seeking is not allowed*/
+        /*flat and gen devices get the regular file position rules, read, write and llseek on a   */
+        /*shared file are serialized by the file position lock, pread and pwrite use the         */
+        /*position they get and never take that lock                                             */
+        /*log devices keep the file position as the reader cursor, a new file starts at the oldest record*/
+        /*the cursor is valid only on record boundaries, so pread and pwrite are not allowed            */
+        if(dev_data->mode == LOG_MODE)
+        {
+            file_ptr->f_pos = READ_ONCE(dev_data->log_tail);
+            file_ptr->f_mode |= FMODE_ATOMIC_POS;
+            file_ptr->f_mode &= ~(FMODE_PREAD | FMODE_PWRITE);
+        }
+        else if((dev_data->mode != FLAT_MODE) && (dev_data->mode != GEN_MODE))
+        {
+            stream_open(inode_ptr, file_ptr);
+        }
+
+        /*the side counts tell fifo_lock whether a reader or a writer is alone on its side*/
+        if(dev_data->mode == FIFO_MODE)
+            fifo_count_files(&dev_data->fifo, file_ptr, 1);
+        else
+        {
+            file_ptr->f_mode |= FMODE_ATOMIC_POS;
+        }
+
+        /*read_iter and write_iter honor IOCB_NOWAIT, so io_uring can complete requests inline*/
+        /*instead of handing them to its worker threads*/
+        file_ptr->f_mode |= FMODE_NOWAIT;
+
+        stats_account_op(dev_data, STAT_OPENS, 0);
+    }
+
+    trace_n_pseudo_open(minor_num, (__force unsigned int)file_ptr->f_mode, err);
+	return err;
+}
+int pseudo_release (struct inode *inode_ptr, struct file *file_ptr)
+{
+    struct dev_priv_data *data_ptr = (struct dev_priv_data *)file_ptr->private_data;
+
+    if(data_ptr->mode == FIFO_MODE)
+        fifo_count_files(&data_ptr->fifo, file_ptr, -1);
+
+	return 0;
+}
+
+ssize_t pseudo_read_iter (struct kiocb *iocb, struct iov_iter *to)
+{
+    struct dev_priv_data *data_ptr = (struct dev_priv_data *)iocb->ki_filp->private_data;
+    size_t count = iov_iter_count(to);
+    loff_t pos = iocb->ki_pos;
+    u64 start;
+    u64 latency;
+    ssize_t ret;
+
+    start = ktime_get_ns();
+    ret = mem_read_iter(iocb, data_ptr, to);
+    latency = ktime_get_ns() - start;
+
+    /*statistics are always on, they touch only this cpu copy*/
+    stats_account_io(data_ptr, true, ret, count, latency);
+    trace_n_pseudo_read(iminor(file_inode(iocb->ki_filp)), count, pos, ret, latency);
+
+    return ret;
+}
+
+ssize_t mem_read_iter(struct kiocb *iocb, struct dev_priv_data *data_ptr, struct iov_iter *to)
+{
+    size_t size = data_ptr->size;
+    size_t count = iov_iter_count(to);
+    ssize_t copied;
+
+    /*fifo devices are opened as streams, the file position is not used for them*/
+    if(data_ptr->mode == FIFO_MODE)
+        return fifo_read(iocb, to, &data_ptr->fifo, data_ptr->data_buffer, data_ptr->size,
+                         &data_ptr->read_lock, &data_ptr->read_queue, &data_ptr->write_queue);
+
+    if(data_ptr->mode == LOG_MODE)
+        return log_read(iocb, data_ptr, to);
+
+    if(data_ptr->mode == GEN_MODE)
+        return gen_read(iocb, data_ptr, to);
+
+    /*the ring indexes belong to user space, the data is accessed through the mapping only*/
+    if(data_ptr->mode == RING_MODE)
+        return -EINVAL;
+
+    /*positional reads can start at any offset, nothing to read beyond the memory*/
+    if(iocb->ki_pos >= size)
+        return 0;
+
+    /*if the count exeeds the memory size truncate the count*/
+    if((count + iocb->ki_pos) > size)
+        count = size - iocb->ki_pos;
+    
+    /*copy data, readers run in parallel without taking any lock*/
+    /*all the iov segments are filled in one call*/
+    copied = copy_mem_to_iter(iocb, data_ptr, to, iocb->ki_pos, count);
+    if(copied < 0)
+        return copied;
+
+    /*update file position*/
+    iocb->ki_pos = iocb->ki_pos + copied;
+
+	return copied;
+}
+
+ssize_t pseudo_write_iter (struct kiocb *iocb, struct iov_iter *from)
+{
+    struct dev_priv_data *data_ptr = (struct dev_priv_data *)iocb->ki_filp->private_data;
+    size_t count = iov_iter_count(from);
+    loff_t pos = iocb->ki_pos;
+    u64 start;
+    u64 latency;
+    ssize_t ret;
+
+    start = ktime_get_ns();
+    ret = mem_write_iter(iocb, data_ptr, from);
+    latency = ktime_get_ns() - start;
+
+    /*statistics are always on, they touch only this cpu copy*/
+    stats_account_io(data_ptr, false, ret, count, latency);
+    trace_n_pseudo_write(iminor(file_inode(iocb->ki_filp)), count, pos, ret, latency);
+
+    return ret;
+}
+
+ssize_t mem_write_iter(struct kiocb *iocb, struct dev_priv_data *data_ptr, struct iov_iter *from)
+{
+    size_t size = data_ptr->size;
+    size_t count = iov_iter_count(from);
+    ssize_t written;
+
+    /*fifo devices are opened as streams, the file position is not used for them*/
+    if(data_ptr->mode == FIFO_MODE)
+        return fifo_write(iocb, from, &data_ptr->fifo, data_ptr->data_buffer, data_ptr->size,
+                          &data_ptr->write_lock, &data_ptr->read_queue, &data_ptr->write_queue);
+
+    if(data_ptr->mode == LOG_MODE)
+        return log_write(iocb, data_ptr, from);
+
+    if(data_ptr->mode == RING_MODE)
+        return -EINVAL;
+
+    /*gen devices are written like flat devices, the data is the template*/
+
+    /*EOF, no space left*/
+    if(iocb->ki_pos >= size)
+        return -ENOMEM;
+    
+    /*if the count exeeds the memory size truncate the count*/
+    if((count + iocb->ki_pos) > size)
+        count = size - iocb->ki_pos;
+    
+    /*copy data, writers are serialized by the device write lock*/
+    written = copy_mem_from_iter(iocb, data_ptr, from, iocb->ki_pos, count);
+    if(written < 0)
+        return written;
+
+    /*update file position*/
+    iocb->ki_pos = iocb->ki_pos + written;
+        
+	return written;
+}
+
+loff_t pseudo_llseek (struct file *file_ptr, loff_t offset, int whence)
+{
+    struct dev_priv_data *data_ptr = (struct dev_priv_data *)file_ptr->private_data;
+    loff_t new_pos;
+
+    /*the generic helper returns EINVAL if the file position will go beyond file memory or if it*/
+    /*will be <0, it updates f_pos with vfs_setpos and does SEEK_CUR atomically under f_lock     */
+    /*gen devices are endless, their reads go up to the largest file offset*/
+    if(data_ptr->mode == LOG_MODE)
+        new_pos = log_llseek(file_ptr, data_ptr, offset, whence);
+    else if(data_ptr->mode == GEN_MODE)
+        new_pos = fixed_size_llseek(file_ptr, offset, whence, MAX_LFS_FILESIZE);
+    else
+        new_pos = fixed_size_llseek(file_ptr, offset, whence, data_ptr->size);
+
+    stats_account_op(data_ptr, STAT_LLSEEKS, new_pos);
+    trace_n_pseudo_llseek(iminor(file_inode(file_ptr)), offset, whence, new_pos);
+	return new_pos;
+}
+
+int pseudo_mmap (struct file *file_ptr, struct vm_area_struct *vma)
+{
+    struct dev_priv_data *data_ptr = (struct dev_priv_data *)file_ptr->private_data;
+
+    /*fifo and log memory layout is internal to the driver, only flat and ring devices can be mapped*/
+    /*gen devices content is generated on read, there are no pages behind it*/
+    if((data_ptr->mode == FIFO_MODE) || (data_ptr->mode == LOG_MODE) || (data_ptr->mode == GEN_MODE))
+        return -ENODEV;
+
+    /*both sides of a ring must see the same pages*/
+    if((data_ptr->mode == RING_MODE) && !(vma->vm_flags & VM_SHARED))
+        return -EINVAL;
+
+    /*user space mapping needs read access, so write only devices can not be mapped*/
+    if(!(data_ptr->permission & RONLY_PERMISSION))
+        return -EACCES;
+
+    /*read only devices accept only read only mappings, clearing VM_MAYWRITE stops mprotect from adding write access later*/
+    if(!(data_ptr->permission & WONLY_PERMISSION))
+    {
+        if(vma->vm_flags & VM_WRITE)
+            return -EACCES;
+
+        vm_flags_clear(vma, VM_MAYWRITE);
+    }
+
+    /*map the device pages directly into user space, no copy is needed after that*/
+    /*private writable mappings copy the pages they write, that needs normal page mappings*/
+    /*vm_map_pages returns -ENXIO if the mapping goes beyond the device memory*/
+    if(is_cow_mapping(vma->vm_flags))
+        return vm_map_pages(vma, data_ptr->pages, data_ptr->nr_pages);
+
+    if((vma->vm_pgoff >= data_ptr->nr_pages) || (vma_pages(vma) > data_ptr->nr_pages - vma->vm_pgoff))
+        return -ENXIO;
+
+    /*the other mappings insert the pages on fault, with one PMD entry per huge chunk where the mapping allows it*/
+    /*the pages are not refcounted by the mapping, the open file keeps the module and so the memory alive      */
+    /*VM_HUGEPAGE enables PMD faults when the THP mode is madvise, MADV_NOHUGEPAGE still turns them off      */
+    vm_flags_set(vma, VM_PFNMAP | VM_DONTEXPAND | VM_DONTDUMP | VM_HUGEPAGE);
+    vma->vm_ops = &pseudo_vm_ops;
+    return 0;
+}
+
+vm_fault_t pseudo_vm_fault (struct vm_fault *vmf)
+{
+    struct dev_priv_data *data_ptr = (struct dev_priv_data *)vmf->vma->vm_file->private_data;
+
+    /*the mapping can not grow, so this only guards against a bad offset*/
+    if(vmf->pgoff >= data_ptr->nr_pages)
+        return VM_FAULT_SIGBUS;
+
+    return vmf_insert_pfn(vmf->vma, vmf->address, page_to_pfn(data_ptr->pages[vmf->pgoff]));
+}
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*map a whole huge chunk, any range that is not exactly one chunk falls back to pseudo_vm_fault*/
+vm_fault_t pseudo_vm_huge_fault (struct vm_fault *vmf, unsigned int order)
+{
+    struct vm_area_struct *vma = vmf->vma;
+    struct dev_priv_data *data_ptr = (struct dev_priv_data *)vma->vm_file->private_data;
+    unsigned long haddr = vmf->address & PMD_MASK;
+    struct page *page;
+    pgoff_t pgoff;
+
+    if(order != HUGE_ORDER)
+        return VM_FAULT_FALLBACK;
+
+    if((haddr < vma->vm_start) || (haddr + PMD_SIZE > vma->vm_end))
+        return VM_FAULT_FALLBACK;
+
+    pgoff = vma->vm_pgoff + ((haddr - vma->vm_start) >> PAGE_SHIFT);
+    if(!IS_ALIGNED(pgoff, HUGE_NR_PAGES) || (pgoff + HUGE_NR_PAGES > data_ptr->nr_pages))
+        return VM_FAULT_FALLBACK;
+
+    page = data_ptr->pages[pgoff];
+    if(!PageHead(page))
+        return VM_FAULT_FALLBACK;
+
+    return vmf_insert_pfn_pmd(vmf, page_to_pfn_t(page), vmf->flags & FAULT_FLAG_WRITE);
+}
+#endif
+
+ssize_t copy_mem_to_iter(struct kiocb *iocb, struct dev_priv_data *data_ptr, struct iov_iter *to, loff_t pos, size_t count)
+{
+    unsigned int seq;
+    size_t copied;
+    int retries;
+
+    for(retries=0; retries<MAX_READ_RETRIES; retries++)
+    {
+        seq = read_seqcount_begin(&data_ptr->mem_seq);
+
+        /*copy_to_iter may fault and sleep, that is fine because no lock is held here*/
+        copied = copy_to_iter(data_ptr->data_buffer+pos, count, to);
+
+        /*the copy is consistent if no writer touched the memory while copying*/
+        if(!read_seqcount_retry(&data_ptr->mem_seq, seq))
+            goto done;
+
+        /*rewind the iterator to copy the same range again*/
+        iov_iter_revert(to, copied);
+    }
+
+    /*writers keep changing the memory, take the write lock so the reader is not starved*/
+    if(iocb->ki_flags & IOCB_NOWAIT)
+    {
+        if(!mutex_trylock(&data_ptr->write_lock))
+            return -EAGAIN;
+    }
+    else
+    {
+        mutex_lock(&data_ptr->write_lock);
+    }
+    copied = copy_to_iter(data_ptr->data_buffer+pos, count, to);
+    mutex_unlock(&data_ptr->write_lock);
+
+done:
+    /*report the fault only if nothing was copied, otherwise return the copied part*/
+    if((copied == 0) && (count > 0))
+        return -EFAULT;
+
+    return copied;
+}
+
+ssize_t copy_mem_from_iter(struct kiocb *iocb, struct dev_priv_data *data_ptr, struct iov_iter *from, loff_t pos, size_t count)
+{
+    size_t done;
+
+    /*non blocking callers like io_uring inline submission must not sleep on the lock*/
+    if(iocb->ki_flags & IOCB_NOWAIT)
+    {
+        if(!mutex_trylock(&data_ptr->write_lock))
+            return -EAGAIN;
+    }
+    else
+    {
+        mutex_lock(&data_ptr->write_lock);
+    }
+
+    done = copy_mem_from_iter_locked(data_ptr, from, pos, count);
+    mutex_unlock(&data_ptr->write_lock);
+
+    /*report the fault only if nothing was written, otherwise return the written part*/
+    if((done == 0) && (count > 0))
+        return -EFAULT;
+
+    return done;
+}
+
+/*the caller holds write_lock*/
+size_t copy_mem_from_iter_locked(struct dev_priv_data *data_ptr, struct iov_iter *from, loff_t pos, size_t count)
+{
+    size_t done = 0;
+    size_t chunk;
+    size_t copied;
+
+    while(done < count)
+    {
+        chunk = min_t(size_t, count - done, WRITE_CHUNK_SIZE);
+
+        /*copy user data outside the write section, copy_from_iter may sleep*/
+        copied = copy_from_iter(data_ptr->bounce_buffer, chunk, from);
+        if(copied == 0)
+            break;
+
+        /*readers that overlap this section will retry their copy*/
+        write_seqcount_begin(&data_ptr->mem_seq);
+        memcpy(data_ptr->data_buffer+pos+done, data_ptr->bounce_buffer, copied);
+        write_seqcount_end(&data_ptr->mem_seq);
+
+        done += copied;
+
+        /*a short copy means the user buffer faulted*/
+        if(copied < chunk)
+            break;
+    }
+
+    return done;
+}
+
+/*ring section*/
+/*the driver never moves the ring indexes, it publishes the geometry and wakes the sleepers*/
+void ring_init(struct dev_priv_data *data_ptr)
+{
+    data_ptr->ring_ctrl = (struct n_pseudo_ring_ctrl *)data_ptr->data_buffer;
+    data_ptr->ring_ctrl->size = data_ptr->size;
+    data_ptr->ring_ctrl->data_offset = PAGE_SIZE;
+}
+
+/*the indexes are read after the waiter is queued, so a kick that follows an index update can not be missed*/
+/*the values come from user space, a corrupted ring only gives wrong poll results to its own users      */
+__poll_t ring_poll(struct file *file_ptr, struct dev_priv_data *data_ptr, struct poll_table_struct *wait)
+{
+    struct n_pseudo_ring_ctrl *ctrl = data_ptr->ring_ctrl;
+    __poll_t mask = 0;
+    u32 head;
+    u32 tail;
+
+    poll_wait(file_ptr, &data_ptr->read_queue, wait);
+    poll_wait(file_ptr, &data_ptr->write_queue, wait);
+
+    /*pairs with the barrier user space puts between its index update and the waiting flag check*/
+    smp_mb();
+    head = READ_ONCE(ctrl->head);
+    tail = READ_ONCE(ctrl->tail);
+
+    if(head != tail)
+        mask |= EPOLLIN | EPOLLRDNORM;
+    if(head - tail < data_ptr->size)
+        mask |= EPOLLOUT | EPOLLWRNORM;
+
+    return mask;
+}
+
+/*called by a side that moved its index and found the waiting flag of the other side set*/
+long ring_kick(struct dev_priv_data *data_ptr)
+{
+    if(data_ptr->mode != RING_MODE)
+        return -EINVAL;
+
+    wake_up_interruptible(&data_ptr->read_queue);
+    wake_up_interruptible(&data_ptr->write_queue);
+    return 0;
+}
+
+/*log section*/
+/*a record is a u32 length followed by the data, the next record starts at the next LOG_HDR_SIZE boundary*/
+/*readers copy without any lock and trust the copy only if log_tail did not pass their cursor meanwhile  */
+void log_copy_from(struct dev_priv_data *data_ptr, unsigned long pos, void *dst, size_t len)
+{
+    size_t size = data_ptr->size;
+    size_t offset = pos & (size - 1);
+    size_t first = min_t(size_t, len, size - offset);
+
+    memcpy(dst, data_ptr->data_buffer+offset, first);
+    memcpy((char *)dst + first, data_ptr->data_buffer, len - first);
+}
+
+/*one record per read like /dev/kmsg, a buffer shorter than the record gets EINVAL and the cursor stays*/
+/*a cursor that fell behind the oldest record gets EPIPE once and moves to the oldest record           */
+/*a cursor after the newest record or inside a record gets EINVAL, only aio and io_uring can pass one  */
+ssize_t log_read(struct kiocb *iocb, struct dev_priv_data *data_ptr, struct iov_iter *to)
+{
+    struct file *file_ptr = iocb->ki_filp;
+    size_t size = data_ptr->size;
+    unsigned long pos = iocb->ki_pos;
+    bool nonblock = (file_ptr->f_flags & O_NONBLOCK) || (iocb->ki_flags & IOCB_NOWAIT);
+    unsigned long head;
+    bool start;
+    size_t offset;
+    size_t first;
+    size_t copied;
+    u32 len;
+
+    /*wait for a record after the cursor, every reader is woken by every write*/
+    while((head = smp_load_acquire(&data_ptr->log_head)) == pos)
+    {
+        if(nonblock)
+            return -EAGAIN;
+
+        if(wait_event_interruptible(data_ptr->read_queue, READ_ONCE(data_ptr->log_head) != pos))
+            return -ERESTARTSYS;
+    }
+
+    if((long)(pos - READ_ONCE(data_ptr->log_tail)) < 0)
+        goto overrun;
+
+    if(((long)(head - pos) < 0) || !IS_ALIGNED(pos, LOG_HDR_SIZE))
+        return -EINVAL;
+
+    /*the start bit and the length are checked against the tail too, a writer that reuses the slot*/
+    /*moves the tail past it before it changes them                                                */
+    start = test_bit((pos & (size - 1)) / LOG_HDR_SIZE, data_ptr->log_starts);
+    log_copy_from(data_ptr, pos, &len, LOG_HDR_SIZE);
+    smp_rmb();
+    if((long)(pos - READ_ONCE(data_ptr->log_tail)) < 0)
+        goto overrun;
+
+    /*the length bound keeps the copy in the buffer even if the header is not what the writer wrote*/
+    if(!start || (len > size - LOG_HDR_SIZE))
+        return -EINVAL;
+
+    if(len > iov_iter_count(to))
+        return -EINVAL;
+
+    /*the record data may wrap around the end of the buffer*/
+    offset = (pos + LOG_HDR_SIZE) & (size - 1);
+    first = min_t(size_t, len, size - offset);
+    copied = copy_to_iter(data_ptr->data_buffer+offset, first, to);
+    if(copied == first)
+        copied += copy_to_iter(data_ptr->data_buffer, len - first, to);
+
+    /*the writer publishes the new tail before it overwrites a record, so an unchanged tail means an intact copy*/
+    smp_rmb();
+    if((long)(pos - READ_ONCE(data_ptr->log_tail)) < 0)
+    {
+        iov_iter_revert(to, copied);
+        goto overrun;
+    }
+
+    /*a record is delivered whole or not at all*/
+    if(copied != len)
+    {
+        iov_iter_revert(to, copied);
+        return -EFAULT;
+    }
+
+    iocb->ki_pos = pos + ALIGN(LOG_HDR_SIZE + len, LOG_HDR_SIZE);
+    return len;
+
+overrun:
+    iocb->ki_pos = READ_ONCE(data_ptr->log_tail);
+    return -EPIPE;
+}
+
+/*every write is one record, the writer drops the oldest records to make space and never waits for readers*/
+ssize_t log_write(struct kiocb *iocb, struct dev_priv_data *data_ptr, struct iov_iter *from)
+{
+    struct file *file_ptr = iocb->ki_filp;
+    size_t size = data_ptr->size;
+    size_t count = iov_iter_count(from);
+    bool nonblock = (file_ptr->f_flags & O_NONBLOCK) || (iocb->ki_flags & IOCB_NOWAIT);
+    unsigned long head;
+    unsigned long tail;
+    unsigned long end;
+    unsigned long slot;
+    unsigned long slots;
+    size_t offset;
+    size_t first;
+    size_t copied;
+    u32 len;
+
+    /*the record and its header must fit the log*/
+    if(count > size - LOG_HDR_SIZE)
+        return -EINVAL;
+
+    /*an empty record would read as end of file*/
+    if(count == 0)
+        return 0;
+
+    /*writers are serialized between each other only, readers never take this lock*/
+    if(nonblock)
+    {
+        if(!mutex_trylock(&data_ptr->write_lock))
+            return -EAGAIN;
+    }
+    else if(mutex_lock_interruptible(&data_ptr->write_lock))
+    {
+        return -ERESTARTSYS;
+    }
+
+    /*the record is copied before the log is changed, a fault drops no record and publishes nothing*/
+    copied = copy_from_iter(data_ptr->log_bounce, count, from);
+    if(copied != count)
+    {
+        mutex_unlock(&data_ptr->write_lock);
+        return -EFAULT;
+    }
+
+    head = data_ptr->log_head;
+    tail = data_ptr->log_tail;
+    end = head + ALIGN(LOG_HDR_SIZE + count, LOG_HDR_SIZE);
+
+    /*drop the oldest records until the new one fits, their slow readers get EPIPE*/
+    while(end - tail > size)
+    {
+        log_copy_from(data_ptr, tail, &len, LOG_HDR_SIZE);
+        tail += ALIGN(LOG_HDR_SIZE + len, LOG_HDR_SIZE);
+    }
+
+    /*publish the tail before the dropped records are overwritten*/
+    WRITE_ONCE(data_ptr->log_tail, tail);
+    smp_wmb();
+
+    /*the new record slots may hold the starts of dropped records, only its first slot is a start*/
+    slot = (head & (size - 1)) / LOG_HDR_SIZE;
+    slots = (end - head) / LOG_HDR_SIZE;
+    first = min_t(size_t, slots, size / LOG_HDR_SIZE - slot);
+    bitmap_clear(data_ptr->log_starts, slot, first);
+    bitmap_clear(data_ptr->log_starts, 0, slots - first);
+    __set_bit(slot, data_ptr->log_starts);
+
+    /*the header is aligned, so it never wraps, the data may wrap around the end of the buffer*/
+    len = count;
+    memcpy(data_ptr->data_buffer+(head & (size - 1)), &len, LOG_HDR_SIZE);
+
+    offset = (head + LOG_HDR_SIZE) & (size - 1);
+    first = min_t(size_t, count, size - offset);
+    memcpy(data_ptr->data_buffer+offset, data_ptr->log_bounce, first);
+    memcpy(data_ptr->data_buffer, data_ptr->log_bounce+first, count-first);
+
+    /*publish the record to the readers*/
+    smp_store_release(&data_ptr->log_head, end);
+    mutex_unlock(&data_ptr->write_lock);
+
+    wake_up_interruptible(&data_ptr->read_queue);
+    return count;
+}
+
+/*the cursor can move only to the log ends, other positions are not known to be record boundaries*/
+/*SEEK_SET 0 is the oldest record, SEEK_END 0 skips to the records written from now on*/
+/*llseek runs under the file position lock, so the cursor is set directly*/
+loff_t log_llseek(struct file *file_ptr, struct dev_priv_data *data_ptr, loff_t offset, int whence)
+{
+    if(offset != 0)
+        return -EINVAL;
+
+    switch(whence)
+    {
+        case SEEK_SET:
+            file_ptr->f_pos = READ_ONCE(data_ptr->log_tail);
+            break;
+
+        case SEEK_END:
+            file_ptr->f_pos = READ_ONCE(data_ptr->log_head);
+            break;
+
+        case SEEK_CUR:
+            break;
+
+        default:
+            return -EINVAL;
+    }
+
+    return file_ptr->f_pos;
+}
+
+/*writers never block, readers are ready when a record follows their cursor or it was overwritten*/
+__poll_t log_poll(struct file *file_ptr, struct dev_priv_data *data_ptr, struct poll_table_struct *wait)
+{
+    unsigned long pos = READ_ONCE(file_ptr->f_pos);
+    __poll_t mask = EPOLLOUT | EPOLLWRNORM;
+
+    poll_wait(file_ptr, &data_ptr->read_queue, wait);
+
+    if(READ_ONCE(data_ptr->log_head) != pos)
+        mask |= EPOLLIN | EPOLLRDNORM;
+
+    /*like /dev/kmsg, the next read returns EPIPE*/
+    if((long)(pos - READ_ONCE(data_ptr->log_tail)) < 0)
+        mask |= EPOLLERR | EPOLLPRI;
+
+    return mask;
+}
+
+/*generator section*/
+/*the bytes at an offset depend only on the offset, so readers share no state and take no lock*/
+/*the prng pages are filled once with the first N_PSEUDO_GEN_PREFILL_SIZE bytes of the stream */
+int gen_init(struct dev_priv_data *data_ptr)
+{
+    struct page *page;
+    int cpu;
+
+    data_ptr->gen_pattern = N_PSEUDO_GEN_COUNTER;
+    data_ptr->gen_flags   = N_PSEUDO_GEN_PREFILL;
+    data_ptr->gen_rate    = 0;
+    data_ptr->gen_tat     = 0;
+    spin_lock_init(&data_ptr->gen_lock);
+
+    data_ptr->gen_prefill = kcalloc(nr_cpu_ids, sizeof(*data_ptr->gen_prefill), GFP_KERNEL);
+    if(data_ptr->gen_prefill == NULL)
+        return -ENOMEM;
+
+    for_each_possible_cpu(cpu)
+    {
+        page = alloc_pages_node(cpu_to_node(cpu), GFP_KERNEL, get_order(N_PSEUDO_GEN_PREFILL_SIZE));
+        if(page == NULL)
+            return -ENOMEM;
+
+        data_ptr->gen_prefill[cpu] = page_address(page);
+        gen_fill(N_PSEUDO_GEN_PRNG, (u64 *)data_ptr->gen_prefill[cpu], 0, N_PSEUDO_GEN_PREFILL_SIZE / sizeof(u64));
+    }
+
+    return 0;
+}
+
+/*frees what gen_init allocated, also after a partial allocation*/
+void gen_free(struct dev_priv_data *data_ptr)
+{
+    int cpu;
+
+    if(data_ptr->gen_prefill == NULL)
+        return;
+
+    for_each_possible_cpu(cpu)
+    {
+        if(data_ptr->gen_prefill[cpu] != NULL)
+            free_pages((unsigned long)data_ptr->gen_prefill[cpu], get_order(N_PSEUDO_GEN_PREFILL_SIZE));
+    }
+
+    kfree(data_ptr->gen_prefill);
+    data_ptr->gen_prefill = NULL;
+}
+
+/*the configuration is updated under write_lock, so two updates never mix their fields*/
+/*a rate change drops the time reserved by the old rate                                */
+int gen_configure(struct dev_priv_data *data_ptr, const struct n_pseudo_gen_config *config)
+{
+    if((config->pattern >= ARRAY_SIZE(gen_pattern_names)) || (config->flags & ~N_PSEUDO_GEN_PREFILL))
+        return -EINVAL;
+
+    if(mutex_lock_interruptible(&data_ptr->write_lock))
+        return -ERESTARTSYS;
+
+    WRITE_ONCE(data_ptr->gen_pattern, config->pattern);
+    WRITE_ONCE(data_ptr->gen_flags, config->flags);
+    if(config->rate != data_ptr->gen_rate)
+    {
+        WRITE_ONCE(data_ptr->gen_rate, config->rate);
+        spin_lock(&data_ptr->gen_lock);
+        data_ptr->gen_tat = 0;
+        spin_unlock(&data_ptr->gen_lock);
+    }
+
+    mutex_unlock(&data_ptr->write_lock);
+    return 0;
+}
+
+/*the configuration is shared by all readers of the device, so changing it needs a file opened for writing*/
+long ioctl_gen(struct file *file_ptr, struct dev_priv_data *data_ptr, unsigned int cmd, struct n_pseudo_gen_config __user *user_config)
+{
+    struct n_pseudo_gen_config config;
+
+    if(data_ptr->mode != GEN_MODE)
+        return -EINVAL;
+
+    if(cmd == N_PSEUDO_IOC_GEN_GET)
+    {
+        config.pattern = READ_ONCE(data_ptr->gen_pattern);
+        config.flags   = READ_ONCE(data_ptr->gen_flags);
+        config.rate    = READ_ONCE(data_ptr->gen_rate);
+
+        return copy_to_user(user_config, &config, sizeof(config)) ? -EFAULT : 0;
+    }
+
+    if(!(file_ptr->f_mode & FMODE_WRITE))
+        return -EBADF;
+
+    if(copy_from_user(&config, user_config, sizeof(config)))
+        return -EFAULT;
+
+    return gen_configure(data_ptr, &config);
+}
+
+/*splitmix64 of the word index, every word is computed on its own so any offset can be read directly*/
+u64 gen_prng_word(u64 index)
+{
+    u64 x = index * 0x9e3779b97f4a7c15ULL;
+
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/*the words dont depend on each other, so the loops unroll and pipeline well*/
+/*kernel code can not use the vector registers without kernel_fpu_begin, and */
+/*that would also disable preemption around the user copy                    */
+void gen_fill(int pattern, u64 *words, u64 first, unsigned int nr)
+{
+    unsigned int itr;
+
+    if(pattern == N_PSEUDO_GEN_COUNTER)
+    {
+        for(itr=0; itr<nr; itr++)
+            words[itr] = first + itr;
+    }
+    else
+    {
+        for(itr=0; itr<nr; itr++)
+            words[itr] = gen_prng_word(first + itr);
+    }
+}
+
+/*copies count bytes starting at pos of a buffer that repeats every period bytes*/
+size_t gen_copy_repeat(const char *buf, size_t period, loff_t pos, size_t count, struct iov_iter *to)
+{
+    u64 offset;
+    size_t done = 0;
+    size_t copied;
+    size_t len;
+
+    div64_u64_rem(pos, period, &offset);
+    while(done < count)
+    {
+        len = min_t(size_t, count - done, period - offset);
+        copied = copy_to_iter(buf+offset, len, to);
+        done += copied;
+        if(copied != len)
+            break;
+
+        offset = 0;
+    }
+
+    return done;
+}
+
+/*fills one chunk of words at a time, the first chunk skips the bytes before pos in its first word*/
+size_t gen_copy_words(int pattern, loff_t pos, size_t count, struct iov_iter *to)
+{
+    u64 words[GEN_CHUNK_WORDS];
+    u64 first = pos / sizeof(u64);
+    size_t skip = pos % sizeof(u64);
+    size_t done = 0;
+    size_t copied;
+    size_t len;
+
+    while(done < count)
+    {
+        gen_fill(pattern, words, first, GEN_CHUNK_WORDS);
+
+        len = min_t(size_t, count - done, sizeof(words) - skip);
+        copied = copy_to_iter((char *)words + skip, len, to);
+        done += copied;
+        if(copied != len)
+            break;
+
+        first += GEN_CHUNK_WORDS;
+        skip = 0;
+    }
+
+    return done;
+}
+
+/*paces the reads of the device with the GCRA of pseudo_throttle.h, every read moves gen_tat by*/
+/*its own transfer time at the configured rate, there is no burst tolerance, so an idle device  */
+/*gets no credit and the rate holds over any window longer than one read                       */
+int gen_throttle(struct kiocb *iocb, struct dev_priv_data *data_ptr, size_t count)
+{
+    u64 rate = READ_ONCE(data_ptr->gen_rate);
+    bool nonblock = (iocb->ki_filp->f_flags & O_NONBLOCK) || (iocb->ki_flags & IOCB_NOWAIT);
+    u64 start;
+    u64 now;
+
+    if(rate == 0)
+        return 0;
+
+    now = ktime_get_ns();
+
+    /*the slot is reserved under the lock like the qos limits of the platform devices*/
+    spin_lock(&data_ptr->gen_lock);
+    start = throttle_start(data_ptr->gen_tat, now, 0);
+
+    /*nowait readers take nothing from the rate when they would have to wait*/
+    if(nonblock && (start > now))
+    {
+        spin_unlock(&data_ptr->gen_lock);
+        return -EAGAIN;
+    }
+
+    throttle_charge(&data_ptr->gen_tat, start, throttle_cost(count, rate));
+    spin_unlock(&data_ptr->gen_lock);
+
+    if(start <= now)
+        return 0;
+
+    return throttle_sleep_until(start);
+}
+
+/*an endless stream, reads at any offset return the pattern bytes of that offset*/
+ssize_t gen_read(struct kiocb *iocb, struct dev_priv_data *data_ptr, struct iov_iter *to)
+{
+    int pattern = READ_ONCE(data_ptr->gen_pattern);
+    size_t count = iov_iter_count(to);
+    loff_t pos = iocb->ki_pos;
+    size_t copied;
+    int err;
+
+    if((pos >= MAX_LFS_FILESIZE) || (count == 0))
+        return 0;
+
+    count = min_t(u64, count, MAX_LFS_FILESIZE - pos);
+
+    err = gen_throttle(iocb, data_ptr, count);
+    if(err < 0)
+        return err;
+
+    switch(pattern)
+    {
+        case N_PSEUDO_GEN_ZERO:
+            copied = iov_iter_zero(count, to);
+            break;
+
+        /*a template written meanwhile can show up in the middle of a read, like a flat device read without retry*/
+        case N_PSEUDO_GEN_TEMPLATE:
+            copied = gen_copy_repeat(data_ptr->data_buffer, data_ptr->size, pos, count, to);
+            break;
+
+        /*the prefilled pages are never written after gen_init, so a reader that moves to another cpu*/
+        /*during the copy still copies valid data, only from a remote node                          */
+        case N_PSEUDO_GEN_PRNG:
+            if(READ_ONCE(data_ptr->gen_flags) & N_PSEUDO_GEN_PREFILL)
+            {
+                copied = gen_copy_repeat(data_ptr->gen_prefill[raw_smp_processor_id()], N_PSEUDO_GEN_PREFILL_SIZE, pos, count, to);
+                break;
+            }
+            fallthrough;
+
+        default:
+            copied = gen_copy_words(pattern, pos, count, to);
+            break;
+    }
+
+    if(copied == 0)
+        return -EFAULT;
+
+    iocb->ki_pos = pos + copied;
+    return copied;
+}
+
+__poll_t pseudo_poll (struct file *file_ptr, struct poll_table_struct *wait)
+{
+    struct dev_priv_data *data_ptr = (struct dev_priv_data *)file_ptr->private_data;
+    size_t size = data_ptr->size;
+    unsigned int len;
+    __poll_t mask = 0;
+
+    if(data_ptr->mode == RING_MODE)
+        return ring_poll(file_ptr, data_ptr, wait);
+
+    if(data_ptr->mode == LOG_MODE)
+        return log_poll(file_ptr, data_ptr, wait);
+
+    /*flat memory and gen devices never block, a rate limited read sleeps but poll can not tell for how long*/
+    if(data_ptr->mode != FIFO_MODE)
+        return EPOLLIN | EPOLLRDNORM | EPOLLOUT | EPOLLWRNORM;
+
+    poll_wait(file_ptr, &data_ptr->read_queue, wait);
+    poll_wait(file_ptr, &data_ptr->write_queue, wait);
+
+    len = fifo_len(&data_ptr->fifo);
+    if(len != 0)
+        mask |= EPOLLIN | EPOLLRDNORM;
+    if(len != size)
+        mask |= EPOLLOUT | EPOLLWRNORM;
+
+    return mask;
+}
+
+long pseudo_ioctl (struct file *file_ptr, unsigned int cmd, unsigned long arg)
+{
+    struct dev_priv_data *data_ptr = (struct dev_priv_data *)file_ptr->private_data;
+
+    switch(cmd)
+    {
+        case N_PSEUDO_IOC_BATCH:
+            return ioctl_batch(file_ptr, data_ptr, (struct n_pseudo_io_batch __user *)arg);
+
+        case N_PSEUDO_IOC_RING_KICK:
+            return ring_kick(data_ptr);
+
+        case N_PSEUDO_IOC_GEN_SET:
+        case N_PSEUDO_IOC_GEN_GET:
+            return ioctl_gen(file_ptr, data_ptr, cmd, (struct n_pseudo_gen_config __user *)arg);
+
+        default:
+            return -ENOTTY;
+    }
+}
+
+/*batch section*/
+/*many small positioned transfers cost one kernel entry and one lock acquisition*/
+long ioctl_batch(struct file *file_ptr, struct dev_priv_data *data_ptr, struct n_pseudo_io_batch __user *user_batch)
+{
+    struct n_pseudo_io_batch batch;
+    struct n_pseudo_io_desc *descs;
+    size_t descs_size;
+    long ret;
+    u32 itr;
+
+    /*fifo and ring devices have no positions, gen devices have no memory behind their positions*/
+    if(data_ptr->mode != FLAT_MODE)
+        return -EINVAL;
+
+    if(copy_from_user(&batch, user_batch, sizeof(batch)))
+        return -EFAULT;
+
+    if((batch.flags != 0) || (batch.count == 0) || (batch.count > N_PSEUDO_MAX_BATCH))
+        return -EINVAL;
+
+    descs_size = batch.count * sizeof(*descs);
+    descs = kvmalloc(descs_size, GFP_KERNEL);
+    if(descs == NULL)
+        return -ENOMEM;
+
+    if(copy_from_user(descs, u64_to_user_ptr(batch.descs), descs_size))
+    {
+        ret = -EFAULT;
+        goto free_descs;
+    }
+
+    /*holding the write lock excludes writers, so the reads in the batch need no seqcount retry*/
+    if(mutex_lock_interruptible(&data_ptr->write_lock))
+    {
+        ret = -ERESTARTSYS;
+        goto free_descs;
+    }
+
+    for(itr=0; itr<batch.count; itr++)
+        descs[itr].result = batch_desc_run(file_ptr, data_ptr, &descs[itr]);
+
+    mutex_unlock(&data_ptr->write_lock);
+
+    if(copy_to_user(u64_to_user_ptr(batch.descs), descs, descs_size))
+        ret = -EFAULT;
+    else
+        ret = batch.count;
+
+free_descs:
+    kvfree(descs);
+    return ret;
+}
+
+/*the caller holds write_lock*/
+ssize_t batch_desc_run(struct file *file_ptr, struct dev_priv_data *data_ptr, struct n_pseudo_io_desc *desc)
+{
+    bool is_read = (desc->op == N_PSEUDO_OP_READ);
+    size_t size = data_ptr->size;
+    size_t count = desc->len;
+    struct iov_iter iter;
+    u64 start;
+    u64 latency;
+    ssize_t ret;
+    int err;
+
+    if((desc->op != N_PSEUDO_OP_READ) && (desc->op != N_PSEUDO_OP_WRITE))
+        return -EINVAL;
+
+    /*the descriptors follow the file open mode, like pread and pwrite*/
+    if(!(file_ptr->f_mode & (is_read ? FMODE_READ : FMODE_WRITE)))
+        return -EBADF;
+
+    start = ktime_get_ns();
+
+    /*same limits as read_iter and write_iter*/
+    if(desc->offset >= size)
+    {
+        ret = is_read ? 0 : -ENOMEM;
+        goto account;
+    }
+
+    if(count > size - desc->offset)
+        count = size - desc->offset;
+
+    err = import_ubuf(is_read ? ITER_DEST : ITER_SOURCE, u64_to_user_ptr(desc->user_ptr), count, &iter);
+    if(err < 0)
+    {
+        ret = err;
+        goto account;
+    }
+
+    if(is_read)
+        ret = copy_to_iter(data_ptr->data_buffer+desc->offset, count, &iter);
+    else
+        ret = copy_mem_from_iter_locked(data_ptr, &iter, desc->offset, count);
+
+    if((ret == 0) && (count > 0))
+        ret = -EFAULT;
+
+account:
+    latency = ktime_get_ns() - start;
+    stats_account_io(data_ptr, is_read, ret, desc->len, latency);
+    if(is_read)
+        trace_n_pseudo_read(iminor(file_inode(file_ptr)), desc->len, desc->offset, ret, latency);
+    else
+        trace_n_pseudo_write(iminor(file_inode(file_ptr)), desc->len, desc->offset, ret, latency);
+
+    return ret;
 }
 
 int check_file_permission(int device_permission, fmode_t request_mode)
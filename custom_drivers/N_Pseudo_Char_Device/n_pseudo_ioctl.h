@@ -0,0 +1,92 @@
+#ifndef  __N_PSEUDO_IOCTL_
+#define  __N_PSEUDO_IOCTL_
+
+/*ioctl interface of n_pseudo_devices, shared by the driver and user space*/
+/*the structures use fixed size fields only, so 32 bit processes on a    */
+/*64 bit kernel use the same layout and compat_ptr_ioctl is enough       */
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define N_PSEUDO_IOC_MAGIC      'p'
+
+/*descriptor operations*/
+#define N_PSEUDO_OP_READ        0
+#define N_PSEUDO_OP_WRITE       1
+
+/*largest number of descriptors in one batch*/
+#define N_PSEUDO_MAX_BATCH      1024
+
+/*one positioned transfer, the file position is not used and not changed*/
+struct n_pseudo_io_desc{
+    __u32 op;
+    __u32 len;
+    __u64 offset;
+    /*user buffer address*/
+    __u64 user_ptr;
+    /*filled by the driver, bytes transferred or a negative error code*/
+    __s64 result;
+};
+
+struct n_pseudo_io_batch{
+    /*address of an array of count descriptors*/
+    __u64 descs;
+    __u32 count;
+    /*reserved, must be zero*/
+    __u32 flags;
+};
+
+/*run all descriptors of the batch under one device lock acquisition*/
+/*returns the number of descriptors, every descriptor has its result */
+#define N_PSEUDO_IOC_BATCH      _IOWR(N_PSEUDO_IOC_MAGIC, 1, struct n_pseudo_io_batch)
+
+/*ring devices control page, it is the first page of the mapping and the ring data follows it*/
+/*the producer copies the data in and then moves head, the consumer copies the data out and  */
+/*then moves tail, so user space enqueues and dequeues without any system call               */
+/*both indexes run freely and wrap at 2^32, the byte of index i is at data_offset + i % size */
+/*a side that finds the ring empty or full sets its waiting flag, checks the ring again and  */
+/*sleeps in poll. the other side checks the flag after it moves its index, with a full      */
+/*memory barrier in between, and calls N_PSEUDO_IOC_RING_KICK only when the flag is set     */
+struct n_pseudo_ring_ctrl{
+    /*written by the producer*/
+    __u32 head;
+    __u32 producer_waiting;
+    __u8  pad0[56];
+    /*written by the consumer*/
+    __u32 tail;
+    __u32 consumer_waiting;
+    __u8  pad1[56];
+    /*set by the driver, size is a power of 2*/
+    __u32 size;
+    __u32 data_offset;
+};
+
+/*wake the poll waiters of a ring device, poll reports the ring state from the control page*/
+#define N_PSEUDO_IOC_RING_KICK  _IO(N_PSEUDO_IOC_MAGIC, 2)
+
+/*generator devices patterns, the bytes at an offset depend only on the offset*/
+/*zero: all bytes are zero                                                    */
+/*counter: native endian 64 bit words, the word at offset o holds o / 8       */
+/*prng: 64 bit words of a pseudo random stream, the splitmix64 mix of o / 8   */
+/*template: the device memory repeated, writes to the device set the template */
+#define N_PSEUDO_GEN_ZERO       0
+#define N_PSEUDO_GEN_COUNTER    1
+#define N_PSEUDO_GEN_PRNG       2
+#define N_PSEUDO_GEN_TEMPLATE   3
+
+/*prng reads copy from per cpu pre-filled pages, the stream repeats every N_PSEUDO_GEN_PREFILL_SIZE bytes*/
+#define N_PSEUDO_GEN_PREFILL    (1U << 0)
+#define N_PSEUDO_GEN_PREFILL_SIZE   (64 * 1024)
+
+struct n_pseudo_gen_config{
+    __u32 pattern;
+    __u32 flags;
+    /*read rate limit of the device in bytes per second, 0 for no limit*/
+    __u64 rate;
+};
+
+/*set and get the generator configuration, the new configuration applies to the next reads*/
+#define N_PSEUDO_IOC_GEN_SET    _IOW(N_PSEUDO_IOC_MAGIC, 3, struct n_pseudo_gen_config)
+#define N_PSEUDO_IOC_GEN_GET    _IOR(N_PSEUDO_IOC_MAGIC, 4, struct n_pseudo_gen_config)
+
+#endif
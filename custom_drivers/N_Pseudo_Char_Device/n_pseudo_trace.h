@@ -0,0 +1,48 @@
+/***********************************************************/
+/*N pseudo devices trace events                            */
+/*the events cost a static branch only while disabled      */
+/*enable them with ftrace, perf or bpftrace, example:      */
+/*echo 1 > /sys/kernel/tracing/events/n_pseudo/enable      */
+/***********************************************************/
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM n_pseudo
+
+#if !defined(_N_PSEUDO_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _N_PSEUDO_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/*the event classes are shared with the other pseudo drivers, only the events are defined here*/
+#include "pseudo_trace_class.h"
+
+/*read and write events, latency is the time spent inside the driver*/
+DEFINE_EVENT(pseudo_io, n_pseudo_read,
+    TP_PROTO(unsigned int minor, size_t count, loff_t pos, ssize_t result, u64 latency_ns),
+    TP_ARGS(minor, count, pos, result, latency_ns)
+);
+
+DEFINE_EVENT(pseudo_io, n_pseudo_write,
+    TP_PROTO(unsigned int minor, size_t count, loff_t pos, ssize_t result, u64 latency_ns),
+    TP_ARGS(minor, count, pos, result, latency_ns)
+);
+
+DEFINE_EVENT(pseudo_llseek, n_pseudo_llseek,
+    TP_PROTO(unsigned int minor, loff_t offset, int whence, loff_t result),
+    TP_ARGS(minor, offset, whence, result)
+);
+
+DEFINE_EVENT(pseudo_open, n_pseudo_open,
+    TP_PROTO(unsigned int minor, unsigned int f_mode, int result),
+    TP_ARGS(minor, f_mode, result)
+);
+
+#endif
+
+/*the header is in the module directory, not in include/trace/events*/
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE n_pseudo_trace
+
+#include <trace/define_trace.h>
@@ -0,0 +1,161 @@
+/*************************************************************/
+/*batch ioctl benchmark                                      */
+/*small random transfers with one, two or 1/batch syscalls   */
+/*************************************************************/
+
+/*usage: batch_bench <device> [record size] [batch size] [seconds] [write]          */
+/*example: batch_bench /dev/pseudo_char_dev:1 64 64 2 0                             */
+/*the same random record offsets are transferred with:                             */
+/*  lseek+rw  lseek() then read() or write(), two syscalls per record               */
+/*  prw       pread() or pwrite(), one syscall per record                           */
+/*  batch     N_PSEUDO_IOC_BATCH, one syscall and one device lock per batch         */
+/*records are read unless write is 1, the device must allow the used open mode     */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include "bench_common.h"
+#include "n_pseudo_ioctl.h"
+
+#define DEFAULT_RECORD_SIZE     64
+#define DEFAULT_BATCH_SIZE      64
+#define DEFAULT_SECONDS         2
+
+enum mode
+{
+    MODE_LSEEK_RW,
+    MODE_PRW,
+    MODE_BATCH,
+    MODE_COUNT
+};
+
+static const char *mode_names[] = {"lseek+rw", "prw", "batch"};
+
+static size_t record_size = DEFAULT_RECORD_SIZE;
+static unsigned int batch_size = DEFAULT_BATCH_SIZE;
+static int write_mode;
+
+static double run_mode(int fd, enum mode mode, int seconds, off_t size)
+{
+    struct n_pseudo_io_desc *descs = calloc(batch_size, sizeof(*descs));
+    struct n_pseudo_io_batch batch;
+    char *buf = malloc(record_size * batch_size);
+    long records = size / record_size;
+    uint64_t seed = 0x9e3779b97f4a7c15ull;
+    uint64_t done = 0;
+    uint64_t start;
+    unsigned int itr;
+    ssize_t ret;
+
+    memset(buf, 0x5a, record_size * batch_size);
+    batch.descs = (uintptr_t)descs;
+    batch.count = batch_size;
+    batch.flags = 0;
+
+    start = now_ns();
+    while(now_ns() - start < (uint64_t)seconds * 1000000000ull)
+    {
+        for(itr=0; itr<batch_size; itr++)
+        {
+            descs[itr].op = write_mode ? N_PSEUDO_OP_WRITE : N_PSEUDO_OP_READ;
+            descs[itr].len = record_size;
+            descs[itr].offset = (xorshift64(&seed) % records) * record_size;
+            descs[itr].user_ptr = (uintptr_t)(buf + itr * record_size);
+        }
+
+        if(mode == MODE_BATCH)
+        {
+            if(ioctl(fd, N_PSEUDO_IOC_BATCH, &batch) < 0)
+            {
+                perror("ioctl");
+                exit(1);
+            }
+            for(itr=0; itr<batch_size; itr++)
+            {
+                if(descs[itr].result != (int64_t)record_size)
+                {
+                    fprintf(stderr, "descriptor %u result %lld\n", itr, (long long)descs[itr].result);
+                    exit(1);
+                }
+            }
+            done += batch_size;
+            continue;
+        }
+
+        for(itr=0; itr<batch_size; itr++)
+        {
+            char *ptr = (char *)(uintptr_t)descs[itr].user_ptr;
+
+            if(mode == MODE_LSEEK_RW)
+            {
+                lseek(fd, descs[itr].offset, SEEK_SET);
+                ret = write_mode ? write(fd, ptr, record_size) : read(fd, ptr, record_size);
+            }
+            else
+            {
+                ret = write_mode ? pwrite(fd, ptr, record_size, descs[itr].offset) :
+                                   pread(fd, ptr, record_size, descs[itr].offset);
+            }
+
+            if(ret != (ssize_t)record_size)
+            {
+                perror(mode_names[mode]);
+                exit(1);
+            }
+        }
+        done += batch_size;
+    }
+    start = now_ns() - start;
+
+    free(descs);
+    free(buf);
+    return done / ((double)start / 1e9);
+}
+
+int main(int argc, char *argv[])
+{
+    int seconds = DEFAULT_SECONDS;
+    off_t size;
+    int mode;
+    int fd;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: %s <device> [record size] [batch size] [seconds] [write]\n", argv[0]);
+        return 1;
+    }
+    if(argc > 2)
+        record_size = strtoul(argv[2], NULL, 0);
+    if(argc > 3)
+        batch_size = strtoul(argv[3], NULL, 0);
+    if(argc > 4)
+        seconds = atoi(argv[4]);
+    if(argc > 5)
+        write_mode = atoi(argv[5]);
+
+    fd = open(argv[1], write_mode ? O_WRONLY : O_RDONLY);
+    if(fd < 0)
+    {
+        perror("open");
+        return 1;
+    }
+    size = device_size(fd);
+
+    if((size <= 0) || (record_size == 0) || (record_size > (size_t)size) ||
+       (batch_size == 0) || (batch_size > N_PSEUDO_MAX_BATCH))
+    {
+        fprintf(stderr, "record size must fit the device size %lld, batch size must be 1-%d\n",
+                (long long)size, N_PSEUDO_MAX_BATCH);
+        return 1;
+    }
+
+    printf("device:%s size:%lld record:%zu batch:%u op:%s\n", argv[1], (long long)size,
+           record_size, batch_size, write_mode ? "write" : "read");
+
+    for(mode=0; mode<MODE_COUNT; mode++)
+        printf("%-9s records/s:%12.0f\n", mode_names[mode], run_mode(fd, mode, seconds, size));
+
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,133 @@
+#ifndef  __BENCH_COMMON_
+#define  __BENCH_COMMON_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <string.h>
+
+/*monotonic time stamp in nano seconds*/
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*pseudo devices report their memory size through SEEK_END*/
+static inline off_t device_size(int fd)
+{
+    off_t size = lseek(fd, 0, SEEK_END);
+
+    lseek(fd, 0, SEEK_SET);
+    return size;
+}
+
+/*small xorshift generator, rand() takes a lock and would dominate the measurement*/
+static inline uint64_t xorshift64(uint64_t *state)
+{
+    uint64_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+/*latency histogram with ~3% resolution, values below 64 ns have their own bucket*/
+/*larger values are split in 32 linear sub buckets per power of 2                */
+#define HIST_LINEAR_LIMIT       64
+#define HIST_SUB_BITS           5
+#define HIST_SUB_BUCKETS        (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXPONENT       40
+#define HIST_BUCKETS            (HIST_LINEAR_LIMIT + (HIST_MAX_EXPONENT - 6 + 1) * HIST_SUB_BUCKETS)
+
+struct lat_hist
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[HIST_BUCKETS];
+};
+
+static inline void hist_init(struct lat_hist *hist)
+{
+    memset(hist, 0, sizeof(*hist));
+    hist->min = UINT64_MAX;
+}
+
+static inline int hist_index(uint64_t value)
+{
+    int exponent;
+    int index;
+
+    if(value < HIST_LINEAR_LIMIT)
+        return value;
+
+    exponent = 63 - __builtin_clzll(value);
+    if(exponent > HIST_MAX_EXPONENT)
+        return HIST_BUCKETS - 1;
+
+    index = HIST_LINEAR_LIMIT + (exponent - 6) * HIST_SUB_BUCKETS;
+    return index + ((value >> (exponent - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1));
+}
+
+/*lowest value that falls in a bucket, used to report the percentiles*/
+static inline uint64_t hist_value(int index)
+{
+    int exponent;
+
+    if(index < HIST_LINEAR_LIMIT)
+        return index;
+
+    index -= HIST_LINEAR_LIMIT;
+    exponent = index / HIST_SUB_BUCKETS + 6;
+    return ((uint64_t)(HIST_SUB_BUCKETS + index % HIST_SUB_BUCKETS)) << (exponent - HIST_SUB_BITS);
+}
+
+static inline void hist_add(struct lat_hist *hist, uint64_t value)
+{
+    hist->count++;
+    hist->sum += value;
+    if(value < hist->min)
+        hist->min = value;
+    if(value > hist->max)
+        hist->max = value;
+    hist->buckets[hist_index(value)]++;
+}
+
+static inline void hist_merge(struct lat_hist *dst, const struct lat_hist *src)
+{
+    int itr;
+
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if(src->min < dst->min)
+        dst->min = src->min;
+    if(src->max > dst->max)
+        dst->max = src->max;
+    for(itr=0; itr<HIST_BUCKETS; itr++)
+        dst->buckets[itr] += src->buckets[itr];
+}
+
+/*percentile in the range 0-100*/
+static inline uint64_t hist_percentile(const struct lat_hist *hist, double percentile)
+{
+    uint64_t target = (uint64_t)(hist->count * percentile / 100.0);
+    uint64_t seen = 0;
+    int itr;
+
+    for(itr=0; itr<HIST_BUCKETS; itr++)
+    {
+        seen += hist->buckets[itr];
+        if((seen > target) && (hist->buckets[itr] != 0))
+            return hist_value(itr);
+    }
+    return hist->max;
+}
+
+#endif
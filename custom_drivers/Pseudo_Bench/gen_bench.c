@@ -0,0 +1,194 @@
+/*************************************************************/
+/*generator benchmark                                        */
+/*read throughput of a gen device for every pattern          */
+/*************************************************************/
+
+/*usage: gen_bench <device> [block size] [seconds] [threads] [rate bytes/s]        */
+/*example: gen_bench /dev/pseudo_char_dev:5 1048576 2 4                            */
+/*every pattern is selected with the generator ioctl, prng is run with and without */
+/*the pre-filled pages, then the reader threads read the device with their own fd  */
+/*the first block of every run is checked against the pattern definition           */
+/*load the module with a gen device: dev_modes=...,gen dev_perms=...,rw             */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/ioctl.h>
+#include "bench_common.h"
+#include "n_pseudo_ioctl.h"
+
+#define DEFAULT_BLOCK_SIZE      (1024 * 1024)
+#define DEFAULT_SECONDS         2
+#define DEFAULT_THREADS         1
+
+struct reader_ctx
+{
+    pthread_t thread;
+    uint64_t bytes;
+};
+
+static const char *path;
+static size_t block_size = DEFAULT_BLOCK_SIZE;
+static atomic_int stop;
+
+static void *reader_thread(void *arg)
+{
+    struct reader_ctx *ctx = arg;
+    char *buf = malloc(block_size);
+    ssize_t ret;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        perror("open");
+        free(buf);
+        return NULL;
+    }
+    memset(buf, 0, block_size);
+
+    while(!atomic_load_explicit(&stop, memory_order_relaxed))
+    {
+        ret = read(fd, buf, block_size);
+        if(ret <= 0)
+        {
+            perror("read");
+            break;
+        }
+        ctx->bytes += ret;
+    }
+
+    close(fd);
+    free(buf);
+    return NULL;
+}
+
+/*same mix as the driver*/
+static uint64_t prng_word(uint64_t index)
+{
+    uint64_t x = index * 0x9e3779b97f4a7c15ull;
+
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+/*checks the words of one block read at an odd offset, the template is not known here*/
+static int check_pattern(int fd, uint32_t pattern)
+{
+    uint64_t words[512];
+    off_t offset = 3 * 8;
+    size_t itr;
+    uint64_t expected;
+
+    if(pread(fd, words, sizeof(words), offset) != sizeof(words))
+        return -1;
+
+    for(itr=0; itr<sizeof(words)/sizeof(words[0]); itr++)
+    {
+        if(pattern == N_PSEUDO_GEN_ZERO)
+            expected = 0;
+        else if(pattern == N_PSEUDO_GEN_COUNTER)
+            expected = offset / 8 + itr;
+        else if(pattern == N_PSEUDO_GEN_PRNG)
+            expected = prng_word(offset / 8 + itr);
+        else
+            return 0;
+
+        if(words[itr] != expected)
+            return -1;
+    }
+
+    return 0;
+}
+
+static void run(int fd, const char *name, uint32_t pattern, uint32_t flags, uint64_t rate, int threads, int seconds)
+{
+    struct n_pseudo_gen_config config = {.pattern = pattern, .flags = flags, .rate = rate};
+    struct reader_ctx *ctx = calloc(threads, sizeof(*ctx));
+    uint64_t bytes = 0;
+    uint64_t start;
+    int itr;
+
+    if(ioctl(fd, N_PSEUDO_IOC_GEN_SET, &config) < 0)
+    {
+        perror("N_PSEUDO_IOC_GEN_SET");
+        exit(1);
+    }
+
+    if(check_pattern(fd, pattern) < 0)
+    {
+        fprintf(stderr, "%s: the data does not match the pattern\n", name);
+        exit(1);
+    }
+
+    atomic_store(&stop, 0);
+    start = now_ns();
+    for(itr=0; itr<threads; itr++)
+        pthread_create(&ctx[itr].thread, NULL, reader_thread, &ctx[itr]);
+
+    sleep(seconds);
+    atomic_store(&stop, 1);
+
+    for(itr=0; itr<threads; itr++)
+    {
+        pthread_join(ctx[itr].thread, NULL);
+        bytes += ctx[itr].bytes;
+    }
+    start = now_ns() - start;
+
+    printf("%-14s GB/s:%8.2f GB/s per thread:%8.2f\n", name, bytes / ((double)start / 1e9) / 1e9,
+           bytes / ((double)start / 1e9) / 1e9 / threads);
+
+    free(ctx);
+}
+
+int main(int argc, char *argv[])
+{
+    int seconds = DEFAULT_SECONDS;
+    int threads = DEFAULT_THREADS;
+    uint64_t rate = 0;
+    int fd;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: %s <device> [block size] [seconds] [threads] [rate bytes/s]\n", argv[0]);
+        return 1;
+    }
+    path = argv[1];
+    if(argc > 2)
+        block_size = strtoul(argv[2], NULL, 0);
+    if(argc > 3)
+        seconds = atoi(argv[3]);
+    if(argc > 4)
+        threads = atoi(argv[4]);
+    if(argc > 5)
+        rate = strtoull(argv[5], NULL, 0);
+
+    if((block_size == 0) || (threads <= 0))
+    {
+        fprintf(stderr, "invalid block size or threads\n");
+        return 1;
+    }
+
+    /*the configuration ioctl needs a file opened for writing*/
+    fd = open(path, O_RDWR);
+    if(fd < 0)
+    {
+        perror("open");
+        return 1;
+    }
+
+    printf("device:%s block:%zu seconds:%d threads:%d rate:%llu\n", path, block_size, seconds, threads, (unsigned long long)rate);
+    run(fd, "zero", N_PSEUDO_GEN_ZERO, 0, rate, threads, seconds);
+    run(fd, "counter", N_PSEUDO_GEN_COUNTER, 0, rate, threads, seconds);
+    run(fd, "prng", N_PSEUDO_GEN_PRNG, 0, rate, threads, seconds);
+    run(fd, "prng prefill", N_PSEUDO_GEN_PRNG, N_PSEUDO_GEN_PREFILL, rate, threads, seconds);
+    run(fd, "template", N_PSEUDO_GEN_TEMPLATE, 0, rate, threads, seconds);
+
+    close(fd);
+    return 0;
+}
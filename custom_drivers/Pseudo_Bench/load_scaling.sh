@@ -0,0 +1,54 @@
+#!/bin/sh
+#load time and memory use of n_pseudo_devices for a growing devices count and size
+#usage: load_scaling.sh <module.ko> [devices counts] [device sizes]
+#example: load_scaling.sh ../N_Pseudo_Char_Device/n_pseudo_devices.ko "1 10 100 500 1000" "4K 1M 16M"
+#all devices are flat rw devices, every step loads and unloads the module once
+#the output is csv, memory columns are the growth of /proc/meminfo fields in kB after the load
+
+MODULE=$1
+COUNTS=${2:-"1 10 100 500 1000"}
+SIZES=${3:-"4K 1M 16M"}
+
+if [ -z "$MODULE" ]; then
+    echo "usage: $0 <module.ko> [devices counts] [device sizes]" >&2
+    exit 1
+fi
+
+meminfo()
+{
+    awk -v field="$1:" '$1 == field { print $2 }' /proc/meminfo
+}
+
+now_ms()
+{
+    echo $(( $(date +%s%N) / 1000000 ))
+}
+
+echo "devices,size,load_ms,unload_ms,vmalloc_kb,percpu_kb,slab_kb,mem_used_kb"
+
+for size in $SIZES; do
+    for count in $COUNTS; do
+        vmalloc=$(meminfo VmallocUsed)
+        percpu=$(meminfo Percpu)
+        slab=$(meminfo Slab)
+        available=$(meminfo MemAvailable)
+
+        start=$(now_ms)
+        if ! insmod "$MODULE" ndevices="$count" dev_sizes="$size" dev_perms=rw dev_modes=flat; then
+            echo "$count,$size,load failed" >&2
+            continue
+        fi
+        load=$(( $(now_ms) - start ))
+
+        vmalloc=$(( $(meminfo VmallocUsed) - vmalloc ))
+        percpu=$(( $(meminfo Percpu) - percpu ))
+        slab=$(( $(meminfo Slab) - slab ))
+        available=$(( available - $(meminfo MemAvailable) ))
+
+        start=$(now_ms)
+        rmmod n_pseudo_devices
+        unload=$(( $(now_ms) - start ))
+
+        echo "$count,$size,$load,$unload,$vmalloc,$percpu,$slab,$available"
+    done
+done
@@ -0,0 +1,179 @@
+/*************************************************************/
+/*log benchmark                                              */
+/*one writer appends records, N readers read all of them     */
+/*with their own cursor                                      */
+/*************************************************************/
+
+/*usage: log_bench <device> [readers] [record size] [records] [slow reader delay us] */
+/*example: log_bench /dev/pseudo_char_dev:5 4 128 1000000 20                        */
+/*the writer appends numbered records as fast as it can. every reader opens the    */
+/*device, waits in poll and checks that the numbers follow each other. the last    */
+/*reader sleeps the given delay after every record, it falls behind and gets EPIPE */
+/*instead of slowing the writer down, the records it missed are counted as lost    */
+/*load the module with a log device: dev_modes=...,log dev_sizes=...,1M             */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include "bench_common.h"
+
+#define DEFAULT_READERS         4
+#define DEFAULT_RECORD_SIZE     128
+#define DEFAULT_RECORDS         1000000
+
+struct reader_ctx
+{
+    pthread_t thread;
+    int fd;
+    int delay_us;
+    uint64_t received;
+    uint64_t lost;
+    uint64_t overruns;
+    uint64_t elapsed;
+};
+
+static const char *path;
+static size_t record_size = DEFAULT_RECORD_SIZE;
+static long records = DEFAULT_RECORDS;
+
+static void *reader_thread(void *arg)
+{
+    struct reader_ctx *ctx = arg;
+    struct pollfd pfd = {.fd = ctx->fd, .events = POLLIN};
+    char *buf = malloc(record_size);
+    uint64_t expected = 0;
+    uint64_t start = now_ns();
+    uint64_t seq;
+    ssize_t ret;
+
+    while(expected < (uint64_t)records)
+    {
+        ret = read(ctx->fd, buf, record_size);
+        if(ret < 0)
+        {
+            if(errno == EAGAIN)
+            {
+                poll(&pfd, 1, -1);
+                continue;
+            }
+
+            /*the cursor moved to the oldest record, the next read tells how many were lost*/
+            if(errno == EPIPE)
+            {
+                ctx->overruns++;
+                continue;
+            }
+
+            perror("read");
+            break;
+        }
+
+        memcpy(&seq, buf, sizeof(seq));
+        if(seq < expected)
+        {
+            fprintf(stderr, "record %llu received after %llu\n", (unsigned long long)seq, (unsigned long long)expected);
+            exit(1);
+        }
+
+        ctx->lost += seq - expected;
+        ctx->received++;
+        expected = seq + 1;
+
+        if(ctx->delay_us)
+            usleep(ctx->delay_us);
+    }
+    ctx->elapsed = now_ns() - start;
+
+    free(buf);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    struct reader_ctx *ctx;
+    int readers = DEFAULT_READERS;
+    int delay_us = 0;
+    uint64_t start;
+    uint64_t seq;
+    char *buf;
+    int fd;
+    int itr;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: %s <device> [readers] [record size] [records] [slow reader delay us]\n", argv[0]);
+        return 1;
+    }
+    path = argv[1];
+    if(argc > 2)
+        readers = atoi(argv[2]);
+    if(argc > 3)
+        record_size = strtoul(argv[3], NULL, 0);
+    if(argc > 4)
+        records = strtol(argv[4], NULL, 0);
+    if(argc > 5)
+        delay_us = atoi(argv[5]);
+
+    if((readers <= 0) || (record_size < sizeof(seq)) || (records <= 0))
+    {
+        fprintf(stderr, "invalid readers, record size or records\n");
+        return 1;
+    }
+
+    fd = open(path, O_WRONLY);
+    if(fd < 0)
+    {
+        perror("open");
+        return 1;
+    }
+
+    /*the readers skip what previous runs left in the log*/
+    ctx = calloc(readers, sizeof(*ctx));
+    for(itr=0; itr<readers; itr++)
+    {
+        ctx[itr].fd = open(path, O_RDONLY | O_NONBLOCK);
+        if(ctx[itr].fd < 0)
+        {
+            perror("open reader");
+            return 1;
+        }
+        lseek(ctx[itr].fd, 0, SEEK_END);
+        ctx[itr].delay_us = (itr == readers - 1) ? delay_us : 0;
+        pthread_create(&ctx[itr].thread, NULL, reader_thread, &ctx[itr]);
+    }
+
+    buf = calloc(1, record_size);
+    start = now_ns();
+    for(seq=0; seq<(uint64_t)records; seq++)
+    {
+        memcpy(buf, &seq, sizeof(seq));
+        if(write(fd, buf, record_size) != (ssize_t)record_size)
+        {
+            perror("write");
+            return 1;
+        }
+    }
+    start = now_ns() - start;
+
+    printf("device:%s readers:%d record size:%zu records:%ld\n", path, readers, record_size, records);
+    printf("writer    records/s:%12.0f MB/s:%10.1f\n", records / ((double)start / 1e9),
+           (double)records * record_size / ((double)start / 1e9) / 1e6);
+
+    for(itr=0; itr<readers; itr++)
+    {
+        pthread_join(ctx[itr].thread, NULL);
+        printf("reader %-2d records/s:%12.0f received:%llu lost:%llu overruns:%llu%s\n", itr,
+               ctx[itr].received / ((double)ctx[itr].elapsed / 1e9),
+               (unsigned long long)ctx[itr].received, (unsigned long long)ctx[itr].lost,
+               (unsigned long long)ctx[itr].overruns, ctx[itr].delay_us ? " (slow)" : "");
+        close(ctx[itr].fd);
+    }
+
+    free(buf);
+    free(ctx);
+    close(fd);
+    return 0;
+}
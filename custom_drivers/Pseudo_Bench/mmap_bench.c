@@ -0,0 +1,110 @@
+/*************************************************************/
+/*mmap benchmark                                             */
+/*compare mapped access against read() on a pseudo device    */
+/*************************************************************/
+
+/*usage: mmap_bench <device> [record size] [iterations]      */
+/*example: mmap_bench /dev/pseudo_char_dev:1 64 1000000      */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "bench_common.h"
+
+#define DEFAULT_RECORD_SIZE     64
+#define DEFAULT_ITERATIONS      1000000
+
+static void report(const char *method, uint64_t elapsed, long iterations, size_t record_size)
+{
+    double ns_per_op = (double)elapsed / iterations;
+    double mb_per_sec = ((double)iterations * record_size) / ((double)elapsed / 1e9) / 1e6;
+
+    printf("%-6s: %10.1f ns/op %10.1f MB/s\n", method, ns_per_op, mb_per_sec);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path;
+    size_t record_size = DEFAULT_RECORD_SIZE;
+    long iterations = DEFAULT_ITERATIONS;
+    long records;
+    long itr;
+    off_t size;
+    uint64_t start;
+    uint64_t seed = 88172645463325252ull;
+    uint64_t checksum = 0;
+    char *map;
+    char *buf;
+    int fd;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: %s <device> [record size] [iterations]\n", argv[0]);
+        return 1;
+    }
+    path = argv[1];
+    if(argc > 2)
+        record_size = strtoul(argv[2], NULL, 0);
+    if(argc > 3)
+        iterations = strtol(argv[3], NULL, 0);
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        perror("open");
+        return 1;
+    }
+
+    size = device_size(fd);
+    if((size <= 0) || (record_size == 0) || (record_size > (size_t)size))
+    {
+        fprintf(stderr, "invalid record size %zu for device size %lld\n", record_size, (long long)size);
+        return 1;
+    }
+    records = size / record_size;
+
+    buf = malloc(record_size);
+    map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if((buf == NULL) || (map == MAP_FAILED))
+    {
+        perror("mmap");
+        return 1;
+    }
+
+    printf("device:%s size:%lld record:%zu iterations:%ld\n", path, (long long)size, record_size, iterations);
+
+    /*read() path, one syscall and one copy_to_user per record*/
+    start = now_ns();
+    for(itr=0; itr<iterations; itr++)
+    {
+        off_t offset = (xorshift64(&seed) % records) * record_size;
+
+        if(pread(fd, buf, record_size, offset) != (ssize_t)record_size)
+        {
+            perror("pread");
+            return 1;
+        }
+        checksum += buf[0];
+    }
+    report("read", now_ns() - start, iterations, record_size);
+
+    /*mapped path, the record is copied straight from the device memory*/
+    start = now_ns();
+    for(itr=0; itr<iterations; itr++)
+    {
+        off_t offset = (xorshift64(&seed) % records) * record_size;
+
+        memcpy(buf, map + offset, record_size);
+        checksum += buf[0];
+    }
+    report("mmap", now_ns() - start, iterations, record_size);
+
+    /*print the checksum so the compiler can not drop the copies*/
+    printf("checksum:%llu\n", (unsigned long long)checksum);
+
+    munmap(map, size);
+    free(buf);
+    close(fd);
+    return 0;
+}
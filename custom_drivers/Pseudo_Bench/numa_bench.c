@@ -0,0 +1,233 @@
+/*************************************************************/
+/*numa benchmark                                             */
+/*read throughput of one device from the cpus of every node  */
+/*************************************************************/
+
+/*usage: numa_bench <device> [block size] [seconds] [threads]                       */
+/*example: numa_bench /dev/pseudo_char_dev:0 65536 2 4                             */
+/*for every node with cpus, the reader threads are pinned to the cpus of the node  */
+/*and read the device sequentially with pread. the device memory placement is     */
+/*printed from its numa_pages sysfs file, so a remote node shows its extra latency */
+/*load the driver with dev_nodes=0,1,interleave (n pseudo devices) or set the      */
+/*numa_node configfs attribute (platform devices) to compare the placements        */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <libgen.h>
+#include "bench_common.h"
+
+#define DEFAULT_BLOCK_SIZE      65536
+#define DEFAULT_SECONDS         2
+#define DEFAULT_THREADS         1
+#define MAX_NODES               64
+
+struct reader_ctx
+{
+    pthread_t thread;
+    uint64_t reads;
+    uint64_t bytes;
+};
+
+static const char *path;
+static size_t block_size = DEFAULT_BLOCK_SIZE;
+static off_t size;
+static atomic_int stop;
+
+/*cpus of the node from its sysfs cpulist, returns the cpus count, 0 for memory only nodes*/
+static int node_cpus(int node, cpu_set_t *set)
+{
+    char file[64];
+    char list[4096];
+    char *token;
+    char *save;
+    int first;
+    int last;
+    int count = 0;
+    FILE *fp;
+
+    snprintf(file, sizeof(file), "/sys/devices/system/node/node%d/cpulist", node);
+    fp = fopen(file, "r");
+    if(fp == NULL)
+        return -1;
+    if(fgets(list, sizeof(list), fp) == NULL)
+        list[0] = '\0';
+    fclose(fp);
+
+    CPU_ZERO(set);
+    for(token=strtok_r(list, ",\n", &save); token!=NULL; token=strtok_r(NULL, ",\n", &save))
+    {
+        if(sscanf(token, "%d-%d", &first, &last) != 2)
+            last = first = atoi(token);
+
+        for(; first<=last; first++, count++)
+            CPU_SET(first, set);
+    }
+
+    return count;
+}
+
+/*prints the numa_pages file of the device, the class directory depends on the driver*/
+static void print_placement(const char *device)
+{
+    static const char * const classes[] = {"pseudo_plf_dev_class", "n_pseudo_char_class"};
+    char *copy = strdup(device);
+    char file[256];
+    char line[1024];
+    size_t itr;
+    FILE *fp;
+
+    for(itr=0; itr<sizeof(classes)/sizeof(classes[0]); itr++)
+    {
+        snprintf(file, sizeof(file), "/sys/class/%s/%s/numa_pages", classes[itr], basename(copy));
+        fp = fopen(file, "r");
+        if(fp == NULL)
+            continue;
+
+        if(fgets(line, sizeof(line), fp) != NULL)
+            printf("pages: %s", line);
+        fclose(fp);
+        break;
+    }
+
+    free(copy);
+}
+
+/*the buffer is allocated after the thread is pinned, so it is on the reader node*/
+static void *reader_thread(void *arg)
+{
+    struct reader_ctx *ctx = arg;
+    char *buf = malloc(block_size);
+    off_t offset = 0;
+    ssize_t ret;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        perror("open");
+        free(buf);
+        return NULL;
+    }
+    memset(buf, 0, block_size);
+
+    while(!atomic_load_explicit(&stop, memory_order_relaxed))
+    {
+        ret = pread(fd, buf, block_size, offset);
+        if(ret <= 0)
+        {
+            if(ret < 0)
+            {
+                perror("pread");
+                break;
+            }
+            offset = 0;
+            continue;
+        }
+
+        ctx->reads++;
+        ctx->bytes += ret;
+        offset += ret;
+        if(offset >= size)
+            offset = 0;
+    }
+
+    close(fd);
+    free(buf);
+    return NULL;
+}
+
+static void run_node(int node, cpu_set_t *set, int threads, int seconds)
+{
+    struct reader_ctx *ctx = calloc(threads, sizeof(*ctx));
+    pthread_attr_t attr;
+    uint64_t reads = 0;
+    uint64_t bytes = 0;
+    uint64_t start;
+    int itr;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setaffinity_np(&attr, sizeof(*set), set);
+
+    atomic_store(&stop, 0);
+    start = now_ns();
+    for(itr=0; itr<threads; itr++)
+        pthread_create(&ctx[itr].thread, &attr, reader_thread, &ctx[itr]);
+
+    sleep(seconds);
+    atomic_store(&stop, 1);
+
+    for(itr=0; itr<threads; itr++)
+    {
+        pthread_join(ctx[itr].thread, NULL);
+        reads += ctx[itr].reads;
+        bytes += ctx[itr].bytes;
+    }
+    start = now_ns() - start;
+
+    printf("node:%-3d threads:%-3d MB/s:%10.1f us/read:%8.2f\n", node, threads,
+           bytes / ((double)start / 1e9) / 1e6,
+           reads ? (double)start * threads / reads / 1e3 : 0.0);
+
+    pthread_attr_destroy(&attr);
+    free(ctx);
+}
+
+int main(int argc, char *argv[])
+{
+    int seconds = DEFAULT_SECONDS;
+    int threads = DEFAULT_THREADS;
+    cpu_set_t set;
+    int nodes = 0;
+    int node;
+    int fd;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: %s <device> [block size] [seconds] [threads]\n", argv[0]);
+        return 1;
+    }
+    path = argv[1];
+    if(argc > 2)
+        block_size = strtoul(argv[2], NULL, 0);
+    if(argc > 3)
+        seconds = atoi(argv[3]);
+    if(argc > 4)
+        threads = atoi(argv[4]);
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        perror("open");
+        return 1;
+    }
+    size = device_size(fd);
+    close(fd);
+
+    if((block_size == 0) || (threads <= 0) || (size <= 0))
+    {
+        fprintf(stderr, "invalid block size, threads or device size\n");
+        return 1;
+    }
+
+    printf("device:%s size:%lld block:%zu seconds:%d\n", path, (long long)size, block_size, seconds);
+    print_placement(path);
+
+    for(node=0; node<MAX_NODES; node++)
+    {
+        if(node_cpus(node, &set) <= 0)
+            continue;
+
+        run_node(node, &set, threads, seconds);
+        nodes++;
+    }
+
+    if(nodes == 0)
+        fprintf(stderr, "no numa nodes with cpus found in sysfs\n");
+
+    return 0;
+}
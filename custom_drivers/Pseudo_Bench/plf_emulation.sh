@@ -0,0 +1,41 @@
+#!/bin/sh
+#io_uring read iops of a platform pseudo device with an emulation profile, for a growing queue depth
+#usage: plf_emulation.sh <device> [latency us] [jitter us] [bandwidth bytes/s] [queue depth] [max uring depth] [record size] [ops per step]
+#example: plf_emulation.sh /dev/pseudo_char_dev:1 100 20 0 32 128 4096 20000
+#the requests complete from an hrtimer after the emulated time, so the iops grow with the uring depth
+#(about depth / latency) until the depth reaches the queue depth of the profile or the bandwidth is used
+#the profile is cleared at the end, writing the sysfs files needs root
+
+DEVICE=$1
+LATENCY=${2:-100}
+JITTER=${3:-0}
+BANDWIDTH=${4:-0}
+DEPTH=${5:-32}
+MAX_DEPTH=${6:-128}
+RECORD=${7:-4096}
+OPS=${8:-20000}
+BENCH_DIR=$(dirname "$0")
+
+if [ -z "$DEVICE" ]; then
+    echo "usage: $0 <device> [latency us] [jitter us] [bandwidth bytes/s] [queue depth] [max uring depth] [record size] [ops per step]" >&2
+    exit 1
+fi
+
+SYSFS=/sys/class/pseudo_plf_dev_class/$(basename "$DEVICE")/emulation
+
+profile()
+{
+    echo "$1" > "$SYSFS/latency_us" &&
+    echo "$2" > "$SYSFS/jitter_us" &&
+    echo "$3" > "$SYSFS/bandwidth" &&
+    echo "$4" > "$SYSFS/queue_depth"
+}
+
+profile "$LATENCY" "$JITTER" "$BANDWIDTH" "$DEPTH" || exit 1
+echo "profile latency:${LATENCY}us jitter:${JITTER}us bandwidth:${BANDWIDTH} queue depth:${DEPTH}"
+
+"$BENCH_DIR/uring_bench" "$DEVICE" "$MAX_DEPTH" "$RECORD" "$OPS" read
+ret=$?
+
+profile 0 0 0 0
+exit $ret
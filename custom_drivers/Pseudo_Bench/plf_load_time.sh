@@ -0,0 +1,62 @@
+#!/bin/sh
+#time until the platform driver is usable with many large dense devices
+#usage: plf_load_time.sh <driver.ko> <setup.ko> [devices count] [device size]
+#example: plf_load_time.sh ../Pseudo_Platform_Device/pseudo_platform_driver.ko ../Pseudo_Platform_Device/pseudo_device_setup.ko 64 64M
+#the setup module registers the devices first, then the driver is loaded in every mode:
+#  sync         sync_probe=1 defer_zeroing=0, the devices are probed one by one as before
+#  async        parallel probes, every probe still zeroes its memory
+#  async+defer  parallel probes, the memory is zeroed by a worker after the probe
+#  detached     like async+defer, and insmod does not wait for the probes (async_probe=1)
+#load_ms is the insmod time, ready_ms is the time until every device file exists
+#the output is csv
+
+DRIVER=$1
+SETUP=$2
+COUNT=${3:-64}
+SIZE=${4:-64M}
+CLASS=/sys/class/pseudo_plf_dev_class
+
+if [ -z "$DRIVER" ] || [ -z "$SETUP" ]; then
+    echo "usage: $0 <driver.ko> <setup.ko> [devices count] [device size]" >&2
+    exit 1
+fi
+
+now_ms()
+{
+    echo $(( $(date +%s%N) / 1000000 ))
+}
+
+#the static devices of the setup module are counted too
+devices_ready()
+{
+    ls "$CLASS" 2>/dev/null | grep -vc '\.snap'
+}
+
+run()
+{
+    name=$1
+    shift
+
+    start=$(now_ms)
+    insmod "$DRIVER" blk_devices=0 "$@" || exit 1
+    load=$(( $(now_ms) - start ))
+
+    expected=$(( COUNT + 5 ))
+    while [ "$(devices_ready)" -lt "$expected" ]; do
+        sleep 0.001
+    done
+    ready=$(( $(now_ms) - start ))
+
+    echo "$name,$COUNT,$SIZE,$load,$ready"
+    rmmod pseudo_platform_driver
+}
+
+insmod "$SETUP" bulk_count="$COUNT" bulk_size="$SIZE" || exit 1
+
+echo "mode,devices,size,load_ms,ready_ms"
+run sync sync_probe=1 defer_zeroing=0
+run async defer_zeroing=0
+run async+defer
+run detached async_probe=1
+
+rmmod pseudo_device_setup
@@ -0,0 +1,99 @@
+#!/bin/sh
+#probe/remove time and memory use of the platform pseudo devices for a growing devices count
+#usage: plf_scaling.sh <driver.ko> <setup.ko> [devices counts] [device size] [blk devices]
+#example: plf_scaling.sh ../Pseudo_Platform_Device/pseudo_platform_driver.ko ../Pseudo_Platform_Device/pseudo_device_setup.ko "10 100 1000 10000" 4K 0
+#every count is measured twice:
+#  bulk      the setup module registers the devices at load time with platform_add_devices
+#  configfs  the devices are created one by one with mkdir and enable, and removed with rmdir
+#the driver is loaded before every step, so the times are the probe and remove of the devices only
+#the static devices of the setup module are in the memory baseline of both methods
+#the output is csv, memory columns are the growth of /proc/meminfo fields in kB after the probe
+
+DRIVER=$1
+SETUP=$2
+COUNTS=${3:-"10 100 1000 10000"}
+SIZE=${4:-4K}
+BLK=${5:-0}
+CONFIGFS=/sys/kernel/config/pseudo_plf
+
+if [ -z "$DRIVER" ] || [ -z "$SETUP" ]; then
+    echo "usage: $0 <driver.ko> <setup.ko> [devices counts] [device size] [blk devices]" >&2
+    exit 1
+fi
+
+meminfo()
+{
+    awk -v field="$1:" '$1 == field { print $2 }' /proc/meminfo
+}
+
+now_ms()
+{
+    echo $(( $(date +%s%N) / 1000000 ))
+}
+
+mem_start()
+{
+    vmalloc=$(meminfo VmallocUsed)
+    percpu=$(meminfo Percpu)
+    slab=$(meminfo Slab)
+    available=$(meminfo MemAvailable)
+}
+
+mem_end()
+{
+    vmalloc=$(( $(meminfo VmallocUsed) - vmalloc ))
+    percpu=$(( $(meminfo Percpu) - percpu ))
+    slab=$(( $(meminfo Slab) - slab ))
+    available=$(( available - $(meminfo MemAvailable) ))
+}
+
+mount | grep -q configfs || mount -t configfs none /sys/kernel/config
+
+echo "method,devices,size,blk,probe_ms,remove_ms,vmalloc_kb,percpu_kb,slab_kb,mem_used_kb"
+
+for count in $COUNTS; do
+    #bulk registration, the setup module load and unload probe and remove all devices
+    insmod "$DRIVER" blk_devices="$BLK" || exit 1
+    mem_start
+    start=$(now_ms)
+    if insmod "$SETUP" bulk_count="$count" bulk_size="$SIZE"; then
+        probe=$(( $(now_ms) - start ))
+        mem_end
+
+        start=$(now_ms)
+        rmmod pseudo_device_setup
+        remove=$(( $(now_ms) - start ))
+
+        echo "bulk,$count,$SIZE,$BLK,$probe,$remove,$vmalloc,$percpu,$slab,$available"
+    else
+        echo "bulk,$count,$SIZE,load failed" >&2
+    fi
+    rmmod pseudo_platform_driver
+
+    #configfs registration, one directory per device
+    insmod "$DRIVER" blk_devices="$BLK" || exit 1
+    insmod "$SETUP" || exit 1
+    mem_start
+    start=$(now_ms)
+    itr=0
+    while [ $itr -lt "$count" ]; do
+        mkdir "$CONFIGFS/dev$itr"
+        echo "$SIZE" > "$CONFIGFS/dev$itr/size"
+        echo 1 > "$CONFIGFS/dev$itr/enable"
+        itr=$(( itr + 1 ))
+    done
+    probe=$(( $(now_ms) - start ))
+    mem_end
+
+    start=$(now_ms)
+    itr=0
+    while [ $itr -lt "$count" ]; do
+        rmdir "$CONFIGFS/dev$itr"
+        itr=$(( itr + 1 ))
+    done
+    remove=$(( $(now_ms) - start ))
+
+    echo "configfs,$count,$SIZE,$BLK,$probe,$remove,$vmalloc,$percpu,$slab,$available"
+    rmmod pseudo_device_setup
+    rmmod pseudo_platform_driver
+done
@@ -0,0 +1,370 @@
+/*************************************************************/
+/*general purpose benchmark for the pseudo char devices      */
+/*configurable block size, threads, access pattern and mode  */
+/*************************************************************/
+
+/*usage: pseudo_bench [options] <device>                                          */
+/*  -b <bytes>    block size of every operation, default 4096                      */
+/*  -t <threads>  worker threads, every thread opens its own file, default 1       */
+/*  -S            all threads share one file, seq then contends on the file        */
+/*                position lock while rand and pos show positional scaling         */
+/*  -p <pattern>  seq: read/write at the file position, wrapped at the device end  */
+/*                rand: llseek to a random block then read/write                   */
+/*                pos: pread/pwrite at a random block                              */
+/*  -o <op>       read, write or mix, default read                                 */
+/*  -r <percent>  read percentage for the mix operation, default 70                */
+/*  -m <mode>     open mode r, w or rw, default derived from the operation         */
+/*  -n            open with O_NONBLOCK                                             */
+/*  -s <seconds>  run time, default 5                                              */
+/*  -f <format>   json or csv, default json                                        */
+/*example: pseudo_bench -b 512 -t 4 -p pos -o mix /dev/pseudo_char_dev:1           */
+/*the result is printed as one json object (or a csv header and row) so runs from  */
+/*different driver versions can be stored and compared by scripts                  */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "bench_common.h"
+
+#define DEFAULT_BLOCK_SIZE      4096
+#define DEFAULT_THREADS         1
+#define DEFAULT_SECONDS         5
+#define DEFAULT_READ_PERCENT    70
+
+enum pattern
+{
+    PATTERN_SEQ,
+    PATTERN_RAND,
+    PATTERN_POS,
+};
+
+enum operation
+{
+    OP_READ,
+    OP_WRITE,
+    OP_MIX,
+};
+
+struct worker_ctx
+{
+    pthread_t thread;
+    int fd;
+    int id;
+    uint64_t ops;
+    uint64_t bytes;
+    uint64_t errors;
+    uint64_t short_ops;
+    struct lat_hist hist;
+};
+
+static const char *pattern_names[] = {"seq", "rand", "pos"};
+static const char *op_names[] = {"read", "write", "mix"};
+static const char *mode_names[] = {"r", "w", "rw"};
+
+static const char *path;
+static size_t block_size = DEFAULT_BLOCK_SIZE;
+static int threads = DEFAULT_THREADS;
+static int seconds = DEFAULT_SECONDS;
+static int read_percent = DEFAULT_READ_PERCENT;
+static enum pattern pattern = PATTERN_SEQ;
+static enum operation operation = OP_READ;
+static int mode = -1;
+static int nonblock;
+static int shared_fd;
+static int csv;
+static off_t size;
+static atomic_int stop;
+
+static int lookup(const char *value, const char **names, int count)
+{
+    int itr;
+
+    for(itr=0; itr<count; itr++)
+    {
+        if(strcmp(value, names[itr]) == 0)
+            return itr;
+    }
+    return -1;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-b block] [-t threads] [-S] [-p seq|rand|pos] [-o read|write|mix] [-r read%%]\n"
+                    "       [-m r|w|rw] [-n] [-s seconds] [-f json|csv] <device>\n", name);
+}
+
+/*one operation, returns the syscall result*/
+static ssize_t do_op(struct worker_ctx *ctx, char *buf, int is_read, uint64_t *seed)
+{
+    off_t blocks = size / block_size;
+    off_t offset = 0;
+
+    if(pattern != PATTERN_SEQ)
+        offset = (xorshift64(seed) % blocks) * block_size;
+
+    switch(pattern)
+    {
+        case PATTERN_RAND:
+            if(lseek(ctx->fd, offset, SEEK_SET) < 0)
+                return -1;
+            /*fall through*/
+        case PATTERN_SEQ:
+            return is_read ? read(ctx->fd, buf, block_size) : write(ctx->fd, buf, block_size);
+        case PATTERN_POS:
+            return is_read ? pread(ctx->fd, buf, block_size, offset) : pwrite(ctx->fd, buf, block_size, offset);
+    }
+    return -1;
+}
+
+static void *worker_thread(void *arg)
+{
+    struct worker_ctx *ctx = arg;
+    uint64_t seed = ((uint64_t)ctx->id << 32) | 0x9e3779b9;
+    char *buf = malloc(block_size);
+
+    memset(buf, 'a' + ctx->id % 26, block_size);
+    while(!atomic_load_explicit(&stop, memory_order_relaxed))
+    {
+        int is_read = (operation == OP_READ) ||
+                      ((operation == OP_MIX) && ((int)(xorshift64(&seed) % 100) < read_percent));
+        uint64_t start = now_ns();
+        ssize_t ret = do_op(ctx, buf, is_read, &seed);
+        uint64_t latency = now_ns() - start;
+
+        if(ret < 0)
+        {
+            if((errno == EAGAIN) || (errno == EINTR))
+                continue;
+            /*sequential writes reach the device end with ENOMEM, start over from the beginning*/
+            if((pattern == PATTERN_SEQ) && (errno == ENOMEM) && (size > 0))
+            {
+                lseek(ctx->fd, 0, SEEK_SET);
+                continue;
+            }
+            ctx->errors++;
+            continue;
+        }
+
+        /*end of device for sequential reads*/
+        if((ret == 0) && (pattern == PATTERN_SEQ) && (size > 0))
+        {
+            lseek(ctx->fd, 0, SEEK_SET);
+            continue;
+        }
+
+        if((size_t)ret != block_size)
+            ctx->short_ops++;
+        ctx->ops++;
+        ctx->bytes += ret;
+        hist_add(&ctx->hist, latency);
+    }
+    free(buf);
+    return NULL;
+}
+
+static void print_result(struct worker_ctx *workers, double elapsed)
+{
+    struct lat_hist total_hist;
+    uint64_t total_ops = 0;
+    uint64_t total_bytes = 0;
+    uint64_t total_errors = 0;
+    uint64_t total_short = 0;
+    uint64_t mean;
+    int itr;
+
+    hist_init(&total_hist);
+    for(itr=0; itr<threads; itr++)
+    {
+        total_ops += workers[itr].ops;
+        total_bytes += workers[itr].bytes;
+        total_errors += workers[itr].errors;
+        total_short += workers[itr].short_ops;
+        hist_merge(&total_hist, &workers[itr].hist);
+    }
+    if(total_hist.count == 0)
+        total_hist.min = 0;
+    mean = total_hist.count ? total_hist.sum / total_hist.count : 0;
+
+    if(csv)
+    {
+        printf("device,size,block_size,threads,shared_fd,pattern,op,read_percent,mode,nonblock,seconds,"
+               "ops,bytes,errors,short_ops,iops,mb_per_s,lat_min_ns,lat_mean_ns,lat_p50_ns,"
+               "lat_p99_ns,lat_p999_ns,lat_max_ns\n");
+        printf("%s,%lld,%zu,%d,%d,%s,%s,%d,%s,%d,%.3f,%llu,%llu,%llu,%llu,%.0f,%.2f,%llu,%llu,%llu,%llu,%llu,%llu\n",
+               path, (long long)size, block_size, threads, shared_fd, pattern_names[pattern], op_names[operation],
+               read_percent, mode_names[mode], nonblock, elapsed,
+               (unsigned long long)total_ops, (unsigned long long)total_bytes,
+               (unsigned long long)total_errors, (unsigned long long)total_short,
+               total_ops / elapsed, total_bytes / elapsed / 1e6,
+               (unsigned long long)total_hist.min, (unsigned long long)mean,
+               (unsigned long long)hist_percentile(&total_hist, 50),
+               (unsigned long long)hist_percentile(&total_hist, 99),
+               (unsigned long long)hist_percentile(&total_hist, 99.9),
+               (unsigned long long)total_hist.max);
+        return;
+    }
+
+    printf("{\n");
+    printf("  \"device\": \"%s\",\n", path);
+    printf("  \"size\": %lld,\n", (long long)size);
+    printf("  \"block_size\": %zu,\n", block_size);
+    printf("  \"threads\": %d,\n", threads);
+    printf("  \"shared_fd\": %d,\n", shared_fd);
+    printf("  \"pattern\": \"%s\",\n", pattern_names[pattern]);
+    printf("  \"op\": \"%s\",\n", op_names[operation]);
+    printf("  \"read_percent\": %d,\n", read_percent);
+    printf("  \"mode\": \"%s\",\n", mode_names[mode]);
+    printf("  \"nonblock\": %d,\n", nonblock);
+    printf("  \"seconds\": %.3f,\n", elapsed);
+    printf("  \"ops\": %llu,\n", (unsigned long long)total_ops);
+    printf("  \"bytes\": %llu,\n", (unsigned long long)total_bytes);
+    printf("  \"errors\": %llu,\n", (unsigned long long)total_errors);
+    printf("  \"short_ops\": %llu,\n", (unsigned long long)total_short);
+    printf("  \"iops\": %.0f,\n", total_ops / elapsed);
+    printf("  \"mb_per_s\": %.2f,\n", total_bytes / elapsed / 1e6);
+    printf("  \"latency_ns\": {\"min\": %llu, \"mean\": %llu, \"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}\n",
+           (unsigned long long)total_hist.min, (unsigned long long)mean,
+           (unsigned long long)hist_percentile(&total_hist, 50),
+           (unsigned long long)hist_percentile(&total_hist, 99),
+           (unsigned long long)hist_percentile(&total_hist, 99.9),
+           (unsigned long long)total_hist.max);
+    printf("}\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static const int open_flags[] = {O_RDONLY, O_WRONLY, O_RDWR};
+    struct worker_ctx *workers;
+    uint64_t start;
+    double elapsed;
+    int opt;
+    int itr;
+    int fd;
+
+    while((opt = getopt(argc, argv, "b:t:Sp:o:r:m:ns:f:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'b':
+                block_size = strtoul(optarg, NULL, 0);
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'p':
+                pattern = lookup(optarg, pattern_names, 3);
+                break;
+            case 'o':
+                operation = lookup(optarg, op_names, 3);
+                break;
+            case 'r':
+                read_percent = atoi(optarg);
+                break;
+            case 'm':
+                mode = lookup(optarg, mode_names, 3);
+                if(mode < 0)
+                {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'n':
+                nonblock = 1;
+                break;
+            case 'S':
+                shared_fd = 1;
+                break;
+            case 's':
+                seconds = atoi(optarg);
+                break;
+            case 'f':
+                csv = (strcmp(optarg, "csv") == 0);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if((optind >= argc) || ((int)pattern < 0) || ((int)operation < 0) ||
+       (block_size == 0) || (threads <= 0) || (seconds <= 0) ||
+       (read_percent < 0) || (read_percent > 100))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    path = argv[optind];
+
+    /*the open mode follows the operation unless it was forced, forcing a wrong mode is*/
+    /*a valid way to measure the permission checks of the driver                        */
+    if(mode < 0)
+        mode = (operation == OP_READ) ? 0 : (operation == OP_WRITE) ? 1 : 2;
+
+    fd = open(path, open_flags[mode] | O_NONBLOCK);
+    if(fd < 0)
+    {
+        perror("open");
+        return 1;
+    }
+    size = device_size(fd);
+    close(fd);
+
+    /*fifo devices are streams without a size, only the sequential pattern applies*/
+    if((size <= 0) && (pattern != PATTERN_SEQ))
+    {
+        fprintf(stderr, "%s has no size, only the seq pattern is supported\n", path);
+        return 1;
+    }
+    if((size > 0) && (block_size > (size_t)size))
+    {
+        fprintf(stderr, "block size must fit the device size %lld\n", (long long)size);
+        return 1;
+    }
+
+    workers = calloc(threads, sizeof(*workers));
+    for(itr=0; itr<threads; itr++)
+    {
+        workers[itr].id = itr;
+        hist_init(&workers[itr].hist);
+        if(shared_fd && (itr > 0))
+        {
+            workers[itr].fd = workers[0].fd;
+            continue;
+        }
+        workers[itr].fd = open(path, open_flags[mode] | (nonblock ? O_NONBLOCK : 0));
+        if(workers[itr].fd < 0)
+        {
+            perror("open worker");
+            return 1;
+        }
+    }
+
+    start = now_ns();
+    for(itr=0; itr<threads; itr++)
+        pthread_create(&workers[itr].thread, NULL, worker_thread, &workers[itr]);
+
+    sleep(seconds);
+    atomic_store(&stop, 1);
+
+    /*blocking fifo workers can sleep in the driver forever, read and write are cancellation points*/
+    if((size <= 0) && !nonblock)
+    {
+        for(itr=0; itr<threads; itr++)
+            pthread_cancel(workers[itr].thread);
+    }
+
+    for(itr=0; itr<threads; itr++)
+        pthread_join(workers[itr].thread, NULL);
+    elapsed = (double)(now_ns() - start) / 1e9;
+
+    for(itr=0; itr<(shared_fd ? 1 : threads); itr++)
+        close(workers[itr].fd);
+
+    print_result(workers, elapsed);
+    free(workers);
+    return 0;
+}
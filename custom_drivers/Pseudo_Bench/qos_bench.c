@@ -0,0 +1,236 @@
+/*************************************************************/
+/*qos benchmark                                              */
+/*latency of a quiet client next to a noisy one, without    */
+/*limits, with the per file qos limit of a platform device   */
+/*and with both the per file and the device limits           */
+/*************************************************************/
+
+/*usage: qos_bench <device> [noisy threads] [seconds] [file bytes/s] [noisy block size] [device bytes/s]*/
+/*example: qos_bench /dev/pseudo_char_dev:1 8 3 50000000 65536 100000000                               */
+/*the noisy client writes big blocks from many threads through one open file, the quiet */
+/*client writes 512 byte blocks every 100 us through its own file. both take the device */
+/*write lock, so the quiet writes queue behind the noisy ones. the run is repeated with */
+/*the qos/file_bytes_per_sec sysfs file of the device set, the noisy file is held to    */
+/*the limit and the quiet latency goes back down. the last run adds the device limit,   */
+/*2 x the file limit by default, the noisy file and the quiet one stay below it together*/
+/*so the quiet latency must stay as low as with the file limit alone. the device needs  */
+/*rw permission and writing the sysfs files needs root                                   */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <libgen.h>
+#include "bench_common.h"
+
+#define DEFAULT_NOISY_THREADS   8
+#define DEFAULT_SECONDS         3
+#define DEFAULT_FILE_LIMIT      50000000ull
+/*the default device limit is this many times the file limit*/
+#define DEVICE_LIMIT_FACTOR     2
+#define DEFAULT_BLOCK_SIZE      65536
+#define QUIET_BLOCK_SIZE        512
+#define QUIET_INTERVAL_NS       100000
+
+static int noisy_fd;
+static int quiet_fd;
+static size_t block_size = DEFAULT_BLOCK_SIZE;
+static off_t size;
+static atomic_int stop;
+static atomic_ullong noisy_bytes;
+
+static void *noisy_thread(void *arg)
+{
+    char *buf = calloc(1, block_size);
+    off_t offset = 0;
+    ssize_t ret;
+
+    (void)arg;
+    while(!atomic_load_explicit(&stop, memory_order_relaxed))
+    {
+        if(offset + (off_t)block_size > size)
+            offset = 0;
+
+        ret = pwrite(noisy_fd, buf, block_size, offset);
+        if(ret <= 0)
+        {
+            perror("noisy pwrite");
+            break;
+        }
+        atomic_fetch_add_explicit(&noisy_bytes, ret, memory_order_relaxed);
+        offset += ret;
+    }
+
+    free(buf);
+    return NULL;
+}
+
+/*open loop, a write that starts late is measured from the time it should have started*/
+static void *quiet_thread(void *arg)
+{
+    struct lat_hist *hist = arg;
+    char buf[QUIET_BLOCK_SIZE] = {0};
+    uint64_t next = now_ns();
+    uint64_t now;
+
+    while(!atomic_load_explicit(&stop, memory_order_relaxed))
+    {
+        while((now = now_ns()) < next)
+            ;
+
+        if(pwrite(quiet_fd, buf, sizeof(buf), 0) != sizeof(buf))
+        {
+            perror("quiet pwrite");
+            break;
+        }
+        hist_add(hist, now_ns() - next);
+        next += QUIET_INTERVAL_NS;
+    }
+
+    return NULL;
+}
+
+/*qos and stats files of the device, -1 if the file can not be used*/
+static int sysfs_write(const char *device, const char *file, unsigned long long value)
+{
+    char *copy = strdup(device);
+    char path[256];
+    FILE *fp;
+    int ret = -1;
+
+    snprintf(path, sizeof(path), "/sys/class/pseudo_plf_dev_class/%s/%s", basename(copy), file);
+    fp = fopen(path, "w");
+    if(fp != NULL)
+    {
+        ret = (fprintf(fp, "%llu\n", value) > 0) ? 0 : -1;
+        if(fclose(fp) != 0)
+            ret = -1;
+    }
+
+    free(copy);
+    return ret;
+}
+
+static unsigned long long sysfs_read(const char *device, const char *file)
+{
+    char *copy = strdup(device);
+    unsigned long long value = 0;
+    char path[256];
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "/sys/class/pseudo_plf_dev_class/%s/%s", basename(copy), file);
+    fp = fopen(path, "r");
+    if(fp != NULL)
+    {
+        if(fscanf(fp, "%llu", &value) != 1)
+            value = 0;
+        fclose(fp);
+    }
+
+    free(copy);
+    return value;
+}
+
+static void run(const char *device, const char *name, int threads, int seconds)
+{
+    pthread_t *noisy = calloc(threads, sizeof(*noisy));
+    struct lat_hist *hist = malloc(sizeof(*hist));
+    unsigned long long throttled = sysfs_read(device, "stats/throttled");
+    pthread_t quiet;
+    uint64_t start;
+    int itr;
+
+    hist_init(hist);
+    atomic_store(&stop, 0);
+    atomic_store(&noisy_bytes, 0);
+
+    start = now_ns();
+    for(itr=0; itr<threads; itr++)
+        pthread_create(&noisy[itr], NULL, noisy_thread, NULL);
+    pthread_create(&quiet, NULL, quiet_thread, hist);
+
+    sleep(seconds);
+    atomic_store(&stop, 1);
+
+    for(itr=0; itr<threads; itr++)
+        pthread_join(noisy[itr], NULL);
+    pthread_join(quiet, NULL);
+    start = now_ns() - start;
+
+    printf("%-10s noisy MB/s:%9.1f  quiet us p50:%8.1f p99:%8.1f p99.9:%8.1f max:%8.1f  throttled:%llu\n", name,
+           atomic_load(&noisy_bytes) / ((double)start / 1e9) / 1e6,
+           hist_percentile(hist, 50) / 1e3, hist_percentile(hist, 99) / 1e3,
+           hist_percentile(hist, 99.9) / 1e3, hist->max / 1e3,
+           sysfs_read(device, "stats/throttled") - throttled);
+
+    free(hist);
+    free(noisy);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long long limit = DEFAULT_FILE_LIMIT;
+    unsigned long long device_limit = 0;
+    int threads = DEFAULT_NOISY_THREADS;
+    int seconds = DEFAULT_SECONDS;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: %s <device> [noisy threads] [seconds] [file bytes/s] [noisy block size] [device bytes/s]\n", argv[0]);
+        return 1;
+    }
+    if(argc > 2)
+        threads = atoi(argv[2]);
+    if(argc > 3)
+        seconds = atoi(argv[3]);
+    if(argc > 4)
+        limit = strtoull(argv[4], NULL, 0);
+    if(argc > 5)
+        block_size = strtoul(argv[5], NULL, 0);
+    if(argc > 6)
+        device_limit = strtoull(argv[6], NULL, 0);
+    if(device_limit == 0)
+        device_limit = limit * DEVICE_LIMIT_FACTOR;
+
+    /*one file per client, the file limit applies to each of them*/
+    noisy_fd = open(argv[1], O_RDWR);
+    quiet_fd = open(argv[1], O_RDWR);
+    if((noisy_fd < 0) || (quiet_fd < 0))
+    {
+        perror("open");
+        return 1;
+    }
+
+    size = device_size(noisy_fd);
+    if((threads <= 0) || (block_size == 0) || (size < (off_t)block_size) || (limit == 0))
+    {
+        fprintf(stderr, "invalid threads, block size or limit, the block must fit the device\n");
+        return 1;
+    }
+
+    printf("device:%s size:%lld noisy threads:%d block:%zu file limit:%llu bytes/s device limit:%llu bytes/s\n",
+           argv[1], (long long)size, threads, block_size, limit, device_limit);
+
+    if((sysfs_write(argv[1], "qos/file_bytes_per_sec", 0) < 0) || (sysfs_write(argv[1], "qos/bytes_per_sec", 0) < 0))
+    {
+        perror("qos/file_bytes_per_sec");
+        return 1;
+    }
+    run(argv[1], "no limit", threads, seconds);
+
+    sysfs_write(argv[1], "qos/file_bytes_per_sec", limit);
+    run(argv[1], "file limit", threads, seconds);
+
+    /*the noisy threads queue behind the file limit, they must not hold device time meanwhile*/
+    sysfs_write(argv[1], "qos/bytes_per_sec", device_limit);
+    run(argv[1], "file+dev", threads, seconds);
+
+    sysfs_write(argv[1], "qos/bytes_per_sec", 0);
+    sysfs_write(argv[1], "qos/file_bytes_per_sec", 0);
+
+    close(quiet_fd);
+    close(noisy_fd);
+    return 0;
+}
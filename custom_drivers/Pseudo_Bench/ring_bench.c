@@ -0,0 +1,348 @@
+/*************************************************************/
+/*ring benchmark                                             */
+/*message passing through a mapped ring device, compared to  */
+/*read and write on a fifo device                            */
+/*************************************************************/
+
+/*usage: ring_bench <ring device> [message size] [messages] [fifo device]           */
+/*example: ring_bench /dev/pseudo_char_dev:5 64 10000000 /dev/pseudo_char_dev:4    */
+/*a producer thread sends numbered messages and a consumer thread checks them.     */
+/*on the ring both sides spin for a while on an empty or full ring, then sleep in  */
+/*poll, kicks counts the system calls the ring needed to wake the other side       */
+/*load the module with a ring device: dev_modes=...,ring dev_sizes=...,1M           */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include "bench_common.h"
+#include "n_pseudo_ioctl.h"
+
+#define DEFAULT_MESSAGE_SIZE    64
+#define DEFAULT_MESSAGES        1000000
+/*empty or full ring checks before a side goes to sleep*/
+#define SPIN_LIMIT              1000
+
+struct ring
+{
+    int fd;
+    struct n_pseudo_ring_ctrl *ctrl;
+    char *data;
+    uint32_t size;
+    uint64_t kicks;
+    uint64_t sleeps;
+};
+
+static size_t message_size = DEFAULT_MESSAGE_SIZE;
+static long messages = DEFAULT_MESSAGES;
+
+/*sleep until poll reports the event, the flag tells the other side to kick*/
+/*the ring is checked again after the flag is set, the other side may have moved just before*/
+static void ring_wait(struct ring *ring, uint32_t *flag, short event, int (*ready)(struct ring *))
+{
+    struct pollfd pfd = {.fd = ring->fd, .events = event};
+    int spins;
+
+    for(spins=0; spins<SPIN_LIMIT; spins++)
+    {
+        if(ready(ring))
+            return;
+    }
+
+    while(!ready(ring))
+    {
+        __atomic_store_n(flag, 1, __ATOMIC_SEQ_CST);
+        if(!ready(ring))
+        {
+            ring->sleeps++;
+            poll(&pfd, 1, -1);
+        }
+        __atomic_store_n(flag, 0, __ATOMIC_RELAXED);
+    }
+}
+
+/*kick the other side only if it said it sleeps, the barrier orders the index store before the flag load*/
+static void ring_kick(struct ring *ring, uint32_t *flag)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if(__atomic_load_n(flag, __ATOMIC_RELAXED))
+    {
+        ioctl(ring->fd, N_PSEUDO_IOC_RING_KICK);
+        ring->kicks++;
+    }
+}
+
+static int ring_has_space(struct ring *ring)
+{
+    uint32_t tail = __atomic_load_n(&ring->ctrl->tail, __ATOMIC_ACQUIRE);
+
+    return ring->size - (ring->ctrl->head - tail) >= message_size;
+}
+
+static int ring_has_message(struct ring *ring)
+{
+    uint32_t head = __atomic_load_n(&ring->ctrl->head, __ATOMIC_ACQUIRE);
+
+    return head - ring->ctrl->tail >= message_size;
+}
+
+/*copies between a message and the ring, the message may wrap around the end of the data*/
+static void ring_copy(struct ring *ring, uint32_t index, char *msg, int to_ring)
+{
+    uint32_t offset = index & (ring->size - 1);
+    size_t first = ring->size - offset;
+
+    if(first > message_size)
+        first = message_size;
+
+    if(to_ring)
+    {
+        memcpy(ring->data + offset, msg, first);
+        memcpy(ring->data, msg + first, message_size - first);
+    }
+    else
+    {
+        memcpy(msg, ring->data + offset, first);
+        memcpy(msg + first, ring->data, message_size - first);
+    }
+}
+
+static void *ring_producer(void *arg)
+{
+    struct ring *ring = arg;
+    char *msg = calloc(1, message_size);
+    uint64_t seq;
+
+    for(seq=0; seq<(uint64_t)messages; seq++)
+    {
+        ring_wait(ring, &ring->ctrl->producer_waiting, POLLOUT, ring_has_space);
+
+        memcpy(msg, &seq, sizeof(seq));
+        ring_copy(ring, ring->ctrl->head, msg, 1);
+        __atomic_store_n(&ring->ctrl->head, ring->ctrl->head + message_size, __ATOMIC_RELEASE);
+
+        ring_kick(ring, &ring->ctrl->consumer_waiting);
+    }
+
+    free(msg);
+    return NULL;
+}
+
+static void *ring_consumer(void *arg)
+{
+    struct ring *ring = arg;
+    char *msg = malloc(message_size);
+    uint64_t expected;
+    uint64_t seq;
+
+    for(expected=0; expected<(uint64_t)messages; expected++)
+    {
+        ring_wait(ring, &ring->ctrl->consumer_waiting, POLLIN, ring_has_message);
+
+        ring_copy(ring, ring->ctrl->tail, msg, 0);
+        __atomic_store_n(&ring->ctrl->tail, ring->ctrl->tail + message_size, __ATOMIC_RELEASE);
+
+        ring_kick(ring, &ring->ctrl->producer_waiting);
+
+        memcpy(&seq, msg, sizeof(seq));
+        if(seq != expected)
+        {
+            fprintf(stderr, "ring: message %llu received as %llu\n", (unsigned long long)expected, (unsigned long long)seq);
+            exit(1);
+        }
+    }
+
+    free(msg);
+    return NULL;
+}
+
+static void *fifo_producer(void *arg)
+{
+    int fd = *(int *)arg;
+    char *msg = calloc(1, message_size);
+    uint64_t seq;
+    size_t done;
+    ssize_t ret;
+
+    for(seq=0; seq<(uint64_t)messages; seq++)
+    {
+        memcpy(msg, &seq, sizeof(seq));
+        for(done=0; done<message_size; done+=ret)
+        {
+            ret = write(fd, msg + done, message_size - done);
+            if(ret <= 0)
+            {
+                perror("fifo write");
+                exit(1);
+            }
+        }
+    }
+
+    free(msg);
+    return NULL;
+}
+
+static void *fifo_consumer(void *arg)
+{
+    int fd = *(int *)arg;
+    char *msg = malloc(message_size);
+    uint64_t expected;
+    uint64_t seq;
+    size_t done;
+    ssize_t ret;
+
+    for(expected=0; expected<(uint64_t)messages; expected++)
+    {
+        for(done=0; done<message_size; done+=ret)
+        {
+            ret = read(fd, msg + done, message_size - done);
+            if(ret <= 0)
+            {
+                perror("fifo read");
+                exit(1);
+            }
+        }
+
+        memcpy(&seq, msg, sizeof(seq));
+        if(seq != expected)
+        {
+            fprintf(stderr, "fifo: message %llu received as %llu\n", (unsigned long long)expected, (unsigned long long)seq);
+            exit(1);
+        }
+    }
+
+    free(msg);
+    return NULL;
+}
+
+static void report(const char *name, uint64_t elapsed)
+{
+    printf("%-5s msgs/s:%12.0f MB/s:%10.1f ns/msg:%8.1f", name, messages / ((double)elapsed / 1e9),
+           (double)messages * message_size / ((double)elapsed / 1e9) / 1e6, (double)elapsed / messages);
+}
+
+static void run_ring(const char *path)
+{
+    struct ring producer;
+    struct ring consumer;
+    pthread_t threads[2];
+    size_t map_size;
+    uint64_t start;
+    char *map;
+    int fd;
+
+    fd = open(path, O_RDWR);
+    if(fd < 0)
+    {
+        perror(path);
+        exit(1);
+    }
+
+    /*the control page tells the ring geometry, then the whole ring is mapped*/
+    map = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED)
+    {
+        perror("mmap control page");
+        exit(1);
+    }
+    producer.size = ((struct n_pseudo_ring_ctrl *)map)->size;
+    map_size = ((struct n_pseudo_ring_ctrl *)map)->data_offset + producer.size;
+    munmap(map, sysconf(_SC_PAGESIZE));
+
+    if(message_size > producer.size)
+    {
+        fprintf(stderr, "the message size is above the ring size %u\n", producer.size);
+        exit(1);
+    }
+
+    map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED)
+    {
+        perror("mmap ring");
+        exit(1);
+    }
+
+    /*the two sides keep their own counters, they share only the mapping*/
+    producer.fd = fd;
+    producer.ctrl = (struct n_pseudo_ring_ctrl *)map;
+    producer.data = map + producer.ctrl->data_offset;
+    producer.kicks = 0;
+    producer.sleeps = 0;
+    consumer = producer;
+
+    /*start from an empty ring, a previous run may have left a partial message*/
+    producer.ctrl->head = producer.ctrl->tail;
+
+    start = now_ns();
+    pthread_create(&threads[0], NULL, ring_consumer, &consumer);
+    pthread_create(&threads[1], NULL, ring_producer, &producer);
+    pthread_join(threads[1], NULL);
+    pthread_join(threads[0], NULL);
+    start = now_ns() - start;
+
+    report("ring", start);
+    printf(" kicks:%llu sleeps:%llu\n", (unsigned long long)(producer.kicks + consumer.kicks),
+           (unsigned long long)(producer.sleeps + consumer.sleeps));
+
+    munmap(map, map_size);
+    close(fd);
+}
+
+static void run_fifo(const char *path)
+{
+    pthread_t threads[2];
+    uint64_t start;
+    int read_fd;
+    int write_fd;
+
+    read_fd = open(path, O_RDONLY);
+    write_fd = open(path, O_WRONLY);
+    if((read_fd < 0) || (write_fd < 0))
+    {
+        perror(path);
+        exit(1);
+    }
+
+    start = now_ns();
+    pthread_create(&threads[0], NULL, fifo_consumer, &read_fd);
+    pthread_create(&threads[1], NULL, fifo_producer, &write_fd);
+    pthread_join(threads[1], NULL);
+    pthread_join(threads[0], NULL);
+    start = now_ns() - start;
+
+    report("fifo", start);
+    printf(" syscalls:>=%llu\n", (unsigned long long)messages * 2);
+
+    close(read_fd);
+    close(write_fd);
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: %s <ring device> [message size] [messages] [fifo device]\n", argv[0]);
+        return 1;
+    }
+    if(argc > 2)
+        message_size = strtoul(argv[2], NULL, 0);
+    if(argc > 3)
+        messages = strtol(argv[3], NULL, 0);
+
+    if((message_size < sizeof(uint64_t)) || (messages <= 0))
+    {
+        fprintf(stderr, "the message size must hold the 8 byte sequence number\n");
+        return 1;
+    }
+
+    printf("message size:%zu messages:%ld\n", message_size, messages);
+    run_ring(argv[1]);
+    if(argc > 4)
+        run_fifo(argv[4]);
+
+    return 0;
+}
@@ -0,0 +1,158 @@
+/*************************************************************/
+/*snapshot benchmark                                         */
+/*snapshot creation time and the copy on write cost          */
+/*************************************************************/
+
+/*usage: snapshot_bench <device> [written size] [block size]                        */
+/*example: snapshot_bench /dev/pseudo_char_dev:3 256M 65536                         */
+/*the first written size bytes of the device are filled, then:                     */
+/*  snapshot    time of PSEUDO_PLF_IOC_SNAPSHOT                                     */
+/*  cow write   rewrite of the range, every page is copied before it is written     */
+/*  write       second rewrite, the pages are private again                         */
+/*  snap read   read of the snapshot, it must still hold the data of the fill       */
+/*the snapshot is deleted at the end, the device must be a flat rw platform device */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include "bench_common.h"
+#include "pseudo_plf_ioctl.h"
+
+#define DEFAULT_WRITTEN_SIZE    (64 << 20)
+#define DEFAULT_BLOCK_SIZE      65536
+
+static size_t block_size = DEFAULT_BLOCK_SIZE;
+
+/*writes the range with the given byte, returns MB/s*/
+static double fill_range(int fd, off_t range, char value)
+{
+    char *buf = malloc(block_size);
+    uint64_t start;
+    off_t offset;
+
+    memset(buf, value, block_size);
+    start = now_ns();
+    for(offset=0; offset<range; offset+=block_size)
+    {
+        if(pwrite(fd, buf, block_size, offset) != (ssize_t)block_size)
+        {
+            perror("pwrite");
+            exit(1);
+        }
+    }
+    start = now_ns() - start;
+
+    free(buf);
+    return range / ((double)start / 1e9) / 1e6;
+}
+
+/*reads the range and checks every byte has the given value, returns MB/s*/
+static double check_range(int fd, off_t range, char value)
+{
+    char *buf = malloc(block_size);
+    uint64_t start;
+    off_t offset;
+    size_t itr;
+
+    start = now_ns();
+    for(offset=0; offset<range; offset+=block_size)
+    {
+        if(pread(fd, buf, block_size, offset) != (ssize_t)block_size)
+        {
+            perror("pread");
+            exit(1);
+        }
+        for(itr=0; itr<block_size; itr++)
+        {
+            if(buf[itr] != value)
+            {
+                fprintf(stderr, "snapshot changed at %lld\n", (long long)(offset + itr));
+                exit(1);
+            }
+        }
+    }
+    start = now_ns() - start;
+
+    free(buf);
+    return range / ((double)start / 1e9) / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+    off_t range = DEFAULT_WRITTEN_SIZE;
+    struct pseudo_plf_snapshot snap;
+    char snap_path[64];
+    uint64_t start;
+    off_t size;
+    int snap_fd;
+    int fd;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: %s <device> [written size] [block size]\n", argv[0]);
+        return 1;
+    }
+    if(argc > 2)
+    {
+        char *end;
+
+        range = strtoull(argv[2], &end, 0);
+        if((*end == 'K') || (*end == 'k'))
+            range <<= 10;
+        else if((*end == 'M') || (*end == 'm'))
+            range <<= 20;
+        else if((*end == 'G') || (*end == 'g'))
+            range <<= 30;
+    }
+    if(argc > 3)
+        block_size = strtoul(argv[3], NULL, 0);
+
+    fd = open(argv[1], O_RDWR);
+    if(fd < 0)
+    {
+        perror("open");
+        return 1;
+    }
+    size = device_size(fd);
+    if(range > size)
+        range = size;
+    if((block_size == 0) || (range % block_size))
+    {
+        fprintf(stderr, "the written size %lld must be a multiple of the block size\n", (long long)range);
+        return 1;
+    }
+
+    printf("device:%s size:%lld written:%lld block:%zu\n", argv[1], (long long)size, (long long)range, block_size);
+    printf("%-10s MB/s:%10.1f\n", "fill", fill_range(fd, range, 0x11));
+
+    start = now_ns();
+    if(ioctl(fd, PSEUDO_PLF_IOC_SNAPSHOT, &snap) < 0)
+    {
+        perror("snapshot");
+        return 1;
+    }
+    printf("%-10s us:%12.1f\n", "snapshot", (now_ns() - start) / 1e3);
+
+    printf("%-10s MB/s:%10.1f\n", "cow write", fill_range(fd, range, 0x22));
+    printf("%-10s MB/s:%10.1f\n", "write", fill_range(fd, range, 0x33));
+
+    /*udev creates the snapshot device file, the name follows the origin file name*/
+    snprintf(snap_path, sizeof(snap_path), "%s.snap%u", argv[1], snap.id);
+    snap_fd = open(snap_path, O_RDONLY);
+    if(snap_fd < 0)
+    {
+        perror(snap_path);
+    }
+    else
+    {
+        printf("%-10s MB/s:%10.1f\n", "snap read", check_range(snap_fd, range, 0x11));
+        close(snap_fd);
+    }
+
+    if(ioctl(fd, PSEUDO_PLF_IOC_SNAP_DELETE, &snap.id) < 0)
+        perror("snapshot delete");
+
+    close(fd);
+    return 0;
+}
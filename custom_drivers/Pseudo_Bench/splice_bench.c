@@ -0,0 +1,252 @@
+/*************************************************************/
+/*splice benchmark                                           */
+/*zero copy splice against a read/write loop through a pipe  */
+/*************************************************************/
+
+/*usage: splice_bench <device> [block size] [seconds] [range]                       */
+/*example: splice_bench /dev/pseudo_char_dev:3 65536 2 64M                          */
+/*every mode moves data between the device and a pipe for the given time:          */
+/*  read         read() from the device and write() the buffer to the pipe          */
+/*  splice       splice() from the device to the pipe, no user space copy           */
+/*  sendfile     sendfile() from the device to /dev/null                            */
+/*  write        read() from the pipe and write() the buffer to the device          */
+/*  splice-write splice() from the pipe to the device                               */
+/*a helper thread keeps the other side of the pipe drained or filled, it uses the  */
+/*same calls in all modes so only the device side changes. the device offset wraps */
+/*at the range end, the range is the device size up to the given limit              */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/sendfile.h>
+#include "bench_common.h"
+
+#define DEFAULT_BLOCK_SIZE      65536
+#define DEFAULT_SECONDS         2
+#define DEFAULT_RANGE           (64 << 20)
+
+enum mode
+{
+    MODE_READ,
+    MODE_SPLICE,
+    MODE_SENDFILE,
+    MODE_WRITE,
+    MODE_SPLICE_WRITE,
+    MODE_COUNT
+};
+
+static const char *mode_names[] = {"read", "splice", "sendfile", "write", "splice-write"};
+
+static size_t block_size = DEFAULT_BLOCK_SIZE;
+static atomic_int stop;
+
+/*empties the pipe into /dev/null, splice to /dev/null does not touch the data*/
+static void *drain_thread(void *arg)
+{
+    int pipe_rd = *(int *)arg;
+    int null_fd = open("/dev/null", O_WRONLY);
+
+    while(!atomic_load_explicit(&stop, memory_order_relaxed))
+    {
+        if(splice(pipe_rd, NULL, null_fd, NULL, block_size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK) < 0)
+            usleep(10);
+    }
+    close(null_fd);
+    return NULL;
+}
+
+/*keeps the pipe full of non zero data, zeros would keep the holes of a sparse device*/
+static void *fill_thread(void *arg)
+{
+    int pipe_wr = *(int *)arg;
+    char *buf = malloc(block_size);
+
+    memset(buf, 0x5a, block_size);
+    while(!atomic_load_explicit(&stop, memory_order_relaxed))
+    {
+        if(write(pipe_wr, buf, block_size) < 0)
+            usleep(10);
+    }
+    free(buf);
+    return NULL;
+}
+
+static double run_mode(const char *path, enum mode mode, int seconds, off_t range)
+{
+    int is_write = (mode == MODE_WRITE) || (mode == MODE_SPLICE_WRITE);
+    char *buf = malloc(block_size);
+    uint64_t bytes = 0;
+    uint64_t start;
+    pthread_t helper;
+    loff_t offset = 0;
+    loff_t call_offset;
+    int pipe_fds[2];
+    int null_fd = -1;
+    ssize_t ret;
+    int fd;
+
+    /*read only and write only devices run only half of the modes*/
+    fd = open(path, is_write ? O_WRONLY : O_RDONLY);
+    if(fd < 0)
+    {
+        free(buf);
+        return -1;
+    }
+
+    /*the helper end of the pipe is non blocking, so the helper sees the stop flag*/
+    if(pipe2(pipe_fds, 0) < 0)
+    {
+        perror("pipe");
+        exit(1);
+    }
+    fcntl(pipe_fds[0], F_SETPIPE_SZ, block_size * 4);
+    fcntl(is_write ? pipe_fds[1] : pipe_fds[0], F_SETFL, O_NONBLOCK);
+
+    if(mode == MODE_SENDFILE)
+        null_fd = open("/dev/null", O_WRONLY);
+
+    atomic_store(&stop, 0);
+    if(is_write)
+        pthread_create(&helper, NULL, fill_thread, &pipe_fds[1]);
+    else
+        pthread_create(&helper, NULL, drain_thread, &pipe_fds[0]);
+
+    start = now_ns();
+    while(now_ns() - start < (uint64_t)seconds * 1000000000ull)
+    {
+        size_t len = block_size;
+
+        /*splice and sendfile move the offset they get, the loop moves it for all modes below*/
+        call_offset = offset;
+        if(offset + (off_t)len > range)
+            len = range - offset;
+
+        switch(mode)
+        {
+            case MODE_READ:
+                ret = pread(fd, buf, len, offset);
+                if(ret > 0)
+                    ret = write(pipe_fds[1], buf, ret);
+            break;
+
+            case MODE_SPLICE:
+                ret = splice(fd, &call_offset, pipe_fds[1], NULL, len, SPLICE_F_MOVE);
+            break;
+
+            case MODE_SENDFILE:
+                ret = sendfile(null_fd, fd, &call_offset, len);
+            break;
+
+            case MODE_WRITE:
+                ret = read(pipe_fds[0], buf, len);
+                if(ret > 0)
+                    ret = pwrite(fd, buf, ret, offset);
+            break;
+
+            default:
+                ret = splice(pipe_fds[0], NULL, fd, &call_offset, len, SPLICE_F_MOVE);
+            break;
+        }
+
+        if(ret < 0)
+        {
+            perror(mode_names[mode]);
+            exit(1);
+        }
+
+        bytes += ret;
+        offset += ret;
+        if(offset >= range)
+            offset = 0;
+    }
+    start = now_ns() - start;
+
+    atomic_store(&stop, 1);
+    pthread_join(helper, NULL);
+
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    if(null_fd >= 0)
+        close(null_fd);
+    close(fd);
+    free(buf);
+
+    return bytes / ((double)start / 1e9) / 1e6;
+}
+
+static void print_result(enum mode mode, double rate)
+{
+    if(rate < 0)
+        printf("%-13s skipped, the device can not be opened for this mode\n", mode_names[mode]);
+    else
+        printf("%-13s MB/s:%10.1f\n", mode_names[mode], rate);
+}
+
+int main(int argc, char *argv[])
+{
+    off_t range = DEFAULT_RANGE;
+    int seconds = DEFAULT_SECONDS;
+    off_t size;
+    int mode;
+    int fd;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: %s <device> [block size] [seconds] [range]\n", argv[0]);
+        return 1;
+    }
+    if(argc > 2)
+        block_size = strtoul(argv[2], NULL, 0);
+    if(argc > 3)
+        seconds = atoi(argv[3]);
+    if(argc > 4)
+    {
+        char *end;
+
+        range = strtoull(argv[4], &end, 0);
+        if((*end == 'K') || (*end == 'k'))
+            range <<= 10;
+        else if((*end == 'M') || (*end == 'm'))
+            range <<= 20;
+        else if((*end == 'G') || (*end == 'g'))
+            range <<= 30;
+    }
+
+    /*the size is read with lseek, any open mode works for it*/
+    fd = open(argv[1], O_RDONLY);
+    if(fd < 0)
+        fd = open(argv[1], O_WRONLY);
+    if(fd < 0)
+    {
+        perror("open");
+        return 1;
+    }
+    size = device_size(fd);
+    close(fd);
+
+    if(size <= 0)
+    {
+        fprintf(stderr, "%s has no size, fifo devices are not supported\n", argv[1]);
+        return 1;
+    }
+    if(range > size)
+        range = size;
+    if((block_size == 0) || (block_size > (size_t)range))
+    {
+        fprintf(stderr, "block size must fit the range %lld\n", (long long)range);
+        return 1;
+    }
+
+    printf("device:%s range:%lld block:%zu\n", argv[1], (long long)range, block_size);
+
+    /*write modes first, so the read modes see allocated pages and not only holes*/
+    for(mode=MODE_WRITE; mode<MODE_COUNT; mode++)
+        print_result(mode, run_mode(argv[1], mode, seconds, range));
+    for(mode=MODE_READ; mode<MODE_WRITE; mode++)
+        print_result(mode, run_mode(argv[1], mode, seconds, range));
+
+    return 0;
+}
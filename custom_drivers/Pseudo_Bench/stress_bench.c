@@ -0,0 +1,217 @@
+/*************************************************************/
+/*multi threaded stress benchmark                            */
+/*parallel readers with an optional writer on one device     */
+/*************************************************************/
+
+/*usage: stress_bench <device> [max threads] [record size] [seconds] [writer]    */
+/*example: stress_bench /dev/pseudo_char_dev:1 8 64 2 1                         */
+/*the reader count is doubled from 1 up to max threads and the read rate is     */
+/*reported for every step. when the writer is enabled it keeps rewriting the    */
+/*whole device with one byte value per pass, so every record a reader gets must */
+/*contain a single byte value, otherwise the read is counted as torn            */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "bench_common.h"
+
+#define DEFAULT_MAX_THREADS     8
+#define DEFAULT_RECORD_SIZE     64
+#define DEFAULT_SECONDS         2
+
+struct reader_ctx
+{
+    pthread_t thread;
+    int fd;
+    uint64_t reads;
+    uint64_t torn;
+};
+
+static const char *path;
+static size_t record_size = DEFAULT_RECORD_SIZE;
+static off_t size;
+static int verify;
+static atomic_int stop;
+
+static void *reader_thread(void *arg)
+{
+    struct reader_ctx *ctx = arg;
+    uint64_t seed = (uintptr_t)arg | 1;
+    long records = size / record_size;
+    char *buf = malloc(record_size);
+    size_t itr;
+
+    while(!atomic_load_explicit(&stop, memory_order_relaxed))
+    {
+        off_t offset = (xorshift64(&seed) % records) * record_size;
+
+        if(pread(ctx->fd, buf, record_size, offset) != (ssize_t)record_size)
+        {
+            perror("pread");
+            break;
+        }
+        ctx->reads++;
+
+        if(verify)
+        {
+            for(itr=1; itr<record_size; itr++)
+            {
+                if(buf[itr] != buf[0])
+                {
+                    ctx->torn++;
+                    break;
+                }
+            }
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+static void *writer_thread(void *arg)
+{
+    int fd = *(int *)arg;
+    char *buf = malloc(size);
+    unsigned char value = 0;
+
+    while(!atomic_load_explicit(&stop, memory_order_relaxed))
+    {
+        memset(buf, value++, size);
+        if(pwrite(fd, buf, size, 0) != size)
+        {
+            perror("pwrite");
+            break;
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    struct reader_ctx *readers;
+    pthread_t writer;
+    int max_threads = DEFAULT_MAX_THREADS;
+    int seconds = DEFAULT_SECONDS;
+    int writer_fd = -1;
+    int threads;
+    int itr;
+    int fd;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: %s <device> [max threads] [record size] [seconds] [writer]\n", argv[0]);
+        return 1;
+    }
+    path = argv[1];
+    if(argc > 2)
+        max_threads = atoi(argv[2]);
+    if(argc > 3)
+        record_size = strtoul(argv[3], NULL, 0);
+    if(argc > 4)
+        seconds = atoi(argv[4]);
+    if(argc > 5)
+        verify = atoi(argv[5]);
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        perror("open");
+        return 1;
+    }
+    size = device_size(fd);
+    close(fd);
+
+    /*records must not cross a page because the driver updates the memory one page at a time*/
+    if((size <= 0) || (record_size == 0) || (record_size > (size_t)size) || (4096 % record_size))
+    {
+        fprintf(stderr, "record size must divide 4096 and fit the device size %lld\n", (long long)size);
+        return 1;
+    }
+
+    readers = calloc(max_threads, sizeof(*readers));
+
+    /*the writer runs for the whole benchmark, one pass is done before the readers start*/
+    if(verify)
+    {
+        writer_fd = open(path, O_WRONLY);
+        if(writer_fd < 0)
+        {
+            perror("open writer");
+            return 1;
+        }
+        char *buf = calloc(1, size);
+        if(pwrite(writer_fd, buf, size, 0) != size)
+        {
+            perror("pwrite");
+            return 1;
+        }
+        free(buf);
+        pthread_create(&writer, NULL, writer_thread, &writer_fd);
+    }
+
+    printf("device:%s size:%lld record:%zu writer:%s\n", path, (long long)size, record_size, verify ? "on" : "off");
+
+    for(threads=1; threads<=max_threads; threads*=2)
+    {
+        uint64_t total_reads = 0;
+        uint64_t total_torn = 0;
+        uint64_t start;
+        double elapsed;
+
+        /*each reader has its own file so the file position lock is not shared*/
+        for(itr=0; itr<threads; itr++)
+        {
+            memset(&readers[itr], 0, sizeof(readers[itr]));
+            readers[itr].fd = open(path, O_RDONLY);
+            if(readers[itr].fd < 0)
+            {
+                perror("open reader");
+                return 1;
+            }
+        }
+
+        start = now_ns();
+        for(itr=0; itr<threads; itr++)
+            pthread_create(&readers[itr].thread, NULL, reader_thread, &readers[itr]);
+
+        sleep(seconds);
+        atomic_store(&stop, 1);
+
+        for(itr=0; itr<threads; itr++)
+        {
+            pthread_join(readers[itr].thread, NULL);
+            close(readers[itr].fd);
+            total_reads += readers[itr].reads;
+            total_torn += readers[itr].torn;
+        }
+        elapsed = (double)(now_ns() - start) / 1e9;
+
+        printf("threads:%3d reads/s:%12.0f per thread:%12.0f torn:%llu\n", threads,
+               total_reads / elapsed, total_reads / elapsed / threads, (unsigned long long)total_torn);
+
+        /*restart the writer flag for the next step*/
+        if(verify)
+        {
+            pthread_join(writer, NULL);
+            atomic_store(&stop, 0);
+            pthread_create(&writer, NULL, writer_thread, &writer_fd);
+        }
+        else
+        {
+            atomic_store(&stop, 0);
+        }
+    }
+
+    if(verify)
+    {
+        atomic_store(&stop, 1);
+        pthread_join(writer, NULL);
+        close(writer_fd);
+    }
+
+    free(readers);
+    return 0;
+}
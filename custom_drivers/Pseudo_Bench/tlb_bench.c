@@ -0,0 +1,162 @@
+/*************************************************************/
+/*tlb benchmark                                              */
+/*random access over a mapped device with huge and small     */
+/*page mappings                                              */
+/*************************************************************/
+
+/*usage: tlb_bench <device> [accesses]                                             */
+/*example: tlb_bench /dev/pseudo_char_dev:0 20000000                               */
+/*the device is mapped twice. the first mapping uses the huge chunks of the device */
+/*and the second one is advised with MADV_NOHUGEPAGE so it gets small page entries */
+/*for both, the first touch of every page is timed, then random 8 byte loads are  */
+/*timed and the dTLB load misses are counted with perf_event_open when allowed     */
+/*load the module with a multi GB device: dev_sizes=4G dev_modes=flat              */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "bench_common.h"
+
+#define DEFAULT_ACCESSES        10000000
+
+/*user space dTLB load misses of this thread, -1 if perf events are not allowed*/
+static int tlb_counter_open(void)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HW_CACHE;
+    attr.config         = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled       = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/*huge chunks of the device from sysfs, -1 if the file is not found*/
+static long device_huge_pages(const char *device)
+{
+    char *copy = strdup(device);
+    char file[256];
+    long value = -1;
+    FILE *fp;
+
+    snprintf(file, sizeof(file), "/sys/class/n_pseudo_char_class/%s/huge_pages", basename(copy));
+    fp = fopen(file, "r");
+    if(fp != NULL)
+    {
+        if(fscanf(fp, "%ld", &value) != 1)
+            value = -1;
+        fclose(fp);
+    }
+
+    free(copy);
+    return value;
+}
+
+static void run(const char *name, int fd, off_t size, long accesses, int small_pages)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    uint64_t seed = 88172645463325252ull;
+    uint64_t words = size / sizeof(uint64_t);
+    uint64_t checksum = 0;
+    uint64_t fault_ns;
+    uint64_t access_ns;
+    long long misses = -1;
+    char *map;
+    off_t offset;
+    long itr;
+    int counter;
+
+    map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(1);
+    }
+
+    if(small_pages && madvise(map, size, MADV_NOHUGEPAGE) < 0)
+        perror("madvise");
+
+    /*first touch, a huge chunk is mapped by one fault instead of one per page*/
+    fault_ns = now_ns();
+    for(offset=0; offset<size; offset+=page_size)
+        checksum += *(volatile char *)(map + offset);
+    fault_ns = now_ns() - fault_ns;
+
+    counter = tlb_counter_open();
+    if(counter >= 0)
+    {
+        ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    access_ns = now_ns();
+    for(itr=0; itr<accesses; itr++)
+        checksum += ((volatile uint64_t *)map)[xorshift64(&seed) % words];
+    access_ns = now_ns() - access_ns;
+
+    if(counter >= 0)
+    {
+        ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+        if(read(counter, &misses, sizeof(misses)) != sizeof(misses))
+            misses = -1;
+        close(counter);
+    }
+
+    printf("%-6s fault ms:%10.1f  access ns:%8.2f  dtlb misses/access:", name, fault_ns / 1e6, (double)access_ns / accesses);
+    if(misses >= 0)
+        printf("%8.4f\n", (double)misses / accesses);
+    else
+        printf("%8s\n", "n/a");
+
+    /*keeps the loads from being optimized out*/
+    if(checksum == 1)
+        printf("checksum:%llu\n", (unsigned long long)checksum);
+
+    munmap(map, size);
+}
+
+int main(int argc, char *argv[])
+{
+    long accesses = DEFAULT_ACCESSES;
+    off_t size;
+    int fd;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: %s <device> [accesses]\n", argv[0]);
+        return 1;
+    }
+    if(argc > 2)
+        accesses = strtol(argv[2], NULL, 0);
+
+    fd = open(argv[1], O_RDONLY);
+    if(fd < 0)
+    {
+        perror("open");
+        return 1;
+    }
+
+    size = device_size(fd);
+    if((size < (off_t)sizeof(uint64_t)) || (accesses <= 0))
+    {
+        fprintf(stderr, "invalid device size or accesses count\n");
+        return 1;
+    }
+
+    printf("device:%s size:%lld accesses:%ld huge chunks:%ld\n", argv[1], (long long)size, accesses, device_huge_pages(argv[1]));
+    run("huge", fd, size, accesses, 0);
+    run("small", fd, size, accesses, 1);
+
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,229 @@
+/*************************************************************/
+/*io_uring benchmark                                         */
+/*measure IOPS against a pseudo device at several queue depth*/
+/*************************************************************/
+
+/*usage: uring_bench <device> [max queue depth] [record size] [ops per step] [read|readv|write] */
+/*example: uring_bench /dev/pseudo_char_dev:1 64 64 1000000 readv                             */
+/*the queue depth is doubled from 1 up to max queue depth, readv splits every record in two    */
+/*iov segments so the vectored path of the driver is measured                                  */
+/*liburing is not needed, the ring is set up with the raw system calls                         */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "bench_common.h"
+
+#define DEFAULT_MAX_DEPTH       64
+#define DEFAULT_RECORD_SIZE     64
+#define DEFAULT_OPS             1000000
+
+struct uring
+{
+    int fd;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+struct slot
+{
+    char *buf;
+    struct iovec iov[2];
+};
+
+static int uring_setup(struct uring *ring, unsigned entries)
+{
+    struct io_uring_params params;
+    void *sq_ptr;
+    void *cq_ptr;
+
+    memset(&params, 0, sizeof(params));
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if(ring->fd < 0)
+        return -1;
+
+    sq_ptr = mmap(NULL, params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    cq_ptr = mmap(NULL, params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe),
+                  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+                      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if((sq_ptr == MAP_FAILED) || (cq_ptr == MAP_FAILED) || (ring->sqes == MAP_FAILED))
+        return -1;
+
+    ring->sq_tail = sq_ptr + params.sq_off.tail;
+    ring->sq_mask = sq_ptr + params.sq_off.ring_mask;
+    ring->sq_array = sq_ptr + params.sq_off.array;
+    ring->cq_head = cq_ptr + params.cq_off.head;
+    ring->cq_tail = cq_ptr + params.cq_off.tail;
+    ring->cq_mask = cq_ptr + params.cq_off.ring_mask;
+    ring->cqes = cq_ptr + params.cq_off.cqes;
+    return 0;
+}
+
+static void uring_queue(struct uring *ring, int fd, int opcode, struct slot *slot, unsigned index,
+                        size_t record_size, off_t offset)
+{
+    unsigned tail = *ring->sq_tail;
+    unsigned sq_index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[sq_index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->user_data = index;
+    if(opcode == IORING_OP_READV)
+    {
+        sqe->addr = (uintptr_t)slot->iov;
+        sqe->len = 2;
+    }
+    else
+    {
+        sqe->addr = (uintptr_t)slot->buf;
+        sqe->len = record_size;
+    }
+    ring->sq_array[sq_index] = sq_index;
+
+    /*the kernel reads the tail with acquire semantics*/
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path;
+    const char *op = "read";
+    unsigned max_depth = DEFAULT_MAX_DEPTH;
+    size_t record_size = DEFAULT_RECORD_SIZE;
+    long ops = DEFAULT_OPS;
+    uint64_t seed = 88172645463325252ull;
+    struct slot *slots;
+    struct uring ring;
+    unsigned depth;
+    unsigned itr;
+    long records;
+    off_t size;
+    int opcode;
+    int fd;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: %s <device> [max queue depth] [record size] [ops per step] [read|readv|write]\n", argv[0]);
+        return 1;
+    }
+    path = argv[1];
+    if(argc > 2)
+        max_depth = strtoul(argv[2], NULL, 0);
+    if(argc > 3)
+        record_size = strtoul(argv[3], NULL, 0);
+    if(argc > 4)
+        ops = strtol(argv[4], NULL, 0);
+    if(argc > 5)
+        op = argv[5];
+
+    if(strcmp(op, "readv") == 0)
+        opcode = IORING_OP_READV;
+    else if(strcmp(op, "write") == 0)
+        opcode = IORING_OP_WRITE;
+    else
+        opcode = IORING_OP_READ;
+
+    fd = open(path, (opcode == IORING_OP_WRITE) ? O_WRONLY : O_RDONLY);
+    if(fd < 0)
+    {
+        perror("open");
+        return 1;
+    }
+    size = device_size(fd);
+    if((size <= 0) || (record_size < 2) || (record_size > (size_t)size))
+    {
+        fprintf(stderr, "invalid record size %zu for device size %lld\n", record_size, (long long)size);
+        return 1;
+    }
+    records = size / record_size;
+
+    if(uring_setup(&ring, max_depth) < 0)
+    {
+        perror("io_uring_setup");
+        return 1;
+    }
+
+    slots = calloc(max_depth, sizeof(*slots));
+    for(itr=0; itr<max_depth; itr++)
+    {
+        slots[itr].buf = calloc(1, record_size);
+        slots[itr].iov[0].iov_base = slots[itr].buf;
+        slots[itr].iov[0].iov_len = record_size / 2;
+        slots[itr].iov[1].iov_base = slots[itr].buf + record_size / 2;
+        slots[itr].iov[1].iov_len = record_size - record_size / 2;
+    }
+
+    printf("device:%s size:%lld record:%zu op:%s\n", path, (long long)size, record_size, op);
+
+    for(depth=1; depth<=max_depth; depth*=2)
+    {
+        long submitted = 0;
+        long completed = 0;
+        unsigned to_submit = 0;
+        uint64_t start = now_ns();
+        double elapsed;
+
+        /*fill the queue, then submit one new request for every completion*/
+        for(itr=0; (itr<depth) && (submitted<ops); itr++, submitted++, to_submit++)
+            uring_queue(&ring, fd, opcode, &slots[itr], itr, record_size, (xorshift64(&seed) % records) * record_size);
+
+        while(completed < ops)
+        {
+            unsigned head;
+            unsigned tail;
+
+            if(syscall(__NR_io_uring_enter, ring.fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0)
+            {
+                perror("io_uring_enter");
+                return 1;
+            }
+            to_submit = 0;
+
+            head = *ring.cq_head;
+            tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+            for(; head != tail; head++)
+            {
+                struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+                unsigned index = cqe->user_data;
+
+                if(cqe->res != (int)record_size)
+                {
+                    fprintf(stderr, "request failed: %s\n", strerror(cqe->res < 0 ? -cqe->res : EIO));
+                    return 1;
+                }
+                completed++;
+
+                if(submitted < ops)
+                {
+                    uring_queue(&ring, fd, opcode, &slots[index], index, record_size, (xorshift64(&seed) % records) * record_size);
+                    submitted++;
+                    to_submit++;
+                }
+            }
+            __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+        }
+
+        elapsed = (double)(now_ns() - start) / 1e9;
+        printf("depth:%4u iops:%12.0f MB/s:%10.1f\n", depth, completed / elapsed, completed * record_size / elapsed / 1e6);
+    }
+
+    close(ring.fd);
+    close(fd);
+    return 0;
+}
@@ -5,13 +5,30 @@
 #include <linux/device.h>
 #include <linux/kdev_t.h>
 #include <linux/uaccess.h>
+#include <linux/mutex.h>
+#include <linux/seqlock.h>
+#include <linux/ktime.h>
+
+/*tracepoints are created once in the module that owns them*/
+#define CREATE_TRACE_POINTS
+#include "pseudo_trace.h"
 
 #define DEV_MEM_SIZE            512
 #define MINOR_NUM_START_NUMBER  0
 #define MINOR_NUMBER_COUNT      1
+/*a reader falls back to the write lock if writers keep changing the memory under it*/
+#define MAX_READ_RETRIES        8
 
 static char device_mem[DEV_MEM_SIZE];
 
+/*writers are serialized by the write lock, readers dont take any lock*/
+/*they copy the memory and retry if the sequence count shows that a writer changed it meanwhile*/
+static DEFINE_MUTEX(device_write_lock);
+static seqcount_mutex_t device_mem_seq = SEQCNT_MUTEX_ZERO(device_mem_seq, &device_write_lock);
+
+/*copy_from_user can sleep so it can not run inside the write section, user data is copied here first*/
+static char write_bounce_buffer[DEV_MEM_SIZE];
+
 /*device number*/
 dev_t dev_num;
 
@@ -24,6 +41,8 @@ ssize_t pseudo_read (struct file *filePtr, char __user *buffer, size_t count, lo
 ssize_t pseudo_write (struct file *filePtr, const char __user *buffer, size_t count, loff_t *f_pos);\
 int pseudo_open (struct inode *inodePtr, struct file *filePtr);
 int pseudo_release (struct inode *inodePtr, struct file *filePtr);
+ssize_t mem_read (char __user *buffer, size_t count, loff_t *f_pos);
+ssize_t mem_write (const char __user *buffer, size_t count, loff_t *f_pos);
 
 /*file_operations struct*/
 struct file_operations pseudo_fops = {
@@ -125,100 +144,135 @@ static void __exit pseudo_deinit(void)
 
 int pseudo_open (struct inode *inodePtr, struct file *filePtr)
 {
-    pr_info("pseudo_open method called:\n");
+    /*read, write and llseek on a shared file are serialized by the file position lock,*/
+    /*pread and pwrite use the position they get and never take that lock              */
+    filePtr->f_mode |= FMODE_ATOMIC_POS;
+
+    trace_pseudo_char_open(MINOR(dev_num), (__force unsigned int)filePtr->f_mode, 0);
 	return 0;
 }
 int pseudo_release (struct inode *inodePtr, struct file *filePtr)
 {
-    pr_info("pseudo_release method called:\n");
 	return 0;
 }
 
 ssize_t pseudo_read (struct file *filePtr, char __user *buffer, size_t count, loff_t *f_pos)
 {
-    pr_info("pseudo_read method called, count:%zu, file position:%lld\n", count, *f_pos);
+    loff_t pos = *f_pos;
+    u64 start = 0;
+    ssize_t ret;
+
+    /*the latency is measured only while the tracepoint is enabled*/
+    if(trace_pseudo_char_read_enabled())
+        start = ktime_get_ns();
+
+    ret = mem_read(buffer, count, f_pos);
+
+    if(trace_pseudo_char_read_enabled())
+        trace_pseudo_char_read(MINOR(dev_num), count, pos, ret, ktime_get_ns() - start);
+
+    return ret;
+}
+
+ssize_t mem_read (char __user *buffer, size_t count, loff_t *f_pos)
+{
+    unsigned int seq;
+    int retries;
+
+    /*pread can start at any offset, nothing to read beyond the memory*/
+    if(*f_pos >= DEV_MEM_SIZE)
+        return 0;
 
     /*if the count exeeds the memory size truncate the count*/
     if((count + *f_pos) > DEV_MEM_SIZE)
         count = DEV_MEM_SIZE - *f_pos;
     
-    /*copy data, note that this code is not thread safe*/
+    /*copy data without taking a lock, retry if a writer changed the memory meanwhile*/
+    for(retries=0; retries<MAX_READ_RETRIES; retries++)
+    {
+        seq = read_seqcount_begin(&device_mem_seq);
+        if(copy_to_user(buffer, &device_mem[*f_pos], count) > 0)
+            return -EFAULT;
+
+        /*the copy is consistent if no writer touched the memory while copying*/
+        if(!read_seqcount_retry(&device_mem_seq, seq))
+            goto done;
+    }
+
+    /*writers keep changing the memory, take the write lock so the reader is not starved*/
+    mutex_lock(&device_write_lock);
     if(copy_to_user(buffer, &device_mem[*f_pos], count) > 0)
+    {
+        mutex_unlock(&device_write_lock);
         return -EFAULT;
+    }
+    mutex_unlock(&device_write_lock);
 
+done:
     /*update file position*/
     *f_pos = *f_pos + count;
 
-    pr_info("number of bytes have been read%zu, file position:%lld\n", count, *f_pos);
 	return count;
 }
 
 ssize_t pseudo_write (struct file *filePtr, const char __user *buffer, size_t count, loff_t *f_pos)
 {
-	pr_info("pseudo_write method called, count:%zu, file position:%lld\n", count, *f_pos);
+    loff_t pos = *f_pos;
+    u64 start = 0;
+    ssize_t ret;
 
-    if(*f_pos == DEV_MEM_SIZE)
-    {
-        /*EOF reached*/
-        pr_info("no space left\n");
+    /*the latency is measured only while the tracepoint is enabled*/
+    if(trace_pseudo_char_write_enabled())
+        start = ktime_get_ns();
+
+    ret = mem_write(buffer, count, f_pos);
+
+    if(trace_pseudo_char_write_enabled())
+        trace_pseudo_char_write(MINOR(dev_num), count, pos, ret, ktime_get_ns() - start);
+
+    return ret;
+}
+
+ssize_t mem_write (const char __user *buffer, size_t count, loff_t *f_pos)
+{
+    /*EOF reached, no space left, pwrite can also start beyond the memory*/
+    if(*f_pos >= DEV_MEM_SIZE)
         return -ENOMEM;
-    }
     
     /*if the count exeeds the memory size truncate the count*/
     if((count + *f_pos) > DEV_MEM_SIZE)
         count = DEV_MEM_SIZE - *f_pos;
     
-    /*copy data, note that this code is not thread safe*/
-    if(copy_from_user(&device_mem[*f_pos], buffer, count) > 0)
+    /*copy data, writers are serialized by the write lock*/
+    mutex_lock(&device_write_lock);
+    if(copy_from_user(write_bounce_buffer, buffer, count) > 0)
+    {
+        mutex_unlock(&device_write_lock);
         return -EFAULT;
+    }
+
+    /*readers that overlap this section will retry their copy*/
+    write_seqcount_begin(&device_mem_seq);
+    memcpy(&device_mem[*f_pos], write_bounce_buffer, count);
+    write_seqcount_end(&device_mem_seq);
+    mutex_unlock(&device_write_lock);
 
     /*update file position*/
     *f_pos = *f_pos + count;
         
-    pr_info("number of bytes have been written%zu, file position:%lld\n", count, *f_pos);
 	return count;
 }
 
 loff_t pseudo_llseek (struct file *filePtr, loff_t offset, int whence)
 {
-    pr_info("pseudo_llseek method called, current f_pos:%lld\n", filePtr->f_pos);
     loff_t newPos;
-    switch (whence)
-    {
-        case SEEK_SET:
-            /*return error if the file position will go beyond file memory or if it will be <0*/
-            if((offset > DEV_MEM_SIZE) || (offset < 0))
-                return -EINVAL;
-
-            filePtr->f_pos = offset;
-        break;
-
-        case SEEK_CUR:
-            newPos = filePtr->f_pos +offset;
-            
-            /*return error if the file position will go beyond file memory or if it will be <0*/
-            if( (newPos > DEV_MEM_SIZE) || (newPos < 0) )
-                return -EINVAL;
-
-            filePtr->f_pos = newPos;
-        break;
-        
-        case SEEK_END:
-            newPos = DEV_MEM_SIZE + offset;
 
-            /*return error if the file position will go beyond file memory or if it will be <0*/
-            if( (newPos > DEV_MEM_SIZE) || (newPos < 0) )
-                return -EINVAL;
+    /*the generic helper returns EINVAL if the file position will go beyond file memory or if it*/
+    /*will be <0, it updates f_pos with vfs_setpos and does SEEK_CUR atomically under f_lock     */
+    newPos = fixed_size_llseek(filePtr, offset, whence, DEV_MEM_SIZE);
 
-            filePtr->f_pos = newPos;
-        break;
-        
-        default:
-            return -EINVAL;
-        break;
-    }
-    pr_info("new f_pos:%lld\n", filePtr->f_pos);
-	return filePtr->f_pos;
+    trace_pseudo_char_llseek(MINOR(dev_num), offset, whence, newPos);
+	return newPos;
 }
 
 /*registration section*/
@@ -0,0 +1,223 @@
+#ifndef  __PSEUDO_FIFO_
+#define  __PSEUDO_FIFO_
+
+/*single producer single consumer fifo helpers shared by the pseudo drivers                */
+/*head is moved only by writers and tail only by readers, both run freely and are masked  */
+/*with size-1, so the fifo size must be a power of 2                                      */
+/*readers and writers have separate locks, so a producer and a consumer never wait for    */
+/*each other, the driver owns the locks, the wait queues and the buffer, they are passed  */
+/*here with the fifo state                                                                */
+
+#include <linux/types.h>
+#include <linux/atomic.h>
+#include <linux/minmax.h>
+#include <linux/fs.h>
+#include <linux/mutex.h>
+#include <linux/wait.h>
+#include <linux/wait_bit.h>
+#include <linux/uio.h>
+
+/*fifo state of one device*/
+struct pseudo_fifo
+{
+    unsigned int head;
+    unsigned int tail;
+    /*open files of each side, a side with one file used by one task skips its lock, see fifo_lock*/
+    atomic_t readers;
+    atomic_t writers;
+    int read_lockless;
+    int write_lockless;
+};
+
+static inline unsigned int fifo_len(struct pseudo_fifo *fifo)
+{
+    return READ_ONCE(fifo->head) - READ_ONCE(fifo->tail);
+}
+
+static inline void fifo_count_files(struct pseudo_fifo *fifo, struct file *file_ptr, int delta)
+{
+    if(file_ptr->f_mode & FMODE_READ)
+        atomic_add(delta, &fifo->readers);
+    if(file_ptr->f_mode & FMODE_WRITE)
+        atomic_add(delta, &fifo->writers);
+}
+
+/*leaves the side entered by fifo_lock, locked is what fifo_lock returned*/
+static inline void fifo_unlock(int *lockless, struct mutex *lock, int locked)
+{
+    if(locked == 0)
+    {
+        mutex_unlock(lock);
+        return;
+    }
+
+    smp_store_release(lockless, 0);
+    /*the waiter check in wake_up_var must not pass the flag store*/
+    smp_mb();
+    wake_up_var(lockless);
+}
+
+/*one side of the fifo (readers or writers) is entered without its mutex when its only open file*/
+/*is not shared with another task or io_uring, lockless marks that user inside the fifo and a    */
+/*user that takes the mutex waits until it is out. returns 1 lockless, 0 with the mutex held     */
+static inline int fifo_lock(struct file *file_ptr, atomic_t *files, int *lockless, struct mutex *lock, bool nonblock)
+{
+    if((atomic_read(files) == 1) && (file_count(file_ptr) == 1))
+    {
+        WRITE_ONCE(*lockless, 1);
+        /*pairs with the barrier after the mutex, either a new user sees the flag or it is counted here*/
+        smp_mb();
+        if((atomic_read(files) == 1) && (file_count(file_ptr) == 1))
+            return 1;
+        fifo_unlock(lockless, lock, 1);
+    }
+
+    if(nonblock)
+    {
+        if(!mutex_trylock(lock))
+            return -EAGAIN;
+    }
+    else if(mutex_lock_interruptible(lock))
+    {
+        return -ERESTARTSYS;
+    }
+
+    /*a lockless user that started before this file was opened or shared finishes its copy first*/
+    smp_mb();
+    if(READ_ONCE(*lockless))
+    {
+        if(nonblock || wait_var_event_killable(lockless, !READ_ONCE(*lockless)))
+        {
+            mutex_unlock(lock);
+            return nonblock ? -EAGAIN : -ERESTARTSYS;
+        }
+    }
+
+    return 0;
+}
+
+/*reads from the size bytes buffer of the fifo, readers wait on read_queue and wake the writers on write_queue*/
+static inline ssize_t fifo_read(struct kiocb *iocb, struct iov_iter *to, struct pseudo_fifo *fifo, char *buffer, size_t size,
+                                struct mutex *read_lock, wait_queue_head_t *read_queue, wait_queue_head_t *write_queue)
+{
+    struct file *file_ptr = iocb->ki_filp;
+    size_t count = iov_iter_count(to);
+    bool nonblock = (file_ptr->f_flags & O_NONBLOCK) || (iocb->ki_flags & IOCB_NOWAIT);
+    unsigned int head;
+    unsigned int tail;
+    size_t offset;
+    size_t first;
+    size_t copied;
+    int locked;
+
+    /*readers are serialized between each other only, a writer never takes this lock*/
+    locked = fifo_lock(file_ptr, &fifo->readers, &fifo->read_lockless, read_lock, nonblock);
+    if(locked < 0)
+        return locked;
+
+    /*wait for data if the fifo is empty, or return immediately for non blocking files*/
+    while(fifo_len(fifo) == 0)
+    {
+        fifo_unlock(&fifo->read_lockless, read_lock, locked);
+
+        if(nonblock)
+            return -EAGAIN;
+
+        if(wait_event_interruptible(*read_queue, fifo_len(fifo) != 0))
+            return -ERESTARTSYS;
+
+        locked = fifo_lock(file_ptr, &fifo->readers, &fifo->read_lockless, read_lock, nonblock);
+        if(locked < 0)
+            return locked;
+    }
+
+    /*acquire pairs with the writer release, so the data before head is visible*/
+    head = smp_load_acquire(&fifo->head);
+    tail = fifo->tail;
+
+    count = min_t(size_t, count, head - tail);
+    offset = tail & (size - 1);
+    first = min_t(size_t, count, size - offset);
+
+    /*the data may wrap around the end of the buffer*/
+    copied = copy_to_iter(buffer+offset, first, to);
+    if(copied == first)
+        copied += copy_to_iter(buffer, count-first, to);
+
+    if((copied == 0) && (count > 0))
+    {
+        fifo_unlock(&fifo->read_lockless, read_lock, locked);
+        return -EFAULT;
+    }
+
+    /*release the space only after the data is copied out*/
+    smp_store_release(&fifo->tail, tail + copied);
+    fifo_unlock(&fifo->read_lockless, read_lock, locked);
+
+    wake_up_interruptible(write_queue);
+    return copied;
+}
+
+/*writes to the size bytes buffer of the fifo, writers wait on write_queue and wake the readers on read_queue*/
+static inline ssize_t fifo_write(struct kiocb *iocb, struct iov_iter *from, struct pseudo_fifo *fifo, char *buffer, size_t size,
+                                 struct mutex *write_lock, wait_queue_head_t *read_queue, wait_queue_head_t *write_queue)
+{
+    struct file *file_ptr = iocb->ki_filp;
+    size_t count = iov_iter_count(from);
+    bool nonblock = (file_ptr->f_flags & O_NONBLOCK) || (iocb->ki_flags & IOCB_NOWAIT);
+    unsigned int head;
+    unsigned int tail;
+    size_t offset;
+    size_t first;
+    size_t copied;
+    int locked;
+
+    /*writers are serialized between each other only, a reader never takes this lock*/
+    locked = fifo_lock(file_ptr, &fifo->writers, &fifo->write_lockless, write_lock, nonblock);
+    if(locked < 0)
+        return locked;
+
+    /*wait for space if the fifo is full, or return immediately for non blocking files*/
+    while(fifo_len(fifo) == size)
+    {
+        fifo_unlock(&fifo->write_lockless, write_lock, locked);
+
+        if(nonblock)
+            return -EAGAIN;
+
+        if(wait_event_interruptible(*write_queue, fifo_len(fifo) != size))
+            return -ERESTARTSYS;
+
+        locked = fifo_lock(file_ptr, &fifo->writers, &fifo->write_lockless, write_lock, nonblock);
+        if(locked < 0)
+            return locked;
+    }
+
+    /*acquire pairs with the reader release, so the reader is done with the freed space*/
+    tail = smp_load_acquire(&fifo->tail);
+    head = fifo->head;
+
+    count = min_t(size_t, count, size - (head - tail));
+    offset = head & (size - 1);
+    first = min_t(size_t, count, size - offset);
+
+    /*the data may wrap around the end of the buffer*/
+    copied = copy_from_iter(buffer+offset, first, from);
+    if(copied == first)
+        copied += copy_from_iter(buffer, count-first, from);
+
+    if((copied == 0) && (count > 0))
+    {
+        fifo_unlock(&fifo->write_lockless, write_lock, locked);
+        return -EFAULT;
+    }
+
+    /*publish the data to the readers*/
+    smp_store_release(&fifo->head, head + copied);
+    fifo_unlock(&fifo->write_lockless, write_lock, locked);
+
+    wake_up_interruptible(read_queue);
+    return copied;
+}
+
+#endif
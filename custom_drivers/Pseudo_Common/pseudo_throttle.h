@@ -0,0 +1,57 @@
+#ifndef  __PSEUDO_THROTTLE_
+#define  __PSEUDO_THROTTLE_
+
+/*rate limiting helpers shared by the pseudo drivers                                      */
+/*every limit is a GCRA, it keeps its tat, the time in ns at which the limit is back to  */
+/*idle after all the requests it accepted, a request may start once it is no more than   */
+/*the burst time ahead of the tat and moves the tat by its own cost                      */
+/*the caller reserves the start time under the lock of its limits and then sleeps until */
+/*it, so throttled callers are served in the order they came and none of them spins      */
+
+#include <linux/types.h>
+#include <linux/math64.h>
+#include <linux/minmax.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/sched.h>
+#include <linux/sched/signal.h>
+
+/*time in ns of count units at rate units/s, count is at most MAX_RW_COUNT so the product fits 64 bits*/
+static inline u64 throttle_cost(u64 count, u64 rate)
+{
+    return div64_u64(count * NSEC_PER_SEC, rate);
+}
+
+/*earliest start of a request under one limit, no sooner than earliest*/
+static inline u64 throttle_start(u64 tat, u64 earliest, u64 burst_ns)
+{
+    if(tat > earliest + burst_ns)
+        return tat - burst_ns;
+
+    return earliest;
+}
+
+/*charge a request that starts at start to the limit, an idle limit gets no credit beyond the burst*/
+static inline void throttle_charge(u64 *tat, u64 start, u64 cost_ns)
+{
+    *tat = max(*tat, start) + cost_ns;
+}
+
+/*sleeps on an hrtimer until the ktime_get_ns time deadline, both use the monotonic clock*/
+/*the reserved slot stays taken if a signal ends the wait, so a signal can not pass a limit*/
+static inline int throttle_sleep_until(u64 deadline)
+{
+    ktime_t expires = ns_to_ktime(deadline);
+
+    while(ktime_get_ns() < deadline)
+    {
+        set_current_state(TASK_INTERRUPTIBLE);
+        schedule_hrtimeout(&expires, HRTIMER_MODE_ABS);
+        if(signal_pending(current))
+            return -ERESTARTSYS;
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,87 @@
+/***********************************************************/
+/*trace event classes shared by the pseudo drivers         */
+/*a driver trace header sets its TRACE_SYSTEM, includes    */
+/*this file and defines its events on these classes, the   */
+/*classes are static in each module so the names dont clash*/
+/***********************************************************/
+
+/*read again with the driver header by trace/define_trace.h*/
+#if !defined(_PSEUDO_TRACE_CLASS_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _PSEUDO_TRACE_CLASS_H
+
+#include <linux/tracepoint.h>
+
+/*read and write events, latency is the time spent inside the driver*/
+DECLARE_EVENT_CLASS(pseudo_io,
+
+    TP_PROTO(unsigned int minor, size_t count, loff_t pos, ssize_t result, u64 latency_ns),
+
+    TP_ARGS(minor, count, pos, result, latency_ns),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(size_t, count)
+        __field(loff_t, pos)
+        __field(ssize_t, result)
+        __field(u64, latency_ns)
+    ),
+
+    TP_fast_assign(
+        __entry->minor      = minor;
+        __entry->count      = count;
+        __entry->pos        = pos;
+        __entry->result     = result;
+        __entry->latency_ns = latency_ns;
+    ),
+
+    TP_printk("minor=%u count=%zu pos=%lld result=%zd latency_ns=%llu",
+              __entry->minor, __entry->count, __entry->pos, __entry->result, __entry->latency_ns)
+);
+
+DECLARE_EVENT_CLASS(pseudo_llseek,
+
+    TP_PROTO(unsigned int minor, loff_t offset, int whence, loff_t result),
+
+    TP_ARGS(minor, offset, whence, result),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(loff_t, offset)
+        __field(int, whence)
+        __field(loff_t, result)
+    ),
+
+    TP_fast_assign(
+        __entry->minor  = minor;
+        __entry->offset = offset;
+        __entry->whence = whence;
+        __entry->result = result;
+    ),
+
+    TP_printk("minor=%u offset=%lld whence=%d result=%lld",
+              __entry->minor, __entry->offset, __entry->whence, __entry->result)
+);
+
+DECLARE_EVENT_CLASS(pseudo_open,
+
+    TP_PROTO(unsigned int minor, unsigned int f_mode, int result),
+
+    TP_ARGS(minor, f_mode, result),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+        __field(unsigned int, f_mode)
+        __field(int, result)
+    ),
+
+    TP_fast_assign(
+        __entry->minor  = minor;
+        __entry->f_mode = f_mode;
+        __entry->result = result;
+    ),
+
+    TP_printk("minor=%u f_mode=0x%x result=%d",
+              __entry->minor, __entry->f_mode, __entry->result)
+);
+
+#endif
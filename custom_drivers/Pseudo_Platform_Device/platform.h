@@ -1,17 +1,39 @@
 #ifndef  __PLF_CFG_
 #define  __PLF_CFG_
 
-/*number of platform devices*/
-#define PLF_DEV_COUNT           2
-#define MAX_NUMBER_OF_DEVICES   5
+/*number of static platform devices, the setup module creates more at runtime*/
+/*the driver allocates a minor per device, so the devices count is limited by the minor space only*/
+#define PLF_DEV_COUNT           5
+#define MAX_NUMBER_OF_DEVICES   (1 << 20)
+
+/*serial number buffer size of the runtime devices*/
+#define SERIAL_NUMBER_LEN       32
 
 /*device permission*/
 #define RONLY_PERMISSION        0b01
 #define WONLY_PERMISSION        0b10
 #define RW_PERMISSION           0b11
 
+/*device mode*/
+/*flat mode: the device is a seekable memory*/
+/*fifo mode: the device is a circular buffer, readers wait for data and writers wait for space*/
+#define FLAT_MODE               0
+#define FIFO_MODE               1
+
 #define DEV0_MEM_SIZE           1024
 #define DEV1_MEM_SIZE           512
+/*fifo devices size must be power of 2*/
+#define DEV2_MEM_SIZE           1024
+/*sparse device, memory is used only for the written pages*/
+#define DEV3_MEM_SIZE           (1UL << 30)
+/*compressed device, memory is used only for the compressed written chunks*/
+#define DEV4_MEM_SIZE           (64UL << 20)
+
+/*numa_node values other than a node id*/
+/*any: the pages come from the node of the cpu that allocates them, this is the probe or the first writer*/
+/*interleave: page n of the device is on the n-th memory node modulo the memory nodes count             */
+#define PLF_NUMA_ANY            (-1)
+#define PLF_NUMA_INTERLEAVE     (-2)
 
 /*device platform data*/
 struct pseudo_platform_data{
@@ -20,6 +42,16 @@ struct pseudo_platform_data{
     /*first bit for read permission and second bit for write permission*/
     /* example: 0b11 means RW permission                               */
     int permission;
+    int mode;
+    /*flat devices only, a sparse device allocates its pages on the first write instead of at probe*/
+    /*pages that were never written are holes, they are read as zeros                              */
+    int sparse;
+    /*flat devices only, the memory is kept as lz4 compressed page size chunks, it trades cpu for memory*/
+    /*compressed devices are always sparse, chunks that were never written or are all zeros are holes */
+    int compressed;
+    /*node of the device memory, a node id or PLF_NUMA_ANY or PLF_NUMA_INTERLEAVE*/
+    /*0 is a node id, so the platform data must set this field explicitly       */
+    int numa_node;
 };
 
 
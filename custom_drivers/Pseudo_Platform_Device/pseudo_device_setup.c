@@ -1,38 +1,136 @@
 /**************************************************************/
 /*psuedo platform device driver                               */
-/*interface with 2 pseudo memory devices using platform driver*/
+/*interface with 4 pseudo memory devices using platform driver*/
+/*more devices are created at runtime through configfs, or in */
+/*bulk at load time with the bulk_count parameter             */
 /**************************************************************/
 
 /********file includes********/
 
 #include <linux/module.h>
 #include <linux/platform_device.h>
+#include <linux/configfs.h>
+#include <linux/idr.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/mutex.h>
 #include "platform.h"
  
 /********functions decleartions*******/
 
 /*device release function*/
 void pseudo_dev_release(struct device*);
+void bulk_dev_release(struct device*);
+
+int bulk_devices_add(void);
+void bulk_devices_del(void);
+int names_lookup(const char * const *names, int count, const char *page);
+int numa_node_parse(const char *page, int *node);
+
+/*configfs interface*/
+struct config_item *pseudo_cfg_make_item(struct config_group *group, const char *name);
+void pseudo_cfg_drop_item(struct config_group *group, struct config_item *item);
+void pseudo_cfg_release(struct config_item *item);
 
 
 /********data types definition********/
 
+/*bulk devices are flat rw devices of the same size, they are registered in one platform_add_devices call*/
+/*example: insmod pseudo_device_setup.ko bulk_count=10000 bulk_size=4K bulk_sparse=1             */
+static unsigned int bulk_count;
+module_param(bulk_count, uint, 0444);
+MODULE_PARM_DESC(bulk_count, "number of flat rw devices registered at load time");
+
+static char *bulk_size = "4K";
+module_param(bulk_size, charp, 0444);
+MODULE_PARM_DESC(bulk_size, "memory size of the bulk devices, K/M/G suffixes are accepted");
+
+static bool bulk_sparse;
+module_param(bulk_sparse, bool, 0444);
+MODULE_PARM_DESC(bulk_sparse, "bulk devices allocate their pages on the first write");
+
+static char *bulk_numa_node = "any";
+module_param(bulk_numa_node, charp, 0444);
+MODULE_PARM_DESC(bulk_numa_node, "memory node of the bulk devices: any, interleave or a node id");
+
+/*platform device ids, the static devices use the ids below PLF_DEV_COUNT*/
+static DEFINE_IDA(plf_dev_ida);
+
+/*a bulk device is allocated with its platform data, bulk_dev_release frees both with the device id*/
+struct bulk_dev
+{
+    struct platform_device plf_dev;
+    struct pseudo_platform_data plf_data;
+};
+
+/*the array passed to platform_add_devices, a device may outlive its unregister until its last user is gone*/
+struct platform_device **bulk_devs;
+
+/*names used by configfs, indexed by the permission and mode values*/
+static const char * const perm_names[] = {
+    [RONLY_PERMISSION]  = "r",
+    [WONLY_PERMISSION]  = "w",
+    [RW_PERMISSION]     = "rw"
+};
+
+static const char * const mode_names[] = {
+    [FLAT_MODE]         = "flat",
+    [FIFO_MODE]         = "fifo"
+};
+
+/*one configfs directory, the platform device exists while enable is 1*/
+/*the other attributes can be changed only while the device is disabled*/
+struct pseudo_cfg_dev{
+    struct config_item item;
+    struct pseudo_platform_data plf_data;
+    char serial_number[SERIAL_NUMBER_LEN];
+    struct platform_device *plf_dev;
+    int id;
+};
+
 struct pseudo_platform_data pseudo_plf_data[PLF_DEV_COUNT] = 
 {
     [0] = 
     {
         .size           = DEV0_MEM_SIZE,
         .serial_number  = "PLFDEV0000",
-        .permission     = RONLY_PERMISSION
+        .permission     = RONLY_PERMISSION,
+        .numa_node      = PLF_NUMA_ANY
     },
     [1] = 
     {
         .size           = DEV1_MEM_SIZE,
         .serial_number  = "PLFDEV0001",
-        .permission     = RW_PERMISSION
+        .permission     = RW_PERMISSION,
+        .numa_node      = PLF_NUMA_ANY
+    },
+    [2] = 
+    {
+        .size           = DEV2_MEM_SIZE,
+        .serial_number  = "PLFDEV0002",
+        .permission     = RW_PERMISSION,
+        .mode           = FIFO_MODE,
+        .numa_node      = PLF_NUMA_ANY
+    },
+    [3] = 
+    {
+        .size           = DEV3_MEM_SIZE,
+        .serial_number  = "PLFDEV0003",
+        .permission     = RW_PERMISSION,
+        .sparse         = 1,
+        .numa_node      = PLF_NUMA_ANY
+    },
+    [4] = 
+    {
+        .size           = DEV4_MEM_SIZE,
+        .serial_number  = "PLFDEV0004",
+        .permission     = RW_PERMISSION,
+        .compressed     = 1,
+        .numa_node      = PLF_NUMA_ANY
     }
 };
 
+
 struct platform_device pseudo_plf_dev0 = 
 {
     .name = "pseudo-char-dev",
@@ -56,27 +154,582 @@ struct platform_device pseudo_plf_dev1 =
 
 };
 
+struct platform_device pseudo_plf_dev2 = 
+{
+    .name = "pseudo-char-dev",
+    .id   = 2,
+    .dev = 
+    {
+        .platform_data = &pseudo_plf_data[2],
+        .release       = pseudo_dev_release
+    }
+
+};
+
+struct platform_device pseudo_plf_dev3 = 
+{
+    .name = "pseudo-char-dev",
+    .id   = 3,
+    .dev = 
+    {
+        .platform_data = &pseudo_plf_data[3],
+        .release       = pseudo_dev_release
+    }
+
+};
+
+struct platform_device pseudo_plf_dev4 = 
+{
+    .name = "pseudo-char-dev",
+    .id   = 4,
+    .dev = 
+    {
+        .platform_data = &pseudo_plf_data[4],
+        .release       = pseudo_dev_release
+    }
+
+};
+
+struct platform_device *pseudo_plf_devs[PLF_DEV_COUNT] = 
+{
+    &pseudo_plf_dev0,
+    &pseudo_plf_dev1,
+    &pseudo_plf_dev2,
+    &pseudo_plf_dev3,
+    &pseudo_plf_dev4
+};
+
 /********functions implementation*******/
 
+/*bulk devices section*/
+int bulk_devices_add(void)
+{
+    struct pseudo_platform_data plf_data = {0};
+    struct bulk_dev *bulk;
+    unsigned long long size;
+    char *end;
+    int node;
+    int itr;
+    int id;
+    int err;
+
+    size = memparse(bulk_size, &end);
+    if((size == 0) || (*end != '\0') || (bulk_count > MAX_NUMBER_OF_DEVICES - PLF_DEV_COUNT))
+    {
+        pr_err("%s:invalid bulk_size or bulk_count above %d\n", __func__, MAX_NUMBER_OF_DEVICES - PLF_DEV_COUNT);
+        return -EINVAL;
+    }
+
+    if(numa_node_parse(bulk_numa_node, &node) < 0)
+    {
+        pr_err("%s:invalid bulk_numa_node %s\n", __func__, bulk_numa_node);
+        return -EINVAL;
+    }
+
+    plf_data.size          = size;
+    plf_data.serial_number = "PLFDEVBULK";
+    plf_data.permission    = RW_PERMISSION;
+    plf_data.sparse        = bulk_sparse;
+    plf_data.numa_node     = node;
+
+    bulk_devs = kcalloc(bulk_count, sizeof(*bulk_devs), GFP_KERNEL);
+    if(bulk_devs == NULL)
+        return -ENOMEM;
+
+    for(itr=0; itr<bulk_count; itr++)
+    {
+        bulk = kzalloc(sizeof(*bulk), GFP_KERNEL);
+        if(bulk == NULL)
+        {
+            err = -ENOMEM;
+            goto free_devs;
+        }
+
+        id = ida_alloc_range(&plf_dev_ida, PLF_DEV_COUNT, MAX_NUMBER_OF_DEVICES - 1, GFP_KERNEL);
+        if(id < 0)
+        {
+            kfree(bulk);
+            err = id;
+            goto free_devs;
+        }
+
+        /*each device gets its own copy of the platform data*/
+        bulk->plf_data                  = plf_data;
+        bulk->plf_dev.name              = "pseudo-char-dev";
+        bulk->plf_dev.id                = id;
+        bulk->plf_dev.dev.platform_data = &bulk->plf_data;
+        bulk->plf_dev.dev.release       = bulk_dev_release;
+        bulk_devs[itr] = &bulk->plf_dev;
+    }
+
+    err = platform_add_devices(bulk_devs, bulk_count);
+    if(err < 0)
+    {
+        /*platform_add_devices unregistered the devices before the failed one, their release freed them*/
+        /*the failed device is initialized and only its reference is left, the devices after it were   */
+        /*never initialized, so they are freed here directly                                            */
+        for(itr=bulk_count-1; itr>=0; itr--)
+        {
+            if(bulk_devs[itr]->dev.kobj.state_initialized)
+            {
+                put_device(&bulk_devs[itr]->dev);
+                break;
+            }
+            bulk_dev_release(&bulk_devs[itr]->dev);
+        }
+
+        kfree(bulk_devs);
+        bulk_devs = NULL;
+        return err;
+    }
+
+    pr_info("%s:%u bulk devices registered\n", __func__, bulk_count);
+    return 0;
+
+free_devs:
+    /*no device is registered yet, so the release is called directly*/
+    while(itr-- > 0)
+        bulk_dev_release(&bulk_devs[itr]->dev);
+
+    kfree(bulk_devs);
+    bulk_devs = NULL;
+    return err;
+}
+
+void bulk_devices_del(void)
+{
+    int itr;
+
+    if(bulk_devs == NULL)
+        return;
+
+    for(itr=bulk_count-1; itr>=0; itr--)
+        platform_device_unregister(bulk_devs[itr]);
+
+    kfree(bulk_devs);
+    bulk_devs = NULL;
+}
+
+/*called when the last reference of a bulk device is gone, its id is free to use only from here*/
+void bulk_dev_release(struct device* dev)
+{
+    struct bulk_dev *bulk = container_of(to_platform_device(dev), struct bulk_dev, plf_dev);
+
+    ida_free(&plf_dev_ida, bulk->plf_dev.id);
+    kfree(bulk);
+}
+
+/*configfs section*/
+/*example:                                                       */
+/*  mkdir /sys/kernel/config/pseudo_plf/mydev                    */
+/*  echo 64M > /sys/kernel/config/pseudo_plf/mydev/size          */
+/*  echo 1 > /sys/kernel/config/pseudo_plf/mydev/enable          */
+/*the device file is pseudo_char_dev:<id>, id is a read only attribute*/
+/*rmdir unregisters the device if it is still enabled                 */
+
+/*protects the attributes of all directories against enable*/
+static DEFINE_MUTEX(cfg_lock);
+
+static inline struct pseudo_cfg_dev *to_cfg_dev(struct config_item *item)
+{
+    return container_of(item, struct pseudo_cfg_dev, item);
+}
+
+/*index of the name that matches the written value, sysfs_streq ignores the trailing new line*/
+int names_lookup(const char * const *names, int count, const char *page)
+{
+    int itr;
+
+    for(itr=0; itr<count; itr++)
+    {
+        if((names[itr] != NULL) && sysfs_streq(names[itr], page))
+            return itr;
+    }
+
+    return -EINVAL;
+}
+
+/*any, interleave or a node id, the driver checks at probe that the node has memory*/
+int numa_node_parse(const char *page, int *node)
+{
+    if(sysfs_streq(page, "any"))
+        *node = PLF_NUMA_ANY;
+    else if(sysfs_streq(page, "interleave"))
+        *node = PLF_NUMA_INTERLEAVE;
+    else if(kstrtoint(page, 0, node) || (*node < 0))
+        return -EINVAL;
+
+    return 0;
+}
+
+static ssize_t pseudo_cfg_size_show(struct config_item *item, char *page)
+{
+    return sprintf(page, "%zu\n", to_cfg_dev(item)->plf_data.size);
+}
+
+static ssize_t pseudo_cfg_size_store(struct config_item *item, const char *page, size_t len)
+{
+    struct pseudo_cfg_dev *cfg = to_cfg_dev(item);
+    unsigned long long size;
+    ssize_t ret = len;
+    char *end;
+
+    size = memparse(page, &end);
+    if((size == 0) || ((*end != '\0') && (*end != '\n')))
+        return -EINVAL;
+
+    mutex_lock(&cfg_lock);
+    if(cfg->plf_dev != NULL)
+        ret = -EBUSY;
+    else
+        cfg->plf_data.size = size;
+    mutex_unlock(&cfg_lock);
+
+    return ret;
+}
+
+static ssize_t pseudo_cfg_serial_number_show(struct config_item *item, char *page)
+{
+    return sprintf(page, "%s\n", to_cfg_dev(item)->serial_number);
+}
+
+static ssize_t pseudo_cfg_serial_number_store(struct config_item *item, const char *page, size_t len)
+{
+    struct pseudo_cfg_dev *cfg = to_cfg_dev(item);
+    size_t serial_len = strcspn(page, "\n");
+    ssize_t ret = len;
+
+    if((serial_len == 0) || (serial_len >= SERIAL_NUMBER_LEN))
+        return -EINVAL;
+
+    mutex_lock(&cfg_lock);
+    if(cfg->plf_dev != NULL)
+    {
+        ret = -EBUSY;
+    }
+    else
+    {
+        memcpy(cfg->serial_number, page, serial_len);
+        cfg->serial_number[serial_len] = '\0';
+    }
+    mutex_unlock(&cfg_lock);
+
+    return ret;
+}
+
+static ssize_t pseudo_cfg_permission_show(struct config_item *item, char *page)
+{
+    return sprintf(page, "%s\n", perm_names[to_cfg_dev(item)->plf_data.permission]);
+}
+
+static ssize_t pseudo_cfg_permission_store(struct config_item *item, const char *page, size_t len)
+{
+    struct pseudo_cfg_dev *cfg = to_cfg_dev(item);
+    int perm = names_lookup(perm_names, ARRAY_SIZE(perm_names), page);
+    ssize_t ret = len;
+
+    if(perm < 0)
+        return perm;
+
+    mutex_lock(&cfg_lock);
+    if(cfg->plf_dev != NULL)
+        ret = -EBUSY;
+    else
+        cfg->plf_data.permission = perm;
+    mutex_unlock(&cfg_lock);
+
+    return ret;
+}
+
+static ssize_t pseudo_cfg_mode_show(struct config_item *item, char *page)
+{
+    return sprintf(page, "%s\n", mode_names[to_cfg_dev(item)->plf_data.mode]);
+}
+
+static ssize_t pseudo_cfg_mode_store(struct config_item *item, const char *page, size_t len)
+{
+    struct pseudo_cfg_dev *cfg = to_cfg_dev(item);
+    int mode = names_lookup(mode_names, ARRAY_SIZE(mode_names), page);
+    ssize_t ret = len;
+
+    if(mode < 0)
+        return mode;
+
+    mutex_lock(&cfg_lock);
+    if(cfg->plf_dev != NULL)
+        ret = -EBUSY;
+    else
+        cfg->plf_data.mode = mode;
+    mutex_unlock(&cfg_lock);
+
+    return ret;
+}
+
+/*sparse and compressed are boolean platform data fields*/
+#define PSEUDO_CFG_BOOL_ATTR(_name)                                                             \
+static ssize_t pseudo_cfg_##_name##_show(struct config_item *item, char *page)                 \
+{                                                                                               \
+    return sprintf(page, "%d\n", to_cfg_dev(item)->plf_data._name);                            \
+}                                                                                               \
+static ssize_t pseudo_cfg_##_name##_store(struct config_item *item, const char *page, size_t len) \
+{                                                                                               \
+    struct pseudo_cfg_dev *cfg = to_cfg_dev(item);                                              \
+    ssize_t ret = len;                                                                          \
+    bool value;                                                                                 \
+                                                                                                \
+    if(kstrtobool(page, &value))                                                                \
+        return -EINVAL;                                                                         \
+                                                                                                \
+    mutex_lock(&cfg_lock);                                                                      \
+    if(cfg->plf_dev != NULL)                                                                    \
+        ret = -EBUSY;                                                                           \
+    else                                                                                        \
+        cfg->plf_data._name = value;                                                            \
+    mutex_unlock(&cfg_lock);                                                                    \
+                                                                                                \
+    return ret;                                                                                 \
+}
+
+PSEUDO_CFG_BOOL_ATTR(sparse)
+PSEUDO_CFG_BOOL_ATTR(compressed)
+
+static ssize_t pseudo_cfg_numa_node_show(struct config_item *item, char *page)
+{
+    int node = to_cfg_dev(item)->plf_data.numa_node;
+
+    if(node == PLF_NUMA_ANY)
+        return sprintf(page, "any\n");
+
+    if(node == PLF_NUMA_INTERLEAVE)
+        return sprintf(page, "interleave\n");
+
+    return sprintf(page, "%d\n", node);
+}
+
+static ssize_t pseudo_cfg_numa_node_store(struct config_item *item, const char *page, size_t len)
+{
+    struct pseudo_cfg_dev *cfg = to_cfg_dev(item);
+    ssize_t ret = len;
+    int node;
+
+    if(numa_node_parse(page, &node) < 0)
+        return -EINVAL;
+
+    mutex_lock(&cfg_lock);
+    if(cfg->plf_dev != NULL)
+        ret = -EBUSY;
+    else
+        cfg->plf_data.numa_node = node;
+    mutex_unlock(&cfg_lock);
+
+    return ret;
+}
+
+static ssize_t pseudo_cfg_id_show(struct config_item *item, char *page)
+{
+    return sprintf(page, "%d\n", to_cfg_dev(item)->id);
+}
+
+static ssize_t pseudo_cfg_enable_show(struct config_item *item, char *page)
+{
+    return sprintf(page, "%d\n", READ_ONCE(to_cfg_dev(item)->plf_dev) != NULL);
+}
+
+/*the driver probes the device during the registration if it is loaded*/
+static ssize_t pseudo_cfg_enable_store(struct config_item *item, const char *page, size_t len)
+{
+    struct pseudo_cfg_dev *cfg = to_cfg_dev(item);
+    struct platform_device *plf_dev;
+    ssize_t ret = len;
+    bool enable;
+
+    if(kstrtobool(page, &enable))
+        return -EINVAL;
+
+    mutex_lock(&cfg_lock);
+    if(enable && (cfg->plf_dev == NULL))
+    {
+        /*the platform data is copied, the serial number buffer lives until the directory is removed*/
+        cfg->plf_data.serial_number = cfg->serial_number;
+        plf_dev = platform_device_register_data(NULL, "pseudo-char-dev", cfg->id, &cfg->plf_data, sizeof(cfg->plf_data));
+        if(IS_ERR(plf_dev))
+            ret = PTR_ERR(plf_dev);
+        else
+            WRITE_ONCE(cfg->plf_dev, plf_dev);
+    }
+    else if(!enable && (cfg->plf_dev != NULL))
+    {
+        platform_device_unregister(cfg->plf_dev);
+        WRITE_ONCE(cfg->plf_dev, NULL);
+    }
+    mutex_unlock(&cfg_lock);
+
+    return ret;
+}
+
+CONFIGFS_ATTR(pseudo_cfg_, size);
+CONFIGFS_ATTR(pseudo_cfg_, serial_number);
+CONFIGFS_ATTR(pseudo_cfg_, permission);
+CONFIGFS_ATTR(pseudo_cfg_, mode);
+CONFIGFS_ATTR(pseudo_cfg_, sparse);
+CONFIGFS_ATTR(pseudo_cfg_, compressed);
+CONFIGFS_ATTR(pseudo_cfg_, numa_node);
+CONFIGFS_ATTR_RO(pseudo_cfg_, id);
+CONFIGFS_ATTR(pseudo_cfg_, enable);
+
+static struct configfs_attribute *pseudo_cfg_attrs[] = {
+    &pseudo_cfg_attr_size,
+    &pseudo_cfg_attr_serial_number,
+    &pseudo_cfg_attr_permission,
+    &pseudo_cfg_attr_mode,
+    &pseudo_cfg_attr_sparse,
+    &pseudo_cfg_attr_compressed,
+    &pseudo_cfg_attr_numa_node,
+    &pseudo_cfg_attr_id,
+    &pseudo_cfg_attr_enable,
+    NULL
+};
+
+static struct configfs_item_operations pseudo_cfg_item_ops = {
+    .release    = pseudo_cfg_release
+};
+
+static const struct config_item_type pseudo_cfg_item_type = {
+    .ct_item_ops    = &pseudo_cfg_item_ops,
+    .ct_attrs       = pseudo_cfg_attrs,
+    .ct_owner       = THIS_MODULE
+};
+
+static struct configfs_group_operations pseudo_cfg_group_ops = {
+    .make_item  = pseudo_cfg_make_item,
+    .drop_item  = pseudo_cfg_drop_item
+};
+
+static const struct config_item_type pseudo_cfg_group_type = {
+    .ct_group_ops   = &pseudo_cfg_group_ops,
+    .ct_owner       = THIS_MODULE
+};
+
+static struct configfs_subsystem pseudo_cfg_subsys = {
+    .su_group =
+    {
+        .cg_item =
+        {
+            .ci_namebuf = "pseudo_plf",
+            .ci_type    = &pseudo_cfg_group_type
+        }
+    }
+};
+
+/*a new directory is a disabled 4K flat rw device, its serial number is the directory name*/
+struct config_item *pseudo_cfg_make_item(struct config_group *group, const char *name)
+{
+    struct pseudo_cfg_dev *cfg;
+
+    cfg = kzalloc(sizeof(*cfg), GFP_KERNEL);
+    if(cfg == NULL)
+        return ERR_PTR(-ENOMEM);
+
+    cfg->id = ida_alloc_range(&plf_dev_ida, PLF_DEV_COUNT, MAX_NUMBER_OF_DEVICES - 1, GFP_KERNEL);
+    if(cfg->id < 0)
+    {
+        kfree(cfg);
+        return ERR_PTR(-ENOSPC);
+    }
+
+    cfg->plf_data.size       = PAGE_SIZE;
+    cfg->plf_data.permission = RW_PERMISSION;
+    cfg->plf_data.mode       = FLAT_MODE;
+    cfg->plf_data.numa_node  = PLF_NUMA_ANY;
+    strscpy(cfg->serial_number, name, SERIAL_NUMBER_LEN);
+
+    config_item_init_type_name(&cfg->item, name, &pseudo_cfg_item_type);
+    return &cfg->item;
+}
+
+void pseudo_cfg_drop_item(struct config_group *group, struct config_item *item)
+{
+    struct pseudo_cfg_dev *cfg = to_cfg_dev(item);
+
+    mutex_lock(&cfg_lock);
+    if(cfg->plf_dev != NULL)
+    {
+        platform_device_unregister(cfg->plf_dev);
+        cfg->plf_dev = NULL;
+    }
+    mutex_unlock(&cfg_lock);
+
+    config_item_put(item);
+}
+
+void pseudo_cfg_release(struct config_item *item)
+{
+    struct pseudo_cfg_dev *cfg = to_cfg_dev(item);
+
+    ida_free(&plf_dev_ida, cfg->id);
+    kfree(cfg);
+}
+
 static int __init pseudo_plf_dev_init(void)
 {
-    platform_device_register(&pseudo_plf_dev0);
-    platform_device_register(&pseudo_plf_dev1);
+    int itr;
+    int err;
+
+    /*the static devices are registered in one call*/
+    err = platform_add_devices(pseudo_plf_devs, PLF_DEV_COUNT);
+    if(err < 0)
+    {
+        pr_err("%s:static devices registration failed\n", __func__);
+        return err;
+    }
+
+    if(bulk_count > 0)
+    {
+        err = bulk_devices_add();
+        if(err < 0)
+            goto static_del;
+    }
+
+    config_group_init(&pseudo_cfg_subsys.su_group);
+    mutex_init(&pseudo_cfg_subsys.su_mutex);
+    err = configfs_register_subsystem(&pseudo_cfg_subsys);
+    if(err < 0)
+    {
+        pr_err("%s:configfs registration failed\n", __func__);
+        goto bulk_del;
+    }
+
     pr_info("%s:plf setup module loaded successfully\n",__func__);
     return 0;
+
+bulk_del:
+    bulk_devices_del();
+
+static_del:
+    for(itr=PLF_DEV_COUNT-1; itr>=0; itr--)
+        platform_device_unregister(pseudo_plf_devs[itr]);
+
+    return err;
 }
 
 static void __exit pseudo_plf_dev_deinit(void)
 {
-    /*if you have too many devices, you can use  platform_add_devices(struct platform_device **devs, int num)*/
-    platform_device_unregister(&pseudo_plf_dev0);
-    platform_device_unregister(&pseudo_plf_dev1);
+    int itr;
+
+    /*configfs directories hold a module reference, so no configfs device is left here*/
+    configfs_unregister_subsystem(&pseudo_cfg_subsys);
+
+    bulk_devices_del();
+
+    for(itr=PLF_DEV_COUNT-1; itr>=0; itr--)
+        platform_device_unregister(pseudo_plf_devs[itr]);
+
     pr_info("%s:plf setup module unloaded\n",__func__);
 }
 
 void pseudo_dev_release(struct device* dev)
 {
-    pr_info("%s:platform device released\n",__func__);
+    pr_debug("%s:platform device released\n",__func__);
 }
 
 /*module registration*/
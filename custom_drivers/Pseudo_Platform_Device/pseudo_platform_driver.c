@@ -11,14 +11,87 @@
 #include <linux/kdev_t.h>
 #include <linux/uaccess.h>
 #include <linux/platform_device.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/seqlock.h>
+#include <linux/wait.h>
+#include <linux/wait_bit.h>
+#include <linux/poll.h>
+#include <linux/uio.h>
+#include <linux/log2.h>
+#include <linux/ktime.h>
+#include <linux/percpu.h>
+#include <linux/u64_stats_sync.h>
+#include <linux/xarray.h>
+#include <linux/highmem.h>
+#include <linux/string.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
+#include <linux/lz4.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/rcupdate.h>
+#include <linux/bitmap.h>
+#include <linux/list.h>
+#include <linux/idr.h>
+#include <linux/workqueue.h>
+#include <linux/atomic.h>
+#include <linux/nodemask.h>
+#include <linux/spinlock.h>
+#include <linux/hrtimer.h>
+#include <linux/sched/signal.h>
+#include <linux/random.h>
+#include <linux/kref.h>
 #include "platform.h"
+#include "pseudo_plf_ioctl.h"
+#include "pseudo_throttle.h"
+#include "pseudo_fifo.h"
+
+/*tracepoints are created once in the module that owns them*/
+#define CREATE_TRACE_POINTS
+#include "pseudo_plf_trace.h"
+
+/*writers copy user data in chunks of up to this size, each chunk is updated atomically for readers*/
+/*flat devices memory is a set of pages, so a chunk never crosses a page boundary*/
+#define WRITE_CHUNK_SIZE        PAGE_SIZE
+/*a reader falls back to the write lock if writers keep changing the memory under it*/
+#define MAX_READ_RETRIES        8
+
+/*dense devices pages that were not zeroed yet, the zero worker or the first access zeroes them*/
+#define PAGE_UNZEROED           XA_MARK_0
+/*pages that were passed to a pipe, the pipe keeps the page so a write must go to a copy*/
+#define PAGE_SPLICED            XA_MARK_1
+
+/*compressed devices keep this many decompressed chunks, a chunk is cached in slot index % HOT_CHUNKS*/
+#define HOT_CHUNKS              8
+
+/*snapshots of one device, a writer checks all of them when it copies a page*/
+#define MAX_SNAPSHOTS           16
+
+/*the driver reserves the whole minor space of its major, devices and snapshots take minors from it*/
+#define DEV_MINORS_COUNT        (MINORMASK + 1)
+
+/*block device frontend, every cpu submits to its own hardware queue*/
+#define BLK_QUEUE_DEPTH         128
+
+/*burst tolerance of the qos limits of a new device*/
+#define QOS_DEFAULT_BURST_US    1000
+
+/*emulation profile limits, the jitter bound keeps the random part in 32 bits*/
+#define EMU_MAX_LATENCY_US      (10 * USEC_PER_SEC)
+#define EMU_MAX_JITTER_US       USEC_PER_SEC
 
 /*file operations*/
 loff_t pseudo_llseek (struct file *file_ptr, loff_t offset, int whence);
-ssize_t pseudo_read (struct file *file_ptr, char __user *buffer, size_t count, loff_t *f_pos);
-ssize_t pseudo_write (struct file *file_ptr, const char __user *buffer, size_t count, loff_t *f_pos);\
+ssize_t pseudo_read_iter (struct kiocb *iocb, struct iov_iter *to);
+ssize_t pseudo_write_iter (struct kiocb *iocb, struct iov_iter *from);
 int pseudo_open (struct inode *inode_ptr, struct file *file_ptr);
 int pseudo_release (struct inode *inode_ptr, struct file *file_ptr);
+__poll_t pseudo_poll (struct file *file_ptr, struct poll_table_struct *wait);
+ssize_t pseudo_splice_read (struct file *file_ptr, loff_t *ppos, struct pipe_inode_info *pipe, size_t len, unsigned int flags);
+long pseudo_ioctl (struct file *file_ptr, unsigned int cmd, unsigned long arg);
 
 
 int pseudo_plf_probe(struct platform_device *plf_dev);
@@ -26,45 +99,837 @@ int pseudo_plf_remove(struct platform_device *plf_dev);
 
 int check_file_permission(int device_permission, fmode_t mode);
 
+struct dev_priv_data;
+int stats_error_item(long err);
+void stats_account_op(struct dev_priv_data *data_ptr, int op_item, long ret);
+void stats_account_io(struct dev_priv_data *data_ptr, bool is_read, ssize_t ret, size_t count, u64 latency_ns);
+u64 stats_fold_item(struct dev_priv_data *data_ptr, int item);
+ssize_t stats_show_hist(struct device *dev, char *buf, int first_item);
+ssize_t mem_read_iter(struct kiocb *iocb, struct dev_priv_data *data_ptr, struct iov_iter *to);
+ssize_t mem_write_iter(struct kiocb *iocb, struct dev_priv_data *data_ptr, struct iov_iter *from);
+ssize_t copy_mem_to_iter(struct dev_priv_data *data_ptr, struct iov_iter *to, loff_t pos, size_t count, bool nowait);
+ssize_t copy_mem_from_iter(struct dev_priv_data *data_ptr, struct iov_iter *from, loff_t pos, size_t count, bool nowait);
+int storage_init(struct device *dev, struct dev_priv_data *data_ptr);
+void storage_release(struct dev_priv_data *data_ptr);
+struct page *storage_write_page(struct dev_priv_data *data_ptr, pgoff_t index);
+struct page *storage_cow_page(struct dev_priv_data *data_ptr, pgoff_t index, struct page *old);
+struct page *storage_get_page(struct dev_priv_data *data_ptr, pgoff_t index);
+int storage_page_node(struct dev_priv_data *data_ptr, pgoff_t index);
+void storage_zero_page(struct dev_priv_data *data_ptr, pgoff_t index, struct page *page);
+bool storage_page_shared(struct dev_priv_data *data_ptr, pgoff_t index, struct page *page);
+void storage_zero_work(struct work_struct *work);
+void storage_zero_cancel(struct dev_priv_data *data_ptr);
+size_t storage_copy_to_iter(struct dev_priv_data *data_ptr, loff_t pos, size_t count, struct iov_iter *to);
+loff_t storage_seek_data(struct dev_priv_data *data_ptr, loff_t pos);
+int comp_init(struct device *dev, struct dev_priv_data *data_ptr);
+void comp_free(struct dev_priv_data *data_ptr);
+struct hot_chunk *comp_hot_chunk_lock(struct dev_priv_data *data_ptr, pgoff_t index, bool nowait);
+int comp_chunk_load(struct dev_priv_data *data_ptr, pgoff_t index, char *buffer);
+int comp_chunk_store(struct dev_priv_data *data_ptr, pgoff_t index, const char *buffer);
+ssize_t comp_copy_to_iter(struct dev_priv_data *data_ptr, struct iov_iter *to, loff_t pos, size_t count, bool nowait);
+int comp_write_chunk(struct dev_priv_data *data_ptr, pgoff_t index, size_t offset, const char *src, size_t len, bool nowait);
+loff_t storage_seek_hole(struct dev_priv_data *data_ptr, loff_t pos);
+unsigned long storage_next_hole(struct xarray *pages, unsigned long index, unsigned long last);
+blk_status_t pseudo_blk_queue_rq(struct blk_mq_hw_ctx *hctx, const struct blk_mq_queue_data *bd);
+int blk_dev_create(struct dev_priv_data *data_ptr, int id);
+void blk_dev_destroy(struct dev_priv_data *data_ptr);
+struct pseudo_snapshot;
+long snapshot_create(struct file *file_ptr, struct dev_priv_data *data_ptr, struct pseudo_plf_snapshot __user *user_snap);
+int snapshot_delete(struct dev_priv_data *data_ptr, u32 id);
+void snapshot_delete_all(struct dev_priv_data *data_ptr);
+void snapshot_destroy(struct pseudo_snapshot *snap);
+void snapshot_release(struct device *dev);
+int minor_alloc(struct device *dev, dev_t *dev_num);
+void minor_release(void *data);
+struct qos_state;
+struct dev_priv_data *pseudo_file_data(struct file *file_ptr);
+void data_get(struct dev_priv_data *data_ptr);
+struct dev_priv_data *data_lookup(int minor);
+void data_put(struct dev_priv_data *data_ptr);
+void data_release(struct kref *ref);
+void data_free(struct dev_priv_data *data_ptr);
+u64 qos_start(struct qos_state *qos, u64 bps, u64 iops, u64 earliest, u64 burst_ns);
+void qos_charge(struct qos_state *qos, u64 bps, u64 iops, size_t count, u64 start);
+int qos_throttle(struct file *file_ptr, struct dev_priv_data *data_ptr, size_t count, bool nowait);
+struct pseudo_file;
+struct qos_class;
+void qos_file_sync(struct pseudo_file *pfile, struct qos_class *class);
+int qos_set_class(struct file *file_ptr, u32 class);
+void stats_account_throttle(struct dev_priv_data *data_ptr, u64 wait_ns);
+bool emu_enabled(struct dev_priv_data *data_ptr);
+bool emu_slot_try(struct dev_priv_data *data_ptr, unsigned int depth);
+int emu_slot_get(struct dev_priv_data *data_ptr, bool nowait, bool *emu);
+void emu_slot_put(struct dev_priv_data *data_ptr);
+u64 emu_done_time(struct dev_priv_data *data_ptr, size_t bytes, u64 now);
+ssize_t emu_complete(struct kiocb *iocb, struct dev_priv_data *data_ptr, ssize_t ret, u64 done_ns);
+enum hrtimer_restart emu_timer_fn(struct hrtimer *timer);
+
+
+/*per cpu statistics, every cpu updates its own copy without atomics and the copies are folded when read*/
+/*latency histograms are log2 buckets, bucket n counts operations that took [2^n, 2^(n+1)) ns*/
+#define LAT_HIST_BUCKETS        32
+
+enum dev_stat_item
+{
+    STAT_READS,
+    STAT_WRITES,
+    STAT_LLSEEKS,
+    STAT_BYTES_READ,
+    STAT_BYTES_WRITTEN,
+    STAT_SHORT_READS,
+    STAT_SHORT_WRITES,
+    STAT_EFAULT,
+    STAT_ENOMEM,
+    STAT_EINVAL,
+    STAT_OPENS,
+    /*time spent in read and write calls, the throughput files divide the bytes by it*/
+    STAT_READ_NS,
+    STAT_WRITE_NS,
+    /*compressed devices only, reads and writes that found their chunk decompressed*/
+    STAT_CACHE_HITS,
+    STAT_CACHE_MISSES,
+    /*reads and writes that waited for their qos limits, and the time they waited*/
+    STAT_THROTTLED,
+    STAT_THROTTLE_NS,
+    STAT_READ_LAT_HIST,
+    STAT_WRITE_LAT_HIST = STAT_READ_LAT_HIST + LAT_HIST_BUCKETS,
+    STAT_ITEMS_COUNT    = STAT_WRITE_LAT_HIST + LAT_HIST_BUCKETS
+};
+
+struct dev_stats
+{
+    u64 items[STAT_ITEMS_COUNT];
+    /*lets readers get consistent 64 bit values on 32 bit machines, it is empty on 64 bit machines*/
+    struct u64_stats_sync syncp;
+};
+
+/*compressed devices chunk, raw chunks are stored with len PAGE_SIZE when lz4 can not make the page smaller*/
+struct comp_chunk
+{
+    unsigned int len;
+    u8 data[];
+};
+
+/*decompressed copy of one chunk, the lock also serializes readers and writers of the chunks that map to it*/
+struct hot_chunk
+{
+    struct mutex lock;
+    pgoff_t index;
+    bool valid;
+    char *buffer;
+};
+
+/*qos limits state of a device or an open file, the theoretical arrival time of the GCRA of each limit*/
+/*a tat is the time in ns at which the limit is back to idle after all the requests it accepted        */
+struct qos_state
+{
+    spinlock_t lock;
+    u64 bytes_tat;
+    u64 ios_tat;
+};
+
+/*per file limits of a qos class, every open file of the class gets them for itself*/
+/*gen changes with every limit change, a file of the class restarts its state then */
+struct qos_class
+{
+    u64 file_bps;
+    u64 file_iops;
+    unsigned int gen;
+};
 
 /*device private data*/
+/*the data is freed by the last of the platform device, the open files and the emulated requests*/
+/*that hold a reference, so a device removed while it is in use stays valid for its users      */
 struct dev_priv_data
 {
+        struct kref ref;
+        /*fifo devices memory, the ring is one contiguous buffer*/
         char*  data_buffer;
+        /*flat devices memory, one page per entry indexed by the page number in the device*/
+        /*xa_load is lockless, so readers look up pages without taking any lock          */
+        /*pages are added by writers, a page shared with a snapshot or a pipe is replaced*/
+        /*by a copy before it is written, readers hold a page reference while they copy  */
+        /*the page private is the snap_gen of the device when the page was written       */
+        /*compressed devices keep a struct comp_chunk per entry instead of a page        */
+        struct xarray pages;
+        /*number of pages in the xarray, updated under write_lock*/
+        unsigned long nr_pages;
+        /*dense devices pages are zeroed after the probe by zero_work, zero_lock serializes*/
+        /*the worker with the readers and writers that zero a page before they use it     */
+        struct work_struct zero_work;
+        struct mutex zero_lock;
+        /*compressed devices state, the chunks are accessed only under their hot chunk lock*/
+        /*the lz4 work memory and output buffer are used by the writer that holds write_lock*/
+        struct hot_chunk *hot_chunks;
+        void *lz4_wrkmem;
+        char *lz4_buffer;
+        /*bytes used by the compressed chunks, updated under write_lock*/
+        unsigned long compressed_bytes;
         struct pseudo_platform_data plf_data;
         dev_t  dev_num;
-        struct cdev dev_cdev;
+        /*writers are serialized by write_lock, readers dont take any lock*/
+        /*they copy the memory and retry if mem_seq shows that a writer changed it meanwhile*/
+        struct mutex write_lock;
+        seqcount_mutex_t mem_seq;
+        /*copy_from_user can sleep so it can not run inside the write section, user data is copied here first*/
+        char*  bounce_buffer;
+        /*fifo mode state, the fifo helpers are shared with the other driver, see pseudo_fifo.h*/
+        /*readers and writers have separate locks, so a producer and a consumer never wait for each other*/
+        struct pseudo_fifo fifo;
+        struct mutex read_lock;
+        wait_queue_head_t read_queue;
+        wait_queue_head_t write_queue;
+        /*per cpu statistics, exported in the stats directory of the device in sysfs*/
+        struct dev_stats __percpu *stats;
+        /*qos limits set in the qos directory of the device in sysfs, 0 means no limit*/
+        /*the device limits are shared by all its files, the file limits of a class apply to*/
+        /*each open file of the class, a file is in class 0 until it picks another by ioctl  */
+        u64 qos_bps;
+        u64 qos_iops;
+        struct qos_class qos_classes[PSEUDO_PLF_QOS_CLASSES];
+        /*an idle limit lets this much time of requests through without waiting*/
+        u64 qos_burst_us;
+        struct qos_state qos;
+        /*emulation profile set in the emulation directory of the device in sysfs, all 0 turns it off*/
+        /*a request is transferred on a link of emu_bandwidth bytes/s and completes latency_us +-    */
+        /*jitter_us after its transfer, with at most emu_queue_depth requests in flight (0: no limit) */
+        u64 emu_latency_us;
+        u64 emu_jitter_us;
+        u64 emu_bandwidth;
+        u64 emu_queue_depth;
+        /*the time the emulated link is free again, under emu_lock*/
+        u64 emu_link_free;
+        spinlock_t emu_lock;
+        /*requests between their queue slot and their completion*/
+        atomic_t emu_inflight;
+        wait_queue_head_t emu_queue;
+        /*open files hold the cdev, so it is allocated apart from the data and freed by its last user*/
+        struct cdev *cdev;
         struct device *dev_ptr;
+        /*block device over the same memory, NULL for fifo and write only devices*/
+        struct blk_mq_tag_set tag_set;
+        struct gendisk *disk;
+        /*snapshots of this device in creation order, they stay here until they are freed*/
+        /*changed under drv_data.snap_lock and write_lock, so either lock protects a walk */
+        struct list_head snapshots;
+        struct ida snap_ida;
+        /*incremented by every snapshot, a snapshot shares the pages of older generations*/
+        /*a snapshot keeps its own generation here and holds the data of its origin device*/
+        unsigned long snap_gen;
+        struct dev_priv_data *origin;
+        /*snapshots are read only devices, they can not be snapshotted again*/
+        bool snapshot;
+        /*platform device id, it names the device files, the minor is allocated separately*/
+        int id;
+};
+
+/*emulated request that completes from its timer, the data was already copied when it was queued*/
+/*the request holds a reference on the device data, so a device removed meanwhile stays valid  */
+/*until the timer has completed it                                                              */
+struct emu_request
+{
+    struct hrtimer timer;
+    struct kiocb *iocb;
+    struct dev_priv_data *data_ptr;
+    long ret;
+};
+
+/*open file private data, the device and the qos state of the file*/
+/*the class and the gen of its limits that the state follows are under the qos lock*/
+struct pseudo_file
+{
+    struct dev_priv_data *data;
+    struct qos_state qos;
+    unsigned int qos_class;
+    unsigned int qos_gen;
+};
+
+/*snapshot device, the device struct lives while a snapshot file is open and its release frees the snapshot*/
+struct pseudo_snapshot
+{
+    struct dev_priv_data data;
+    struct device dev;
+    /*the cdev holds the device, see cdev_device_add*/
+    struct cdev cdev;
+    struct list_head node;
+    /*a deleted snapshot stays in the origin list while its files are open*/
+    bool deleted;
+    int id;
+    /*-1 until the minor is allocated*/
+    int minor;
 };
 
 /*driver private data*/
 struct drv_priv_data
 {
-    int devices_count;
+    /*devices are probed in parallel*/
+    atomic_t devices_count;
     dev_t dev_num_base;
+    int blk_major;
     struct class *dev_class;
-    struct dev_priv_data *devs_data;
+    /*minors of the devices and snapshots, a removed device returns its minor for reuse*/
+    struct ida minor_ida;
+    /*devices and snapshots data indexed by minor, open looks the device up here*/
+    struct xarray devs;
+    /*protects the snapshot lists, writers walk them under the write lock of their device*/
+    struct mutex snap_lock;
 };
 
 struct drv_priv_data drv_data;
 
+/*every block device has its own tag set with per cpu queues, that is most of a device memory*/
+/*example: insmod pseudo_platform_driver.ko blk_devices=0                                    */
+static bool blk_devices = true;
+module_param(blk_devices, bool, 0444);
+MODULE_PARM_DESC(blk_devices, "create a block device for every flat readable device");
+
+/*the load time benchmark compares the probe modes with these two parameters*/
+static bool sync_probe;
+module_param(sync_probe, bool, 0444);
+MODULE_PARM_DESC(sync_probe, "probe the devices one by one in the driver registration");
+
+static bool defer_zeroing = true;
+module_param(defer_zeroing, bool, 0444);
+MODULE_PARM_DESC(defer_zeroing, "zero the dense devices memory in a worker after the probe");
+
 /*file_operations struct*/
 struct file_operations pseudo_fops = {
-    .open       = pseudo_open,
-    .release    = pseudo_release,
-    .read       = pseudo_read,
-    .write      = pseudo_write,
-    .llseek     = pseudo_llseek,
+    .open           = pseudo_open,
+    .release        = pseudo_release,
+    .read_iter      = pseudo_read_iter,
+    .write_iter     = pseudo_write_iter,
+    .llseek         = pseudo_llseek,
+    .poll           = pseudo_poll,
+    .splice_read    = pseudo_splice_read,
+    /*pipe pages are copied in through write_iter, they are not stolen into the device memory*/
+    .splice_write   = iter_file_splice_write,
+    .unlocked_ioctl = pseudo_ioctl,
+    .compat_ioctl   = compat_ptr_ioctl,
+    .owner          = THIS_MODULE
+};
+
+/*spliced device pages are shared with the pipe, they can not be stolen by the pipe reader*/
+static const struct pipe_buf_operations pseudo_pipe_buf_ops = {
+    .release    = generic_pipe_buf_release,
+    .get        = generic_pipe_buf_get
+};
+
+/*block device operations, the requests are handled by the tag set queue_rq*/
+struct block_device_operations pseudo_blk_fops = {
     .owner      = THIS_MODULE
 };
 
+struct blk_mq_ops pseudo_blk_mq_ops = {
+    .queue_rq   = pseudo_blk_queue_rq
+};
+
 struct platform_driver pseudo_plf_drv ={
     .probe  = pseudo_plf_probe,
     .remove = pseudo_plf_remove,
     .driver =
     {
-        .name = "pseudo-char-dev"
+        .name       = "pseudo-char-dev",
+        /*every probe allocates the device memory, so the devices are probed in parallel*/
+        .probe_type = PROBE_PREFER_ASYNCHRONOUS
+    }
+};
+
+/*statistics section*/
+int stats_error_item(long err)
+{
+    switch(err)
+    {
+        case -EFAULT:
+            return STAT_EFAULT;
+        case -ENOMEM:
+            return STAT_ENOMEM;
+        case -EINVAL:
+            return STAT_EINVAL;
+        default:
+            return -1;
+    }
+}
+
+void stats_account_op(struct dev_priv_data *data_ptr, int op_item, long ret)
+{
+    struct dev_stats *stats;
+    int err_item = stats_error_item(ret);
+
+    /*get_cpu_ptr disables preemption, so this cpu copy has only one writer*/
+    stats = get_cpu_ptr(data_ptr->stats);
+    u64_stats_update_begin(&stats->syncp);
+
+    stats->items[op_item]++;
+    if(err_item >= 0)
+        stats->items[err_item]++;
+
+    u64_stats_update_end(&stats->syncp);
+    put_cpu_ptr(data_ptr->stats);
+}
+
+void stats_account_io(struct dev_priv_data *data_ptr, bool is_read, ssize_t ret, size_t count, u64 latency_ns)
+{
+    struct dev_stats *stats;
+    int err_item = stats_error_item(ret);
+    int bucket = 0;
+
+    if(latency_ns > 0)
+        bucket = min_t(int, ilog2(latency_ns), LAT_HIST_BUCKETS - 1);
+
+    /*get_cpu_ptr disables preemption, so this cpu copy has only one writer*/
+    stats = get_cpu_ptr(data_ptr->stats);
+    u64_stats_update_begin(&stats->syncp);
+
+    if(is_read)
+    {
+        stats->items[STAT_READS]++;
+        stats->items[STAT_READ_NS] += latency_ns;
+        stats->items[STAT_READ_LAT_HIST + bucket]++;
+        if(ret >= 0)
+        {
+            stats->items[STAT_BYTES_READ] += ret;
+            if((size_t)ret < count)
+                stats->items[STAT_SHORT_READS]++;
+        }
+    }
+    else
+    {
+        stats->items[STAT_WRITES]++;
+        stats->items[STAT_WRITE_NS] += latency_ns;
+        stats->items[STAT_WRITE_LAT_HIST + bucket]++;
+        if(ret >= 0)
+        {
+            stats->items[STAT_BYTES_WRITTEN] += ret;
+            if((size_t)ret < count)
+                stats->items[STAT_SHORT_WRITES]++;
+        }
+    }
+
+    if(err_item >= 0)
+        stats->items[err_item]++;
+
+    u64_stats_update_end(&stats->syncp);
+    put_cpu_ptr(data_ptr->stats);
+}
+
+void stats_account_throttle(struct dev_priv_data *data_ptr, u64 wait_ns)
+{
+    struct dev_stats *stats;
+
+    stats = get_cpu_ptr(data_ptr->stats);
+    u64_stats_update_begin(&stats->syncp);
+
+    stats->items[STAT_THROTTLED]++;
+    stats->items[STAT_THROTTLE_NS] += wait_ns;
+
+    u64_stats_update_end(&stats->syncp);
+    put_cpu_ptr(data_ptr->stats);
+}
+
+u64 stats_fold_item(struct dev_priv_data *data_ptr, int item)
+{
+    struct dev_stats *stats;
+    unsigned int start;
+    u64 total = 0;
+    u64 value;
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+    {
+        stats = per_cpu_ptr(data_ptr->stats, cpu);
+        do
+        {
+            start = u64_stats_fetch_begin(&stats->syncp);
+            value = stats->items[item];
+        } while(u64_stats_fetch_retry(&stats->syncp, start));
+
+        total += value;
+    }
+
+    return total;
+}
+
+/*sysfs interface, the files are in the stats directory of every device*/
+#define DEV_STAT_ATTR(_name, _item)                                                             \
+static ssize_t _name##_show(struct device *dev, struct device_attribute *attr, char *buf)       \
+{                                                                                               \
+    return sysfs_emit(buf, "%llu\n", stats_fold_item(dev_get_drvdata(dev), _item));            \
+}                                                                                               \
+static DEVICE_ATTR_RO(_name)
+
+DEV_STAT_ATTR(reads, STAT_READS);
+DEV_STAT_ATTR(writes, STAT_WRITES);
+DEV_STAT_ATTR(llseeks, STAT_LLSEEKS);
+DEV_STAT_ATTR(bytes_read, STAT_BYTES_READ);
+DEV_STAT_ATTR(bytes_written, STAT_BYTES_WRITTEN);
+DEV_STAT_ATTR(short_reads, STAT_SHORT_READS);
+DEV_STAT_ATTR(short_writes, STAT_SHORT_WRITES);
+DEV_STAT_ATTR(efault, STAT_EFAULT);
+DEV_STAT_ATTR(enomem, STAT_ENOMEM);
+DEV_STAT_ATTR(einval, STAT_EINVAL);
+DEV_STAT_ATTR(opens, STAT_OPENS);
+DEV_STAT_ATTR(cache_hits, STAT_CACHE_HITS);
+DEV_STAT_ATTR(cache_misses, STAT_CACHE_MISSES);
+DEV_STAT_ATTR(throttled, STAT_THROTTLED);
+DEV_STAT_ATTR(throttle_ns, STAT_THROTTLE_NS);
+
+/*throughput files print bytes per second of time spent inside the read or write calls*/
+#define DEV_THROUGHPUT_ATTR(_name, _bytes_item, _ns_item)                                       \
+static ssize_t _name##_show(struct device *dev, struct device_attribute *attr, char *buf)       \
+{                                                                                               \
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);                                      \
+    u64 bytes = stats_fold_item(data_ptr, _bytes_item);                                         \
+    u64 ns = stats_fold_item(data_ptr, _ns_item);                                               \
+                                                                                                \
+    if(ns == 0)                                                                                 \
+        return sysfs_emit(buf, "0\n");                                                          \
+    return sysfs_emit(buf, "%llu\n", mul_u64_u64_div_u64(bytes, NSEC_PER_SEC, ns));             \
+}                                                                                               \
+static DEVICE_ATTR_RO(_name)
+
+DEV_THROUGHPUT_ATTR(read_throughput, STAT_BYTES_READ, STAT_READ_NS);
+DEV_THROUGHPUT_ATTR(write_throughput, STAT_BYTES_WRITTEN, STAT_WRITE_NS);
+
+/*bytes used by the stored chunks, and the stored data size over it with two decimals*/
+static ssize_t compressed_bytes_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%lu\n", READ_ONCE(data_ptr->compressed_bytes));
+}
+static DEVICE_ATTR_RO(compressed_bytes);
+
+static ssize_t compression_ratio_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+    u64 compressed = READ_ONCE(data_ptr->compressed_bytes);
+    u64 ratio;
+
+    if(compressed == 0)
+        return sysfs_emit(buf, "0.00\n");
+
+    ratio = div64_u64((u64)READ_ONCE(data_ptr->nr_pages) * PAGE_SIZE * 100, compressed);
+    return sysfs_emit(buf, "%llu.%02llu\n", ratio / 100, ratio % 100);
+}
+static DEVICE_ATTR_RO(compression_ratio);
+
+/*histogram files print one count per log2 bucket, starting with the [1, 2) ns bucket*/
+ssize_t stats_show_hist(struct device *dev, char *buf, int first_item)
+{
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+    ssize_t len = 0;
+    int bucket;
+
+    for(bucket=0; bucket<LAT_HIST_BUCKETS; bucket++)
+        len += sysfs_emit_at(buf, len, "%llu%c", stats_fold_item(data_ptr, first_item + bucket),
+                             (bucket == LAT_HIST_BUCKETS - 1) ? '\n' : ' ');
+
+    return len;
+}
+
+static ssize_t read_latency_hist_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    return stats_show_hist(dev, buf, STAT_READ_LAT_HIST);
+}
+static DEVICE_ATTR_RO(read_latency_hist);
+
+static ssize_t write_latency_hist_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    return stats_show_hist(dev, buf, STAT_WRITE_LAT_HIST);
+}
+static DEVICE_ATTR_RO(write_latency_hist);
+
+static struct attribute *dev_stats_attrs[] = {
+    &dev_attr_reads.attr,
+    &dev_attr_writes.attr,
+    &dev_attr_llseeks.attr,
+    &dev_attr_bytes_read.attr,
+    &dev_attr_bytes_written.attr,
+    &dev_attr_short_reads.attr,
+    &dev_attr_short_writes.attr,
+    &dev_attr_efault.attr,
+    &dev_attr_enomem.attr,
+    &dev_attr_einval.attr,
+    &dev_attr_opens.attr,
+    &dev_attr_read_throughput.attr,
+    &dev_attr_write_throughput.attr,
+    &dev_attr_cache_hits.attr,
+    &dev_attr_cache_misses.attr,
+    &dev_attr_throttled.attr,
+    &dev_attr_throttle_ns.attr,
+    &dev_attr_compressed_bytes.attr,
+    &dev_attr_compression_ratio.attr,
+    &dev_attr_read_latency_hist.attr,
+    &dev_attr_write_latency_hist.attr,
+    NULL
+};
+
+static const struct attribute_group dev_stats_group = {
+    .name  = "stats",
+    .attrs = dev_stats_attrs,
+};
+
+/*device memory usage, read only files in the device directory*/
+static ssize_t size_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%zu\n", data_ptr->plf_data.size);
+}
+static DEVICE_ATTR_RO(size);
+
+static ssize_t sparse_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%d\n", data_ptr->plf_data.sparse);
+}
+static DEVICE_ATTR_RO(sparse);
+
+static ssize_t compressed_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%d\n", data_ptr->plf_data.compressed);
+}
+static DEVICE_ATTR_RO(compressed);
+
+/*bytes of memory allocated for the device pages, or for the chunks and the hot chunks of compressed devices*/
+static ssize_t mem_used_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+
+    if(data_ptr->plf_data.mode == FIFO_MODE)
+        return sysfs_emit(buf, "%zu\n", data_ptr->plf_data.size);
+
+    if(data_ptr->plf_data.compressed)
+        return sysfs_emit(buf, "%lu\n", READ_ONCE(data_ptr->compressed_bytes) + HOT_CHUNKS * PAGE_SIZE);
+
+    return sysfs_emit(buf, "%lu\n", READ_ONCE(data_ptr->nr_pages) << PAGE_SHIFT);
+}
+static DEVICE_ATTR_RO(mem_used);
+
+static ssize_t numa_node_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+
+    if(data_ptr->plf_data.numa_node == PLF_NUMA_ANY)
+        return sysfs_emit(buf, "any\n");
+
+    if(data_ptr->plf_data.numa_node == PLF_NUMA_INTERLEAVE)
+        return sysfs_emit(buf, "interleave\n");
+
+    return sysfs_emit(buf, "%d\n", data_ptr->plf_data.numa_node);
+}
+static DEVICE_ATTR_RO(numa_node);
+
+/*where the memory really is, the allocations fall back to other nodes when the node is full*/
+/*one N<node>=<pages> item per memory node, compressed devices count their chunks instead*/
+static ssize_t numa_pages_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+    unsigned long *counts;
+    unsigned long index;
+    struct page *page;
+    void *entry;
+    ssize_t len = 0;
+    int node;
+
+    counts = kcalloc(nr_node_ids, sizeof(*counts), GFP_KERNEL);
+    if(counts == NULL)
+        return -ENOMEM;
+
+    if(data_ptr->plf_data.mode == FIFO_MODE)
+    {
+        counts[page_to_nid(virt_to_page(data_ptr->data_buffer))] = DIV_ROUND_UP(data_ptr->plf_data.size, PAGE_SIZE);
     }
+    else
+    {
+        /*only the page location is read, so an entry that a writer replaces meanwhile does no harm*/
+        xa_for_each(&data_ptr->pages, index, entry)
+        {
+            page = data_ptr->plf_data.compressed ? virt_to_page(entry) : entry;
+            counts[page_to_nid(page)]++;
+            cond_resched();
+        }
+    }
+
+    for_each_node_state(node, N_MEMORY)
+        len += sysfs_emit_at(buf, len, "%sN%d=%lu", (len == 0) ? "" : " ", node, counts[node]);
+    len += sysfs_emit_at(buf, len, "\n");
+
+    kfree(counts);
+    return len;
+}
+static DEVICE_ATTR_RO(numa_pages);
+
+static struct attribute *dev_config_attrs[] = {
+    &dev_attr_size.attr,
+    &dev_attr_sparse.attr,
+    &dev_attr_compressed.attr,
+    &dev_attr_mem_used.attr,
+    &dev_attr_numa_node.attr,
+    &dev_attr_numa_pages.attr,
+    NULL
+};
+
+static const struct attribute_group dev_config_group = {
+    .attrs = dev_config_attrs,
+};
+
+/*qos limits, writable files in the qos directory of every device*/
+/*a new device limit restarts the device state, the requests already waiting keep their time*/
+#define DEV_QOS_ATTR(_name, _field)                                                             \
+static ssize_t _name##_show(struct device *dev, struct device_attribute *attr, char *buf)       \
+{                                                                                               \
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);                                      \
+                                                                                                \
+    return sysfs_emit(buf, "%llu\n", READ_ONCE(data_ptr->_field));                              \
+}                                                                                               \
+static ssize_t _name##_store(struct device *dev, struct device_attribute *attr,                 \
+                             const char *buf, size_t count)                                     \
+{                                                                                               \
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);                                      \
+    u64 value;                                                                                  \
+    int err;                                                                                    \
+                                                                                                \
+    err = kstrtou64(buf, 0, &value);                                                            \
+    if(err < 0)                                                                                 \
+        return err;                                                                             \
+                                                                                                \
+    spin_lock(&data_ptr->qos.lock);                                                             \
+    WRITE_ONCE(data_ptr->_field, value);                                                        \
+    data_ptr->qos.bytes_tat = 0;                                                                \
+    data_ptr->qos.ios_tat = 0;                                                                  \
+    spin_unlock(&data_ptr->qos.lock);                                                           \
+    return count;                                                                               \
+}                                                                                               \
+static DEVICE_ATTR_RW(_name)
+
+DEV_QOS_ATTR(bytes_per_sec, qos_bps);
+DEV_QOS_ATTR(iops, qos_iops);
+DEV_QOS_ATTR(burst_us, qos_burst_us);
+
+/*per file limits of the qos classes, class 0 keeps the names it had before the classes*/
+/*a new class limit leaves the device state alone, the files of the class restart their*/
+/*own state on their next request                                                         */
+#define DEV_QOS_CLASS_ATTR(_name, _class, _field)                                               \
+static ssize_t _name##_show(struct device *dev, struct device_attribute *attr, char *buf)       \
+{                                                                                               \
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);                                      \
+                                                                                                \
+    return sysfs_emit(buf, "%llu\n", READ_ONCE(data_ptr->qos_classes[_class]._field));          \
+}                                                                                               \
+static ssize_t _name##_store(struct device *dev, struct device_attribute *attr,                 \
+                             const char *buf, size_t count)                                     \
+{                                                                                               \
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);                                      \
+    struct qos_class *class = &data_ptr->qos_classes[_class];                                   \
+    u64 value;                                                                                  \
+    int err;                                                                                    \
+                                                                                                \
+    err = kstrtou64(buf, 0, &value);                                                            \
+    if(err < 0)                                                                                 \
+        return err;                                                                             \
+                                                                                                \
+    /*the device lock only serializes the writers of the class limits*/                        \
+    spin_lock(&data_ptr->qos.lock);                                                             \
+    WRITE_ONCE(class->_field, value);                                                           \
+    WRITE_ONCE(class->gen, class->gen + 1);                                                     \
+    spin_unlock(&data_ptr->qos.lock);                                                           \
+    return count;                                                                               \
+}                                                                                               \
+static DEVICE_ATTR_RW(_name)
+
+DEV_QOS_CLASS_ATTR(file_bytes_per_sec, 0, file_bps);
+DEV_QOS_CLASS_ATTR(file_iops, 0, file_iops);
+DEV_QOS_CLASS_ATTR(class1_file_bytes_per_sec, 1, file_bps);
+DEV_QOS_CLASS_ATTR(class1_file_iops, 1, file_iops);
+DEV_QOS_CLASS_ATTR(class2_file_bytes_per_sec, 2, file_bps);
+DEV_QOS_CLASS_ATTR(class2_file_iops, 2, file_iops);
+DEV_QOS_CLASS_ATTR(class3_file_bytes_per_sec, 3, file_bps);
+DEV_QOS_CLASS_ATTR(class3_file_iops, 3, file_iops);
+
+static struct attribute *dev_qos_attrs[] = {
+    &dev_attr_bytes_per_sec.attr,
+    &dev_attr_iops.attr,
+    &dev_attr_burst_us.attr,
+    &dev_attr_file_bytes_per_sec.attr,
+    &dev_attr_file_iops.attr,
+    &dev_attr_class1_file_bytes_per_sec.attr,
+    &dev_attr_class1_file_iops.attr,
+    &dev_attr_class2_file_bytes_per_sec.attr,
+    &dev_attr_class2_file_iops.attr,
+    &dev_attr_class3_file_bytes_per_sec.attr,
+    &dev_attr_class3_file_iops.attr,
+    NULL
+};
+
+static const struct attribute_group dev_qos_group = {
+    .name  = "qos",
+    .attrs = dev_qos_attrs,
+};
+
+/*emulation profile, writable files in the emulation directory of every device*/
+/*a new profile applies to the requests that start after the change*/
+#define DEV_EMU_ATTR(_name, _field, _max)                                                       \
+static ssize_t _name##_show(struct device *dev, struct device_attribute *attr, char *buf)       \
+{                                                                                               \
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);                                      \
+                                                                                                \
+    return sysfs_emit(buf, "%llu\n", READ_ONCE(data_ptr->_field));                              \
+}                                                                                               \
+static ssize_t _name##_store(struct device *dev, struct device_attribute *attr,                 \
+                             const char *buf, size_t count)                                     \
+{                                                                                               \
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);                                      \
+    u64 value;                                                                                  \
+    int err;                                                                                    \
+                                                                                                \
+    err = kstrtou64(buf, 0, &value);                                                            \
+    if(err < 0)                                                                                 \
+        return err;                                                                             \
+    if(value > (_max))                                                                          \
+        return -EINVAL;                                                                         \
+                                                                                                \
+    WRITE_ONCE(data_ptr->_field, value);                                                        \
+    return count;                                                                               \
+}                                                                                               \
+static DEVICE_ATTR_RW(_name)
+
+DEV_EMU_ATTR(latency_us, emu_latency_us, EMU_MAX_LATENCY_US);
+DEV_EMU_ATTR(jitter_us, emu_jitter_us, EMU_MAX_JITTER_US);
+DEV_EMU_ATTR(bandwidth, emu_bandwidth, U64_MAX);
+DEV_EMU_ATTR(queue_depth, emu_queue_depth, INT_MAX);
+
+static ssize_t inflight_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct dev_priv_data *data_ptr = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%d\n", atomic_read(&data_ptr->emu_inflight));
+}
+static DEVICE_ATTR_RO(inflight);
+
+static struct attribute *dev_emu_attrs[] = {
+    &dev_attr_latency_us.attr,
+    &dev_attr_jitter_us.attr,
+    &dev_attr_bandwidth.attr,
+    &dev_attr_queue_depth.attr,
+    &dev_attr_inflight.attr,
+    NULL
+};
+
+static const struct attribute_group dev_emu_group = {
+    .name  = "emulation",
+    .attrs = dev_emu_attrs,
+};
+
+static const struct attribute_group *dev_attr_groups[] = {
+    &dev_config_group,
+    &dev_stats_group,
+    &dev_qos_group,
+    &dev_emu_group,
+    NULL
 };
 
 /*code section*/
@@ -72,12 +937,15 @@ static int __init pseudo_plf_drv_init(void)
 {
     int err;
     /*intitalize devices count to zero*/
-    drv_data.devices_count =0;
+    atomic_set(&drv_data.devices_count, 0);
+    ida_init(&drv_data.minor_ida);
+    xa_init(&drv_data.devs);
+    mutex_init(&drv_data.snap_lock);
 
     pr_info("%s:start module intialization \n", __func__);
     
     /*allocate device number*/
-    err = alloc_chrdev_region(&drv_data.dev_num_base, 0, MAX_NUMBER_OF_DEVICES, "pseudo memory platform devs");
+    err = alloc_chrdev_region(&drv_data.dev_num_base, 0, DEV_MINORS_COUNT, "pseudo memory platform devs");
     if(err <0)
     {
         pr_err("%s:chrdev alloc failed\n", __func__);
@@ -95,15 +963,30 @@ static int __init pseudo_plf_drv_init(void)
         goto unreg_dev;
     }
 
+    /*allocate a block major number, every flat device gets a disk with the minor of its char device*/
+    drv_data.blk_major = register_blkdev(0, "pseudo_plf_blk");
+    if(drv_data.blk_major < 0)
+    {
+        pr_err("%s:block major alloc failed\n", __func__);
+        err = drv_data.blk_major;
+        goto class_del;
+    }
+
+    if(sync_probe)
+        pseudo_plf_drv.driver.probe_type = PROBE_FORCE_SYNCHRONOUS;
+
     /*register the platform driver*/
     platform_driver_register(&pseudo_plf_drv);
 
     pr_info("%s:plf drv module loaded successfully\n",__func__);
-    return err;
+    return 0;
+
+class_del:
+    class_destroy(drv_data.dev_class);
 
 unreg_dev:
     /*dealloc device number*/
-    unregister_chrdev_region(drv_data.dev_num_base, MAX_NUMBER_OF_DEVICES);
+    unregister_chrdev_region(drv_data.dev_num_base, DEV_MINORS_COUNT);
 
 alloc_fail:
     pr_info("%s:module intialization failed\n", __func__);
@@ -115,12 +998,17 @@ static void __exit pseudo_plf_drv_deinit(void)
 {
     /*unregister the platform driver*/
     platform_driver_unregister(&pseudo_plf_drv);
+
+    unregister_blkdev(drv_data.blk_major, "pseudo_plf_blk");
     
     /*distroy driver class*/
     class_destroy(drv_data.dev_class);
     
     /*dealloc device number*/
-    unregister_chrdev_region(drv_data.dev_num_base, MAX_NUMBER_OF_DEVICES);
+    unregister_chrdev_region(drv_data.dev_num_base, DEV_MINORS_COUNT);
+
+    xa_destroy(&drv_data.devs);
+    ida_destroy(&drv_data.minor_ida);
 
     pr_info("%s:plf drv module unloaded\n",__func__);
 }
@@ -129,6 +1017,7 @@ static void __exit pseudo_plf_drv_deinit(void)
 int pseudo_plf_probe(struct platform_device* plf_dev)
 {
     int err;
+    int cpu;
     
     struct dev_priv_data *new_dev_data;
     struct pseudo_platform_data *new_plf_data;
@@ -141,76 +1030,221 @@ int pseudo_plf_probe(struct platform_device* plf_dev)
         return -EINVAL;
     }
 
-    new_dev_data = devm_kzalloc(&plf_dev->dev, sizeof(*new_dev_data), GFP_KERNEL);
+    /*the platform device id names the device files, devices without an id can not be named*/
+    if(plf_dev->id < 0)
+    {
+        pr_info("%s:device id must not be negative\n",__func__);
+        return -EINVAL;
+    }
+
+    /*the node must have memory, otherwise every allocation of the device would fall back to another node*/
+    if((new_plf_data->numa_node != PLF_NUMA_ANY) && (new_plf_data->numa_node != PLF_NUMA_INTERLEAVE) &&
+       ((new_plf_data->numa_node < 0) || (new_plf_data->numa_node >= nr_node_ids) || !node_state(new_plf_data->numa_node, N_MEMORY)))
+    {
+        pr_info("%s:invalid numa node %d\n",__func__, new_plf_data->numa_node);
+        return -EINVAL;
+    }
+
+    /*the allocations use the device node, so the driver data and the buffers are next to the device pages*/
+    if(new_plf_data->numa_node >= 0)
+        set_dev_node(&plf_dev->dev, new_plf_data->numa_node);
+
+    /*the data is not device managed, open files can use it after the platform device is removed*/
+    new_dev_data = kzalloc_node(sizeof(*new_dev_data), GFP_KERNEL, dev_to_node(&plf_dev->dev));
     if(new_dev_data == NULL)
     {
         pr_info("%s:cannot allocate driver private data\n",__func__);
         return -ENOMEM;
     }
 
+    /*from here every error path drops the reference, data_free frees what was allocated*/
+    kref_init(&new_dev_data->ref);
+    xa_init(&new_dev_data->pages);
+    ida_init(&new_dev_data->snap_ida);
+    mutex_init(&new_dev_data->zero_lock);
+    INIT_WORK(&new_dev_data->zero_work, storage_zero_work);
+
     memcpy((void*)&new_dev_data->plf_data, (void*)new_plf_data, sizeof(*new_plf_data));
 
-    pr_info("%s device platform data: serial_number:%s\nsize:%ld\npermission:%x",__func__, new_dev_data->plf_data.serial_number, new_dev_data->plf_data.size, new_dev_data->plf_data.permission);
+    /*thousands of devices can be probed at once, the per device messages are debug only*/
+    pr_debug("%s device platform data: serial_number:%s\nsize:%zu\npermission:%x\nsparse:%d\ncompressed:%d",__func__, new_dev_data->plf_data.serial_number, new_dev_data->plf_data.size, new_dev_data->plf_data.permission, new_dev_data->plf_data.sparse, new_dev_data->plf_data.compressed);
 
-    /*allocate memory for device mem bvuffer*/
-    new_dev_data->data_buffer = devm_kzalloc(&plf_dev->dev, new_dev_data->plf_data.size, GFP_KERNEL);
-    if(new_dev_data->data_buffer == NULL)
+    /*fifo indices wrap using a mask, so fifo size must be power of 2*/
+    if((new_dev_data->plf_data.mode == FIFO_MODE) && !is_power_of_2(new_dev_data->plf_data.size))
     {
-        pr_info("%s:cannot allocate device memory buffer\n",__func__);
-        return -ENOMEM;
+        pr_info("%s:fifo device size must be power of 2\n",__func__);
+        err = -EINVAL;
+        goto put_data;
     }
 
-    /*initalize device number feild*/
-    new_dev_data->dev_num = drv_data.dev_num_base + plf_dev->id;
+    if(new_dev_data->plf_data.mode == FIFO_MODE)
+    {
+        /*allocate memory for device mem bvuffer*/
+        /*readers get only the bytes that writers put in the fifo, so the buffer is not zeroed*/
+        new_dev_data->data_buffer = kmalloc_node(new_dev_data->plf_data.size, GFP_KERNEL, dev_to_node(&plf_dev->dev));
+        if(new_dev_data->data_buffer == NULL)
+        {
+            pr_info("%s:cannot allocate device memory buffer\n",__func__);
+            err = -ENOMEM;
+            goto put_data;
+        }
+    }
+    else
+    {
+        /*allocate the device pages, sparse devices start empty*/
+        err = storage_init(&plf_dev->dev, new_dev_data);
+        if(err < 0)
+        {
+            pr_info("%s:cannot allocate device memory pages\n",__func__);
+            goto put_data;
+        }
+    }
 
-    /*intialize cdev struct*/
-    cdev_init(&new_dev_data->dev_cdev, &pseudo_fops);
-        
-    /*cdev_init clears all cdev struct elements, so you need to intialize owner after cdev_init*/
-    new_dev_data->dev_cdev.owner = THIS_MODULE;
+    new_dev_data->bounce_buffer = kmalloc_node(WRITE_CHUNK_SIZE, GFP_KERNEL, dev_to_node(&plf_dev->dev));
+    if(new_dev_data->bounce_buffer == NULL)
+    {
+        pr_info("%s:cannot allocate device bounce buffer\n",__func__);
+        err = -ENOMEM;
+        goto put_data;
+    }
+
+    /*per cpu statistics are freed with the device data*/
+    new_dev_data->stats = alloc_percpu(struct dev_stats);
+    if(new_dev_data->stats == NULL)
+    {
+        pr_info("%s:cannot allocate device statistics\n",__func__);
+        err = -ENOMEM;
+        goto put_data;
+    }
+    for_each_possible_cpu(cpu)
+        u64_stats_init(&per_cpu_ptr(new_dev_data->stats, cpu)->syncp);
+
+    mutex_init(&new_dev_data->write_lock);
+    seqcount_mutex_init(&new_dev_data->mem_seq, &new_dev_data->write_lock);
+    mutex_init(&new_dev_data->read_lock);
+    init_waitqueue_head(&new_dev_data->read_queue);
+    init_waitqueue_head(&new_dev_data->write_queue);
+    INIT_LIST_HEAD(&new_dev_data->snapshots);
+    spin_lock_init(&new_dev_data->qos.lock);
+    new_dev_data->qos_burst_us = QOS_DEFAULT_BURST_US;
+    spin_lock_init(&new_dev_data->emu_lock);
+    init_waitqueue_head(&new_dev_data->emu_queue);
+
+    /*initalize device number feild, the minor is freed automatically when the probe fails or the device is removed*/
+    new_dev_data->id = plf_dev->id;
+    err = minor_alloc(&plf_dev->dev, &new_dev_data->dev_num);
+    if(err < 0)
+    {
+        pr_info("%s:no free minor\n",__func__);
+        goto put_data;
+    }
+
+    /*allocate the cdev, its release frees it after the last open file of the device is closed*/
+    new_dev_data->cdev = cdev_alloc();
+    if(new_dev_data->cdev == NULL)
+    {
+        pr_err("cdev allocation failed\n");
+        err = -ENOMEM;
+        goto put_data;
+    }
+    new_dev_data->cdev->ops = &pseudo_fops;
+
+    /*cdev_alloc clears all cdev struct elements, so you need to intialize owner after it*/
+    new_dev_data->cdev->owner = THIS_MODULE;
+
+    /*the device is found by open only after its memory and locks are ready*/
+    err = xa_err(xa_store(&drv_data.devs, MINOR(new_dev_data->dev_num), new_dev_data, GFP_KERNEL));
+    if(err < 0)
+        goto put_data;
 
     /*register the device in VFS*/
-    err = cdev_add(&new_dev_data->dev_cdev, new_dev_data->dev_num, 1);
+    err = cdev_add(new_dev_data->cdev, new_dev_data->dev_num, 1);
     if(err <0)
     {
         pr_err("cdev registration failed\n");
-        return err;
+        goto xa_del;
     }
 
     /*create device files*/
-    new_dev_data->dev_ptr = device_create(drv_data.dev_class, NULL, new_dev_data->dev_num, NULL, "pseudo_char_dev:%d",plf_dev->id);
+    new_dev_data->dev_ptr = device_create_with_groups(drv_data.dev_class, NULL, new_dev_data->dev_num, new_dev_data, dev_attr_groups, "pseudo_char_dev:%d",plf_dev->id);
     
     if(IS_ERR(new_dev_data->dev_ptr))
     {
         pr_err("device file creation failed\n");
         err = PTR_ERR(new_dev_data->dev_ptr);
-        cdev_del(&new_dev_data->dev_cdev);
-        return err;
+        goto cdev_del;
+    }
+
+    /*block device frontend over the same memory, fifo devices are streams so they have no disk*/
+    if(blk_devices && (new_dev_data->plf_data.mode == FLAT_MODE))
+    {
+        err = blk_dev_create(new_dev_data, plf_dev->id);
+        if(err < 0)
+        {
+            pr_err("block device creation failed\n");
+            goto dev_del;
+        }
     }
 
     /*save driver data in platform device struct*/
     dev_set_drvdata(&plf_dev->dev, new_dev_data);
 
-    drv_data.devices_count++;
-    pr_info("%s:device is detected\n",__func__);
+    atomic_inc(&drv_data.devices_count);
+    pr_debug("%s:device is detected\n",__func__);
 
     return 0;
 
+dev_del:
+    device_destroy(drv_data.dev_class, new_dev_data->dev_num);
+
+cdev_del:
+    /*cdev_del also drops the allocation reference*/
+    cdev_del(new_dev_data->cdev);
+    new_dev_data->cdev = NULL;
+
+xa_del:
+    xa_erase(&drv_data.devs, MINOR(new_dev_data->dev_num));
+
+put_data:
+    /*a cdev that was never added is freed by its allocation reference*/
+    if(new_dev_data->cdev != NULL)
+        kobject_put(&new_dev_data->cdev->kobj);
+
+    /*an open that found the device before it was erased may still hold the data*/
+    storage_zero_cancel(new_dev_data);
+    data_put(new_dev_data);
+    return err;
 }
 
 int pseudo_plf_remove(struct platform_device* plf_dev)
 {
     struct dev_priv_data *rm_dev_data = dev_get_drvdata(&plf_dev->dev);
 
+    /*new opens of the device fail from here*/
+    xa_erase(&drv_data.devs, MINOR(rm_dev_data->dev_num));
+
+    /*the disk goes first, it waits for the requests in flight that use the device memory*/
+    if(rm_dev_data->disk != NULL)
+        blk_dev_destroy(rm_dev_data);
+
+    /*snapshot devices are children of the device file, they are deleted before it*/
+    snapshot_delete_all(rm_dev_data);
+
     /*destroy device file*/
     device_destroy(drv_data.dev_class, rm_dev_data->dev_num);
     
-    /*delete cdev*/
-    cdev_del(&rm_dev_data->dev_cdev);
+    /*delete cdev, open files keep it until they are closed*/
+    cdev_del(rm_dev_data->cdev);
+
+    /*the zero worker uses the device pages, the open files zero the pages they use themselves*/
+    storage_zero_cancel(rm_dev_data);
 
-    drv_data.devices_count--;
+    /*drop the platform device reference, the last open file frees the data if there is one*/
+    data_put(rm_dev_data);
 
-    pr_info("%s:device removed\n",__func__);
+    atomic_dec(&drv_data.devices_count);
+
+    pr_debug("%s:device removed\n",__func__);
     
     return 0;
 }
@@ -220,132 +1254,1787 @@ int pseudo_open (struct inode *inode_ptr, struct file *file_ptr)
     int err;
     int minor_num;
     struct dev_priv_data *dev_data;
-
-    pr_info("pseudo_open method called:\n");
+    struct pseudo_file *pfile = NULL;
 
     minor_num = MINOR(inode_ptr->i_rdev);
-    pr_info("minor number:%d:\n", minor_num);
     
-    /*extract pointer to device data using cdev*/
-    dev_data = container_of(inode_ptr->i_cdev, struct dev_priv_data, dev_cdev);
-
-    /*update file private data pointer with the device data pointer*/
-    file_ptr->private_data = dev_data;
+    /*devices and snapshots are looked up by minor, a device that is being removed is not found*/
+    dev_data = data_lookup(minor_num);
+    if(dev_data == NULL)
+    {
+        trace_pseudo_plf_open(minor_num, (__force unsigned int)file_ptr->f_mode, -ENODEV);
+        return -ENODEV;
+    }
 
     /*check if the requested permission compatable with device permission*/
     err = check_file_permission(dev_data->plf_data.permission, file_ptr->f_mode);
-    
+
+    /*every open file has its own qos state, so one file can not use the limits of the others*/
     if(err == 0)
     {
-        pr_info("file opened successfully\n");
+        pfile = kzalloc(sizeof(*pfile), GFP_KERNEL);
+        if(pfile == NULL)
+            err = -ENOMEM;
     }
-    else
+
+    /*the file keeps the lookup reference until it is released*/
+    if(err < 0)
+        data_put(dev_data);
+
+    if(err == 0)
     {
-        pr_info("file open failed\n");
+        /*update file private data pointer with the device data and the file qos state*/
+        pfile->data = dev_data;
+        spin_lock_init(&pfile->qos.lock);
+        file_ptr->private_data = pfile;
+
+        /*fifo devices are streams, the file position is not used and seeking is not allowed*/
+        /*flat devices get the regular file position rules, read, write and llseek on a   */
+        /*shared file are serialized by the file position lock, pread and pwrite use the */
+        /*position they get and never take that lock                                     */
+        /*the side counts tell fifo_lock whether a reader or a writer is alone on its side*/
+        if(dev_data->plf_data.mode == FIFO_MODE)
+        {
+            stream_open(inode_ptr, file_ptr);
+            fifo_count_files(&dev_data->fifo, file_ptr, 1);
+        }
+        else
+        {
+            file_ptr->f_mode |= FMODE_ATOMIC_POS;
+        }
+
+        /*read_iter and write_iter honor IOCB_NOWAIT, so io_uring can complete requests inline*/
+        /*instead of handing them to its worker threads*/
+        file_ptr->f_mode |= FMODE_NOWAIT;
+
+        stats_account_op(dev_data, STAT_OPENS, 0);
     }
+
+    trace_pseudo_plf_open(minor_num, (__force unsigned int)file_ptr->f_mode, err);
 	return err;
 }
 int pseudo_release (struct inode *inode_ptr, struct file *file_ptr)
 {
-    pr_info("pseudo_release method called:\n");
+    struct dev_priv_data *data_ptr = pseudo_file_data(file_ptr);
+
+    if(data_ptr->plf_data.mode == FIFO_MODE)
+        fifo_count_files(&data_ptr->fifo, file_ptr, -1);
+
+    kfree(file_ptr->private_data);
+    data_put(data_ptr);
 	return 0;
 }
 
-ssize_t pseudo_read (struct file *file_ptr, char __user *buffer, size_t count, loff_t *f_pos)
+struct dev_priv_data *pseudo_file_data(struct file *file_ptr)
 {
-    struct dev_priv_data *data_ptr = (struct dev_priv_data *)file_ptr->private_data;
-    size_t size = data_ptr->plf_data.size;
+    return ((struct pseudo_file *)file_ptr->private_data)->data;
+}
 
-    pr_info("pseudo_read method called, count:%zu, file position:%lld\n", count, *f_pos);
+/*data section*/
+void data_get(struct dev_priv_data *data_ptr)
+{
+    kref_get(&data_ptr->ref);
+}
 
-    /*if the count exeeds the memory size truncate the count*/
-    if((count + *f_pos) > size)
-        count = size - *f_pos;
-    
-    /*copy data, note that this code is not thread safe*/
-    if(copy_to_user(buffer, data_ptr->data_buffer+(*f_pos), count) > 0)
-        return -EFAULT;
+/*the reference is taken under the xarray lock, so a remove that erased the device meanwhile*/
+/*is not missed, a device whose last reference is already gone is not found either        */
+struct dev_priv_data *data_lookup(int minor)
+{
+    struct dev_priv_data *data_ptr;
 
-    /*update file position*/
-    *f_pos = *f_pos + count;
+    xa_lock(&drv_data.devs);
+    data_ptr = xa_load(&drv_data.devs, minor);
+    if((data_ptr != NULL) && !kref_get_unless_zero(&data_ptr->ref))
+        data_ptr = NULL;
+    xa_unlock(&drv_data.devs);
 
-    pr_info("number of bytes have been read%zu, file position:%lld\n", count, *f_pos);
-	return count;
+    return data_ptr;
 }
 
-ssize_t pseudo_write (struct file *file_ptr, const char __user *buffer, size_t count, loff_t *f_pos)
+void data_put(struct dev_priv_data *data_ptr)
 {
-	struct dev_priv_data *data_ptr = (struct dev_priv_data *)file_ptr->private_data;
-    size_t size = data_ptr->plf_data.size;
+    kref_put(&data_ptr->ref, data_release);
+}
 
-	pr_info("pseudo_write method called, count:%zu, file position:%lld\n", count, *f_pos);
+/*the references are dropped in process context, see emu_timer_fn*/
+void data_release(struct kref *ref)
+{
+    struct dev_priv_data *data_ptr = container_of(ref, struct dev_priv_data, ref);
 
-    if(*f_pos == size)
+    /*a snapshot data is part of its device struct, the device release frees it*/
+    if(data_ptr->snapshot)
     {
-        /*EOF*/
-        pr_info("no space left\n");
-        return -ENOMEM;
+        put_device(&container_of(data_ptr, struct pseudo_snapshot, data)->dev);
+        return;
     }
-    
-    /*if the count exeeds the memory size truncate the count*/
-    if((count + *f_pos) > size)
-        count = size - *f_pos;
-    
-    /*copy data, note that this code is not thread safe*/
-    if(copy_from_user(data_ptr->data_buffer+(*f_pos), buffer, count) > 0)
-        return -EFAULT;
 
-    /*update file position*/
-    *f_pos = *f_pos + count;
-        
-    pr_info("number of bytes have been written%zu, file position:%lld\n", count, *f_pos);
-	return count;
+    data_free(data_ptr);
+    kfree(data_ptr);
 }
 
-loff_t pseudo_llseek (struct file *file_ptr, loff_t offset, int whence)
+/*free the memory of the device data, the buffers that were not allocated are NULL*/
+void data_free(struct dev_priv_data *data_ptr)
 {
-	struct dev_priv_data *data_ptr = (struct dev_priv_data *)file_ptr->private_data;
-    size_t size = data_ptr->plf_data.size;
-    loff_t new_pos;
+    storage_release(data_ptr);
+    ida_destroy(&data_ptr->snap_ida);
+    comp_free(data_ptr);
+    kfree(data_ptr->data_buffer);
+    kfree(data_ptr->bounce_buffer);
+    free_percpu(data_ptr->stats);
+}
 
-    pr_info("pseudo_llseek method called, current f_pos:%lld\n", file_ptr->f_pos);
-    
-    switch (whence)
-    {
-        case SEEK_SET:
-            /*return error if the file position will go beyond file memory or if it will be <0*/
-            if((offset > size) || (offset < 0))
-                return -EINVAL;
+ssize_t pseudo_read_iter (struct kiocb *iocb, struct iov_iter *to)
+{
+    struct dev_priv_data *data_ptr = pseudo_file_data(iocb->ki_filp);
+    size_t count = iov_iter_count(to);
+    loff_t pos = iocb->ki_pos;
+    u64 start;
+    u64 latency;
+    u64 done;
+    bool emu = false;
+    ssize_t ret;
+
+    /*the qos wait and the emulated service time are part of the latency, that is the time the caller sees*/
+    start = ktime_get_ns();
+    ret = qos_throttle(iocb->ki_filp, data_ptr, count, iocb->ki_flags & IOCB_NOWAIT);
+    if(ret == 0)
+        ret = emu_slot_get(data_ptr, iocb->ki_flags & IOCB_NOWAIT, &emu);
+    if(ret == 0)
+        ret = mem_read_iter(iocb, data_ptr, to);
+    done = ktime_get_ns();
+    if(emu && (ret >= 0))
+        done = emu_done_time(data_ptr, ret, done);
+    latency = done - start;
+
+    /*statistics are always on, they touch only this cpu copy*/
+    stats_account_io(data_ptr, true, ret, count, latency);
+    trace_pseudo_plf_read(MINOR(data_ptr->dev_num), count, pos, ret, latency);
+
+    if(emu)
+        return emu_complete(iocb, data_ptr, ret, done);
+
+    return ret;
+}
 
-            file_ptr->f_pos = offset;
-        break;
+ssize_t mem_read_iter(struct kiocb *iocb, struct dev_priv_data *data_ptr, struct iov_iter *to)
+{
+    size_t size = data_ptr->plf_data.size;
+    size_t count = iov_iter_count(to);
+    ssize_t copied;
 
-        case SEEK_CUR:
-            new_pos = file_ptr->f_pos +offset;
-            
-            /*return error if the file position will go beyond file memory or if it will be <0*/
-            if( (new_pos > size) || (new_pos < 0) )
-                return -EINVAL;
+    /*fifo devices are opened as streams, the file position is not used for them*/
+    if(data_ptr->plf_data.mode == FIFO_MODE)
+        return fifo_read(iocb, to, &data_ptr->fifo, data_ptr->data_buffer, data_ptr->plf_data.size,
+                         &data_ptr->read_lock, &data_ptr->read_queue, &data_ptr->write_queue);
 
-            file_ptr->f_pos = new_pos;
-        break;
+    /*positional reads can start at any offset, nothing to read beyond the memory*/
+    if(iocb->ki_pos >= size)
+        return 0;
+
+    /*if the count exeeds the memory size truncate the count*/
+    if((count + iocb->ki_pos) > size)
+        count = size - iocb->ki_pos;
+    
+    /*copy data, readers run in parallel without taking any lock*/
+    /*all the iov segments are filled in one call*/
+    copied = copy_mem_to_iter(data_ptr, to, iocb->ki_pos, count, iocb->ki_flags & IOCB_NOWAIT);
+    if(copied < 0)
+        return copied;
+
+    /*update file position*/
+    iocb->ki_pos = iocb->ki_pos + copied;
+
+	return copied;
+}
+
+ssize_t pseudo_write_iter (struct kiocb *iocb, struct iov_iter *from)
+{
+    struct dev_priv_data *data_ptr = pseudo_file_data(iocb->ki_filp);
+    size_t count = iov_iter_count(from);
+    loff_t pos = iocb->ki_pos;
+    u64 start;
+    u64 latency;
+    u64 done;
+    bool emu = false;
+    ssize_t ret;
+
+    start = ktime_get_ns();
+    ret = qos_throttle(iocb->ki_filp, data_ptr, count, iocb->ki_flags & IOCB_NOWAIT);
+    if(ret == 0)
+        ret = emu_slot_get(data_ptr, iocb->ki_flags & IOCB_NOWAIT, &emu);
+    if(ret == 0)
+        ret = mem_write_iter(iocb, data_ptr, from);
+    done = ktime_get_ns();
+    if(emu && (ret >= 0))
+        done = emu_done_time(data_ptr, ret, done);
+    latency = done - start;
+
+    /*statistics are always on, they touch only this cpu copy*/
+    stats_account_io(data_ptr, false, ret, count, latency);
+    trace_pseudo_plf_write(MINOR(data_ptr->dev_num), count, pos, ret, latency);
+
+    if(emu)
+        return emu_complete(iocb, data_ptr, ret, done);
+
+    return ret;
+}
+
+ssize_t mem_write_iter(struct kiocb *iocb, struct dev_priv_data *data_ptr, struct iov_iter *from)
+{
+    size_t size = data_ptr->plf_data.size;
+    size_t count = iov_iter_count(from);
+    ssize_t written;
+
+    /*fifo devices are opened as streams, the file position is not used for them*/
+    if(data_ptr->plf_data.mode == FIFO_MODE)
+        return fifo_write(iocb, from, &data_ptr->fifo, data_ptr->data_buffer, data_ptr->plf_data.size,
+                          &data_ptr->write_lock, &data_ptr->read_queue, &data_ptr->write_queue);
+
+    /*EOF, no space left*/
+    if(iocb->ki_pos >= size)
+        return -ENOMEM;
+    
+    /*if the count exeeds the memory size truncate the count*/
+    if((count + iocb->ki_pos) > size)
+        count = size - iocb->ki_pos;
+    
+    /*copy data, writers are serialized by the device write lock*/
+    written = copy_mem_from_iter(data_ptr, from, iocb->ki_pos, count, iocb->ki_flags & IOCB_NOWAIT);
+    if(written < 0)
+        return written;
+
+    /*update file position*/
+    iocb->ki_pos = iocb->ki_pos + written;
         
-        case SEEK_END:
-            new_pos = size + offset;
+	return written;
+}
 
-            /*return error if the file position will go beyond file memory or if it will be <0*/
-            if( (new_pos > size) || (new_pos < 0) )
-                return -EINVAL;
+loff_t pseudo_llseek (struct file *file_ptr, loff_t offset, int whence)
+{
+    struct dev_priv_data *data_ptr = pseudo_file_data(file_ptr);
+    size_t size = data_ptr->plf_data.size;
+    loff_t new_pos;
 
-            file_ptr->f_pos = new_pos;
+    switch (whence)
+    {
+        /*the data and holes are tracked in page units, like a file system with page size blocks*/
+        case SEEK_DATA:
+            new_pos = storage_seek_data(data_ptr, offset);
+            if(new_pos >= 0)
+                new_pos = vfs_setpos(file_ptr, new_pos, size);
         break;
-        
+
+        case SEEK_HOLE:
+            new_pos = storage_seek_hole(data_ptr, offset);
+            if(new_pos >= 0)
+                new_pos = vfs_setpos(file_ptr, new_pos, size);
+        break;
+
+        /*the generic helper returns EINVAL if the file position will go beyond file memory or if it*/
+        /*will be <0, it updates f_pos with vfs_setpos and does SEEK_CUR atomically under f_lock     */
+        default:
+            new_pos = fixed_size_llseek(file_ptr, offset, whence, size);
+        break;
+    }
+
+    stats_account_op(data_ptr, STAT_LLSEEKS, new_pos);
+    trace_pseudo_plf_llseek(MINOR(data_ptr->dev_num), offset, whence, new_pos);
+	return new_pos;
+}
+
+/*nowait callers get EAGAIN instead of sleeping on the write lock*/
+ssize_t copy_mem_to_iter(struct dev_priv_data *data_ptr, struct iov_iter *to, loff_t pos, size_t count, bool nowait)
+{
+    unsigned int seq;
+    size_t copied;
+    int retries;
+
+    /*compressed chunks are decompressed under their hot chunk lock, they dont use mem_seq*/
+    if(data_ptr->plf_data.compressed)
+        return comp_copy_to_iter(data_ptr, to, pos, count, nowait);
+
+    for(retries=0; retries<MAX_READ_RETRIES; retries++)
+    {
+        seq = read_seqcount_begin(&data_ptr->mem_seq);
+
+        /*copy_to_iter may fault and sleep, that is fine because no lock is held here*/
+        copied = storage_copy_to_iter(data_ptr, pos, count, to);
+
+        /*the copy is consistent if no writer touched the memory while copying*/
+        if(!read_seqcount_retry(&data_ptr->mem_seq, seq))
+            goto done;
+
+        /*rewind the iterator to copy the same range again*/
+        iov_iter_revert(to, copied);
+    }
+
+    /*writers keep changing the memory, take the write lock so the reader is not starved*/
+    if(nowait)
+    {
+        if(!mutex_trylock(&data_ptr->write_lock))
+            return -EAGAIN;
+    }
+    else
+    {
+        mutex_lock(&data_ptr->write_lock);
+    }
+    copied = storage_copy_to_iter(data_ptr, pos, count, to);
+    mutex_unlock(&data_ptr->write_lock);
+
+done:
+    /*report the fault only if nothing was copied, otherwise return the copied part*/
+    if((copied == 0) && (count > 0))
+        return -EFAULT;
+
+    return copied;
+}
+
+ssize_t copy_mem_from_iter(struct dev_priv_data *data_ptr, struct iov_iter *from, loff_t pos, size_t count, bool nowait)
+{
+    struct page *page;
+    size_t done = 0;
+    size_t offset;
+    size_t chunk;
+    size_t copied;
+    int err = 0;
+
+    /*non blocking callers like io_uring inline submission must not sleep on the lock*/
+    if(nowait)
+    {
+        if(!mutex_trylock(&data_ptr->write_lock))
+            return -EAGAIN;
+    }
+    else
+    {
+        mutex_lock(&data_ptr->write_lock);
+    }
+
+    while(done < count)
+    {
+        offset = offset_in_page(pos + done);
+        chunk = min_t(size_t, count - done, PAGE_SIZE - offset);
+
+        /*copy user data outside the write section, copy_from_iter may sleep*/
+        copied = copy_from_iter(data_ptr->bounce_buffer, chunk, from);
+        if(copied == 0)
+        {
+            err = -EFAULT;
+            break;
+        }
+
+        /*compressed chunks are replaced as a whole, readers wait on the hot chunk lock meanwhile*/
+        if(data_ptr->plf_data.compressed)
+        {
+            err = comp_write_chunk(data_ptr, (pos + done) >> PAGE_SHIFT, offset, data_ptr->bounce_buffer, copied, nowait);
+            if(err < 0)
+            {
+                iov_iter_revert(from, copied);
+                break;
+            }
+
+            done += copied;
+            if(copied < chunk)
+                break;
+            continue;
+        }
+
+        page = xa_load(&data_ptr->pages, (pos + done) >> PAGE_SHIFT);
+
+        /*the rest of the page must be zeros before a partial write*/
+        if(page != NULL)
+            storage_zero_page(data_ptr, (pos + done) >> PAGE_SHIFT, page);
+
+        /*zeros written to a hole dont change what readers get, keep the hole*/
+        if((page != NULL) || (memchr_inv(data_ptr->bounce_buffer, 0, copied) != NULL))
+        {
+            /*the page allocation can sleep, so it is done before the write section*/
+            /*a page shared with a snapshot or a pipe gets a copy, they keep the old data*/
+            /*readers hold only short references, so they dont force a copy              */
+            if(page == NULL)
+                page = storage_write_page(data_ptr, (pos + done) >> PAGE_SHIFT);
+            else if(storage_page_shared(data_ptr, (pos + done) >> PAGE_SHIFT, page))
+                page = storage_cow_page(data_ptr, (pos + done) >> PAGE_SHIFT, page);
+
+            if(IS_ERR(page))
+            {
+                iov_iter_revert(from, copied);
+                err = PTR_ERR(page);
+                break;
+            }
+
+            /*readers that overlap this section will retry their copy*/
+            write_seqcount_begin(&data_ptr->mem_seq);
+            memcpy_to_page(page, offset, data_ptr->bounce_buffer, copied);
+            write_seqcount_end(&data_ptr->mem_seq);
+        }
+
+        done += copied;
+
+        /*a short copy means the user buffer faulted*/
+        if(copied < chunk)
+            break;
+    }
+    mutex_unlock(&data_ptr->write_lock);
+
+    /*report the error only if nothing was written, otherwise return the written part*/
+    if((done == 0) && (count > 0))
+        return err;
+
+    return done;
+}
+
+/*storage section, flat devices memory*/
+int storage_init(struct device *dev, struct dev_priv_data *data_ptr)
+{
+    pgoff_t nr_pages = DIV_ROUND_UP(data_ptr->plf_data.size, PAGE_SIZE);
+    struct page *page;
+    pgoff_t index;
+    int err;
+
+    /*the pages are freed with the device data, also when the probe fails after this point*/
+    /*compressed devices store only the written chunks, all zero chunks are holes*/
+    if(data_ptr->plf_data.compressed)
+    {
+        data_ptr->plf_data.sparse = 1;
+        return comp_init(dev, data_ptr);
+    }
+
+    if(data_ptr->plf_data.sparse)
+        return 0;
+
+    /*dense devices get all their pages at probe, writes never allocate*/
+    if(!defer_zeroing)
+    {
+        for(index=0; index<nr_pages; index++)
+        {
+            page = storage_write_page(data_ptr, index);
+            if(IS_ERR(page))
+                return PTR_ERR(page);
+        }
+
+        return 0;
+    }
+
+    /*zeroing is most of the probe time of a large device, it is left to a worker*/
+    /*the device is not visible yet, so the pages can be marked after they are inserted*/
+    for(index=0; index<nr_pages; index++)
+    {
+        page = alloc_pages_node(storage_page_node(data_ptr, index), GFP_HIGHUSER, 0);
+        if(page == NULL)
+            return -ENOMEM;
+
+        err = xa_insert(&data_ptr->pages, index, page, GFP_KERNEL);
+        if(err < 0)
+        {
+            __free_page(page);
+            return err;
+        }
+
+        xa_set_mark(&data_ptr->pages, index, PAGE_UNZEROED);
+        data_ptr->nr_pages++;
+    }
+
+    /*the remove and the probe errors stop the worker before the pages can be freed*/
+    queue_work(system_unbound_wq, &data_ptr->zero_work);
+    return 0;
+}
+
+void storage_release(struct dev_priv_data *data_ptr)
+{
+    struct page *page;
+    unsigned long index;
+
+    if(data_ptr->plf_data.compressed)
+    {
+        struct comp_chunk *comp;
+
+        xa_for_each(&data_ptr->pages, index, comp)
+            kfree(comp);
+    }
+    else
+    {
+        /*snapshots and pipes may still use the page, the last reference frees it*/
+        xa_for_each(&data_ptr->pages, index, page)
+            put_page(page);
+    }
+
+    xa_destroy(&data_ptr->pages);
+}
+
+/*allocate the page of a hole, called by the writer that holds write_lock, or by the probe*/
+struct page *storage_write_page(struct dev_priv_data *data_ptr, pgoff_t index)
+{
+    struct page *page;
+    int err;
+
+    /*highmem pages are fine, they are accessed with kmap_local_page*/
+    page = alloc_pages_node(storage_page_node(data_ptr, index), GFP_HIGHUSER | __GFP_ZERO, 0);
+    if(page == NULL)
+        return ERR_PTR(-ENOMEM);
+    set_page_private(page, data_ptr->snap_gen);
+
+    /*the store publishes the zeroed page, a reader sees either the hole or zeros*/
+    err = xa_insert(&data_ptr->pages, index, page, GFP_KERNEL);
+    if(err < 0)
+    {
+        __free_page(page);
+        return ERR_PTR(err);
+    }
+
+    WRITE_ONCE(data_ptr->nr_pages, data_ptr->nr_pages + 1);
+    return page;
+}
+
+/*a write to the page must go to a copy if a pipe or a snapshot still uses the page, called under write_lock*/
+/*the snapshots are in creation order, so only the newest generation must be checked                       */
+bool storage_page_shared(struct dev_priv_data *data_ptr, pgoff_t index, struct page *page)
+{
+    struct pseudo_snapshot *snap;
+
+    if(xa_get_mark(&data_ptr->pages, index, PAGE_SPLICED))
+        return true;
+
+    if(list_empty(&data_ptr->snapshots))
+        return false;
+
+    snap = list_last_entry(&data_ptr->snapshots, struct pseudo_snapshot, node);
+    return page_private(page) < snap->data.snap_gen;
+}
+
+/*copy a shared page before writing it, called by the writer that holds write_lock*/
+struct page *storage_cow_page(struct dev_priv_data *data_ptr, pgoff_t index, struct page *old)
+{
+    struct pseudo_snapshot *snap;
+    struct page *page;
+    void *entry;
+    int err;
+
+    page = alloc_pages_node(storage_page_node(data_ptr, index), GFP_HIGHUSER, 0);
+    if(page == NULL)
+        return ERR_PTR(-ENOMEM);
+
+    copy_highpage(page, old);
+    set_page_private(page, data_ptr->snap_gen);
+
+    /*the snapshots taken after the old page was written keep it in their own pages*/
+    /*it is added there before it leaves the device, see storage_get_page            */
+    /*a snapshot that has it already got it from a write that failed after this loop*/
+    list_for_each_entry(snap, &data_ptr->snapshots, node)
+    {
+        if(page_private(old) >= snap->data.snap_gen)
+            continue;
+
+        get_page(old);
+        err = xa_insert(&snap->data.pages, index, old, GFP_KERNEL);
+        if(err < 0)
+        {
+            put_page(old);
+            if(err == -EBUSY)
+                continue;
+
+            __free_page(page);
+            return ERR_PTR(err);
+        }
+        WRITE_ONCE(snap->data.nr_pages, snap->data.nr_pages + 1);
+    }
+
+    /*the copy has the same data, so readers dont care which of the two pages they get here*/
+    entry = xa_store(&data_ptr->pages, index, page, GFP_KERNEL);
+    if(xa_is_err(entry))
+    {
+        __free_page(page);
+        return ERR_PTR(xa_err(entry));
+    }
+
+    /*the pipes got the old page, the copy is not in any of them*/
+    xa_clear_mark(&data_ptr->pages, index, PAGE_SPLICED);
+
+    /*drop the device reference, the snapshots, pipes and readers that use the old page keep their own*/
+    put_page(old);
+    return page;
+}
+
+/*take a reference on the page of index, NULL for holes*/
+/*the reference keeps the page valid if a writer replaces it with a copy meanwhile*/
+struct page *storage_get_page(struct dev_priv_data *data_ptr, pgoff_t index)
+{
+    struct page *page;
+
+    /*a snapshot reads the origin pages of older generations, the newer ones were written after it*/
+    /*then it has the page that the writer replaced in its own pages                              */
+    if(data_ptr->origin != NULL)
+    {
+        page = storage_get_page(data_ptr->origin, index);
+        if(page != NULL)
+        {
+            if(page_private(page) < data_ptr->snap_gen)
+                return page;
+            put_page(page);
+        }
+
+        /*pairs with the xa_store of storage_cow_page, the old page was added here before it*/
+        smp_rmb();
+    }
+
+    rcu_read_lock();
+repeat:
+    page = xa_load(&data_ptr->pages, index);
+    if(page != NULL)
+    {
+        /*the page may be freed and reused after the lookup, keep it only if it is still the device page*/
+        if(!get_page_unless_zero(page))
+            goto repeat;
+
+        if(unlikely(page != xa_load(&data_ptr->pages, index)))
+        {
+            put_page(page);
+            goto repeat;
+        }
+    }
+    rcu_read_unlock();
+
+    if(page != NULL)
+        storage_zero_page(data_ptr, index, page);
+
+    return page;
+}
+
+/*node of the page of index, NUMA_NO_NODE lets the page allocator use the node of the current cpu*/
+/*a node id is a preference, the allocation falls back to the other nodes when the node is full  */
+int storage_page_node(struct dev_priv_data *data_ptr, pgoff_t index)
+{
+    int node = data_ptr->plf_data.numa_node;
+    int nth;
+
+    if(node == PLF_NUMA_ANY)
+        return NUMA_NO_NODE;
+
+    if(node != PLF_NUMA_INTERLEAVE)
+        return node;
+
+    /*the index picks the node, so the placement does not depend on the order the pages are written*/
+    nth = index % num_node_state(N_MEMORY);
+    for_each_node_state(node, N_MEMORY)
+    {
+        if(nth-- == 0)
+            return node;
+    }
+
+    return NUMA_NO_NODE;
+}
+
+/*zero the page if the zero worker did not get to it yet, called before any access to a dense device page*/
+void storage_zero_page(struct dev_priv_data *data_ptr, pgoff_t index, struct page *page)
+{
+    /*the mark is cleared only after the page is zeroed, so a clear mark needs no lock*/
+    if(!xa_get_mark(&data_ptr->pages, index, PAGE_UNZEROED))
+    {
+        smp_rmb();
+        return;
+    }
+
+    mutex_lock(&data_ptr->zero_lock);
+    if(xa_get_mark(&data_ptr->pages, index, PAGE_UNZEROED))
+    {
+        clear_highpage(page);
+        smp_wmb();
+        xa_clear_mark(&data_ptr->pages, index, PAGE_UNZEROED);
+    }
+    mutex_unlock(&data_ptr->zero_lock);
+}
+
+void storage_zero_work(struct work_struct *work)
+{
+    struct dev_priv_data *data_ptr = container_of(work, struct dev_priv_data, zero_work);
+    struct page *page;
+    unsigned long index;
+
+    xa_for_each_marked(&data_ptr->pages, index, page, PAGE_UNZEROED)
+    {
+        storage_zero_page(data_ptr, index, page);
+        cond_resched();
+    }
+}
+
+void storage_zero_cancel(struct dev_priv_data *data_ptr)
+{
+    cancel_work_sync(&data_ptr->zero_work);
+}
+
+size_t storage_copy_to_iter(struct dev_priv_data *data_ptr, loff_t pos, size_t count, struct iov_iter *to)
+{
+    struct page *page;
+    size_t done = 0;
+    size_t offset;
+    size_t chunk;
+    size_t copied;
+
+    while(done < count)
+    {
+        offset = offset_in_page(pos + done);
+        chunk = min_t(size_t, count - done, PAGE_SIZE - offset);
+
+        /*holes are read as zeros without allocating memory*/
+        page = storage_get_page(data_ptr, (pos + done) >> PAGE_SHIFT);
+        if(page != NULL)
+        {
+            copied = copy_page_to_iter(page, offset, chunk, to);
+            put_page(page);
+        }
+        else
+        {
+            copied = iov_iter_zero(chunk, to);
+        }
+
+        done += copied;
+
+        /*a short copy means the user buffer faulted*/
+        if(copied < chunk)
+            break;
+    }
+
+    return done;
+}
+
+/*first allocated page at or after pos, ENXIO if there is no data up to the device end*/
+loff_t storage_seek_data(struct dev_priv_data *data_ptr, loff_t pos)
+{
+    size_t size = data_ptr->plf_data.size;
+    unsigned long last = (size - 1) >> PAGE_SHIFT;
+    unsigned long index;
+    unsigned long origin_index;
+    struct page *page;
+
+    if((pos < 0) || (pos >= size))
+        return -ENXIO;
+
+    index = pos >> PAGE_SHIFT;
+    page = xa_find(&data_ptr->pages, &index, last, XA_PRESENT);
+    if(page == NULL)
+        index = last + 1;
+
+    /*a snapshot has the data of its own pages and of the origin pages, the origin pages written*/
+    /*after the snapshot are reported as data too, like a file system may do with its holes     */
+    if(data_ptr->origin != NULL)
+    {
+        origin_index = pos >> PAGE_SHIFT;
+        if(xa_find(&data_ptr->origin->pages, &origin_index, last, XA_PRESENT) != NULL)
+            index = min(index, origin_index);
+    }
+
+    if(index > last)
+        return -ENXIO;
+
+    return max_t(loff_t, pos, (loff_t)index << PAGE_SHIFT);
+}
+
+/*first hole at or after pos, the device end counts as a hole*/
+loff_t storage_seek_hole(struct dev_priv_data *data_ptr, loff_t pos)
+{
+    size_t size = data_ptr->plf_data.size;
+    unsigned long last = (size - 1) >> PAGE_SHIFT;
+    unsigned long index;
+    unsigned long next;
+
+    if((pos < 0) || (pos >= size))
+        return -ENXIO;
+
+    /*dense devices have no holes*/
+    if(!data_ptr->plf_data.sparse)
+        return size;
+
+    index = storage_next_hole(&data_ptr->pages, pos >> PAGE_SHIFT, last);
+
+    /*a snapshot hole has no page in the snapshot and in the origin, look in both until they agree*/
+    while((data_ptr->origin != NULL) && (index <= last))
+    {
+        next = storage_next_hole(&data_ptr->origin->pages, index, last);
+        if(next == index)
+            break;
+        index = storage_next_hole(&data_ptr->pages, next, last);
+    }
+
+    if(index > last)
+        return size;
+
+    return max_t(loff_t, pos, (loff_t)index << PAGE_SHIFT);
+}
+
+/*first index in [index, last] without a page, last + 1 if there is none*/
+/*only the present entries are visited, the lookup jumps to the next one */
+/*so a hole is found when the index of an entry skips over it           */
+unsigned long storage_next_hole(struct xarray *pages, unsigned long index, unsigned long last)
+{
+    unsigned long hole = index;
+    void *entry;
+
+    xa_for_each_range(pages, index, entry, hole, last)
+    {
+        if(index != hole)
+            break;
+
+        hole++;
+        cond_resched();
+    }
+
+    return hole;
+}
+
+/*compression section, compressed flat devices memory*/
+int comp_init(struct device *dev, struct dev_priv_data *data_ptr)
+{
+    int itr;
+
+    /*the buffers are freed by comp_free with the device data*/
+    data_ptr->hot_chunks = kcalloc_node(HOT_CHUNKS, sizeof(*data_ptr->hot_chunks), GFP_KERNEL, dev_to_node(dev));
+    if(data_ptr->hot_chunks == NULL)
+        return -ENOMEM;
+
+    for(itr=0; itr<HOT_CHUNKS; itr++)
+    {
+        data_ptr->hot_chunks[itr].buffer = kmalloc_node(PAGE_SIZE, GFP_KERNEL, dev_to_node(dev));
+        if(data_ptr->hot_chunks[itr].buffer == NULL)
+            return -ENOMEM;
+        mutex_init(&data_ptr->hot_chunks[itr].lock);
+    }
+
+    data_ptr->lz4_wrkmem = kmalloc_node(LZ4_MEM_COMPRESS, GFP_KERNEL, dev_to_node(dev));
+    data_ptr->lz4_buffer = kmalloc_node(LZ4_COMPRESSBOUND(PAGE_SIZE), GFP_KERNEL, dev_to_node(dev));
+    if((data_ptr->lz4_wrkmem == NULL) || (data_ptr->lz4_buffer == NULL))
+        return -ENOMEM;
+
+    return 0;
+}
+
+void comp_free(struct dev_priv_data *data_ptr)
+{
+    int itr;
+
+    if(data_ptr->hot_chunks != NULL)
+    {
+        for(itr=0; itr<HOT_CHUNKS; itr++)
+            kfree(data_ptr->hot_chunks[itr].buffer);
+    }
+
+    kfree(data_ptr->hot_chunks);
+    kfree(data_ptr->lz4_wrkmem);
+    kfree(data_ptr->lz4_buffer);
+}
+
+/*lock the hot chunk of index and make it hold the chunk data, nowait callers get EAGAIN instead of sleeping*/
+struct hot_chunk *comp_hot_chunk_lock(struct dev_priv_data *data_ptr, pgoff_t index, bool nowait)
+{
+    struct hot_chunk *hot = &data_ptr->hot_chunks[index % HOT_CHUNKS];
+    int err;
+
+    if(nowait)
+    {
+        if(!mutex_trylock(&hot->lock))
+            return ERR_PTR(-EAGAIN);
+    }
+    else
+    {
+        mutex_lock(&hot->lock);
+    }
+
+    if(hot->valid && (hot->index == index))
+    {
+        stats_account_op(data_ptr, STAT_CACHE_HITS, 0);
+        return hot;
+    }
+
+    stats_account_op(data_ptr, STAT_CACHE_MISSES, 0);
+    err = comp_chunk_load(data_ptr, index, hot->buffer);
+    if(err < 0)
+    {
+        hot->valid = false;
+        mutex_unlock(&hot->lock);
+        return ERR_PTR(err);
+    }
+
+    hot->index = index;
+    hot->valid = true;
+    return hot;
+}
+
+/*called under the hot chunk lock, the chunk can not be replaced meanwhile*/
+int comp_chunk_load(struct dev_priv_data *data_ptr, pgoff_t index, char *buffer)
+{
+    struct comp_chunk *comp = xa_load(&data_ptr->pages, index);
+    int len;
+
+    /*holes are read as zeros*/
+    if(comp == NULL)
+    {
+        memset(buffer, 0, PAGE_SIZE);
+        return 0;
+    }
+
+    if(comp->len == PAGE_SIZE)
+    {
+        memcpy(buffer, comp->data, PAGE_SIZE);
+        return 0;
+    }
+
+    len = LZ4_decompress_safe((const char *)comp->data, buffer, comp->len, PAGE_SIZE);
+    if(len != PAGE_SIZE)
+    {
+        pr_err("%s:corrupted chunk %lu\n", __func__, index);
+        return -EIO;
+    }
+
+    return 0;
+}
+
+/*replace the chunk of index with the compressed buffer, called under write_lock and the hot chunk lock*/
+int comp_chunk_store(struct dev_priv_data *data_ptr, pgoff_t index, const char *buffer)
+{
+    struct comp_chunk *comp = NULL;
+    struct comp_chunk *old;
+    const char *src = data_ptr->lz4_buffer;
+    int len;
+
+    /*all zero chunks are stored as holes*/
+    if(memchr_inv(buffer, 0, PAGE_SIZE) != NULL)
+    {
+        len = LZ4_compress_default(buffer, data_ptr->lz4_buffer, PAGE_SIZE, LZ4_COMPRESSBOUND(PAGE_SIZE), data_ptr->lz4_wrkmem);
+
+        /*keep incompressible data raw, so reading it back costs only a copy*/
+        if((len <= 0) || (len >= PAGE_SIZE))
+        {
+            len = PAGE_SIZE;
+            src = buffer;
+        }
+
+        comp = kmalloc_node(struct_size(comp, data, len), GFP_KERNEL, storage_page_node(data_ptr, index));
+        if(comp == NULL)
+            return -ENOMEM;
+
+        comp->len = len;
+        memcpy(comp->data, src, len);
+
+        old = xa_store(&data_ptr->pages, index, comp, GFP_KERNEL);
+        if(xa_is_err(old))
+        {
+            kfree(comp);
+            return xa_err(old);
+        }
+    }
+    else
+    {
+        old = xa_erase(&data_ptr->pages, index);
+    }
+
+    WRITE_ONCE(data_ptr->nr_pages, data_ptr->nr_pages + (comp != NULL) - (old != NULL));
+    WRITE_ONCE(data_ptr->compressed_bytes, data_ptr->compressed_bytes + (comp ? comp->len : 0) - (old ? old->len : 0));
+
+    kfree(old);
+    return 0;
+}
+
+ssize_t comp_copy_to_iter(struct dev_priv_data *data_ptr, struct iov_iter *to, loff_t pos, size_t count, bool nowait)
+{
+    struct hot_chunk *hot;
+    size_t done = 0;
+    size_t offset;
+    size_t chunk;
+    size_t copied;
+    int err = -EFAULT;
+
+    while(done < count)
+    {
+        offset = offset_in_page(pos + done);
+        chunk = min_t(size_t, count - done, PAGE_SIZE - offset);
+
+        hot = comp_hot_chunk_lock(data_ptr, (pos + done) >> PAGE_SHIFT, nowait);
+        if(IS_ERR(hot))
+        {
+            err = PTR_ERR(hot);
+            break;
+        }
+
+        /*copy_to_iter may fault and sleep, the hot chunk lock is a mutex so that is fine*/
+        copied = copy_to_iter(hot->buffer + offset, chunk, to);
+        mutex_unlock(&hot->lock);
+
+        done += copied;
+
+        /*a short copy means the user buffer faulted*/
+        if(copied < chunk)
+            break;
+    }
+
+    /*report the error only if nothing was copied, otherwise return the copied part*/
+    if((done == 0) && (count > 0))
+        return err;
+
+    return done;
+}
+
+/*read modify write of one chunk, the hot chunk keeps the new data so the next access does not decompress*/
+/*a nowait writer holds write_lock from a trylock and must not sleep on a hot chunk a reader holds either*/
+int comp_write_chunk(struct dev_priv_data *data_ptr, pgoff_t index, size_t offset, const char *src, size_t len, bool nowait)
+{
+    struct hot_chunk *hot;
+    int err;
+
+    hot = comp_hot_chunk_lock(data_ptr, index, nowait);
+    if(IS_ERR(hot))
+        return PTR_ERR(hot);
+
+    memcpy(hot->buffer + offset, src, len);
+
+    /*the hot chunk does not match the stored chunk if the store failed*/
+    err = comp_chunk_store(data_ptr, index, hot->buffer);
+    if(err < 0)
+        hot->valid = false;
+
+    mutex_unlock(&hot->lock);
+    return err;
+}
+
+/*splice section*/
+/*flat devices pass references to their pages to the pipe instead of copying the data*/
+/*the pipe reader sees the page content at the time it reads, like page cache splice */
+ssize_t pseudo_splice_read (struct file *file_ptr, loff_t *ppos, struct pipe_inode_info *pipe, size_t len, unsigned int flags)
+{
+    struct dev_priv_data *data_ptr = pseudo_file_data(file_ptr);
+    size_t size = data_ptr->plf_data.size;
+    struct pipe_buffer buf;
+    struct page *page;
+    pgoff_t index;
+    loff_t pos = *ppos;
+    size_t done = 0;
+    size_t offset;
+    size_t chunk;
+    ssize_t ret = 0;
+    u64 start;
+    u64 latency;
+
+    /*fifo data is consumed by the read, so it is copied to the pipe through read_iter*/
+    /*compressed devices have no pages to share, their chunks are decompressed by read_iter*/
+    if((data_ptr->plf_data.mode == FIFO_MODE) || data_ptr->plf_data.compressed)
+        return copy_splice_read(file_ptr, ppos, pipe, len, flags);
+
+    start = ktime_get_ns();
+
+    if(pos < size)
+        len = min_t(size_t, len, size - pos);
+    else
+        len = 0;
+
+    ret = qos_throttle(file_ptr, data_ptr, len, flags & SPLICE_F_NONBLOCK);
+    if(ret < 0)
+        len = 0;
+
+    while(done < len)
+    {
+        offset = offset_in_page(pos + done);
+        chunk = min_t(size_t, len - done, PAGE_SIZE - offset);
+
+        /*holes are passed as the shared zero page*/
+        /*the pipe keeps its own reference, the page stays valid even if the device is removed*/
+        index = (pos + done) >> PAGE_SHIFT;
+        page = storage_get_page(data_ptr, index);
+        if(page == NULL)
+        {
+            page = ZERO_PAGE(0);
+            get_page(page);
+        }
+        /*later writes copy a marked page first, so the pipe keeps the data it got here*/
+        /*a page that was replaced meanwhile is not written anymore and needs no mark   */
+        /*snapshots are never written and their origin copies the pages they share      */
+        else if(data_ptr->origin == NULL)
+        {
+            xa_lock(&data_ptr->pages);
+            if(xa_load(&data_ptr->pages, index) == page)
+                __xa_set_mark(&data_ptr->pages, index, PAGE_SPLICED);
+            xa_unlock(&data_ptr->pages);
+        }
+        buf = (struct pipe_buffer) {
+            .page   = page,
+            .offset = offset,
+            .len    = chunk,
+            .ops    = &pseudo_pipe_buf_ops
+        };
+
+        /*add_to_pipe drops the reference itself if the pipe is full or has no readers*/
+        ret = add_to_pipe(pipe, &buf);
+        if(ret < 0)
+            break;
+
+        done += chunk;
+    }
+
+    *ppos = pos + done;
+    if(done > 0)
+        ret = done;
+
+    latency = ktime_get_ns() - start;
+    stats_account_io(data_ptr, true, ret, len, latency);
+    trace_pseudo_plf_read(MINOR(data_ptr->dev_num), len, pos, ret, latency);
+
+    return ret;
+}
+
+long pseudo_ioctl (struct file *file_ptr, unsigned int cmd, unsigned long arg)
+{
+    struct dev_priv_data *data_ptr = pseudo_file_data(file_ptr);
+    u32 id;
+
+    switch(cmd)
+    {
+        case PSEUDO_PLF_IOC_SNAPSHOT:
+            return snapshot_create(file_ptr, data_ptr, (struct pseudo_plf_snapshot __user *)arg);
+
+        case PSEUDO_PLF_IOC_SNAP_DELETE:
+            if(get_user(id, (u32 __user *)arg))
+                return -EFAULT;
+            return snapshot_delete(data_ptr, id);
+
+        case PSEUDO_PLF_IOC_QOS_CLASS:
+            if(get_user(id, (u32 __user *)arg))
+                return -EFAULT;
+            return qos_set_class(file_ptr, id);
+
         default:
-            return -EINVAL;
+            return -ENOTTY;
+    }
+}
+
+/*qos section*/
+/*every limit is a GCRA of pseudo_throttle.h, a token bucket that keeps one time instead of a token count*/
+/*a request of count bytes moves the bytes tat by count/rate and the ios tat by 1/rate, it may start  */
+/*once it is no more than the burst time ahead of both tats                                           */
+
+/*earliest start of a request under the limits of one level, no sooner than earliest*/
+u64 qos_start(struct qos_state *qos, u64 bps, u64 iops, u64 earliest, u64 burst_ns)
+{
+    u64 start = earliest;
+
+    if(bps)
+        start = throttle_start(qos->bytes_tat, start, burst_ns);
+
+    if(iops)
+        start = throttle_start(qos->ios_tat, start, burst_ns);
+
+    return start;
+}
+
+void qos_charge(struct qos_state *qos, u64 bps, u64 iops, size_t count, u64 start)
+{
+    if(bps)
+        throttle_charge(&qos->bytes_tat, start, throttle_cost(count, bps));
+
+    if(iops)
+        throttle_charge(&qos->ios_tat, start, throttle_cost(1, iops));
+}
+
+/*the file limit is waited for first and the device slot is reserved only when the file may run, so a*/
+/*file that waits for its own limit does not hold device time that the other files could use meanwhile*/
+/*each slot is reserved under its lock and the caller sleeps until it, so throttled callers are served*/
+/*in the order they came, none of them spins and none of them can pass the others                    */
+int qos_throttle(struct file *file_ptr, struct dev_priv_data *data_ptr, size_t count, bool nowait)
+{
+    struct pseudo_file *pfile = file_ptr->private_data;
+    struct qos_class *class = &data_ptr->qos_classes[READ_ONCE(pfile->qos_class)];
+    u64 bps = READ_ONCE(data_ptr->qos_bps);
+    u64 iops = READ_ONCE(data_ptr->qos_iops);
+    u64 file_bps = READ_ONCE(class->file_bps);
+    u64 file_iops = READ_ONCE(class->file_iops);
+    u64 burst_ns = READ_ONCE(data_ptr->qos_burst_us) * NSEC_PER_USEC;
+    u64 waited = 0;
+    u64 start;
+    u64 now;
+    int err = 0;
+
+    if(!bps && !iops && !file_bps && !file_iops)
+        return 0;
+
+    now = ktime_get_ns();
+
+    /*nowait callers take nothing from the limits when they would have to wait*/
+    /*both levels are checked together, so a refused request charges neither */
+    if(nowait)
+    {
+        /*the file lock is always taken before the device lock*/
+        spin_lock(&pfile->qos.lock);
+        qos_file_sync(pfile, class);
+        spin_lock(&data_ptr->qos.lock);
+
+        start = qos_start(&pfile->qos, file_bps, file_iops, now, burst_ns);
+        start = qos_start(&data_ptr->qos, bps, iops, start, burst_ns);
+        if(start <= now)
+        {
+            qos_charge(&pfile->qos, file_bps, file_iops, count, now);
+            qos_charge(&data_ptr->qos, bps, iops, count, now);
+        }
+
+        spin_unlock(&data_ptr->qos.lock);
+        spin_unlock(&pfile->qos.lock);
+
+        return (start <= now) ? 0 : -EAGAIN;
+    }
+
+    spin_lock(&pfile->qos.lock);
+    qos_file_sync(pfile, class);
+    start = qos_start(&pfile->qos, file_bps, file_iops, now, burst_ns);
+    qos_charge(&pfile->qos, file_bps, file_iops, count, start);
+    spin_unlock(&pfile->qos.lock);
+
+    /*the slot stays reserved if a signal ends the wait, so a signal can not be used to pass the limits*/
+    if(start > now)
+    {
+        waited += start - now;
+        err = throttle_sleep_until(start);
+        if(err < 0)
+            goto out;
+        now = ktime_get_ns();
+    }
+
+    /*the device is charged from the time the file may run, not from a time in the future*/
+    spin_lock(&data_ptr->qos.lock);
+    start = qos_start(&data_ptr->qos, bps, iops, now, burst_ns);
+    qos_charge(&data_ptr->qos, bps, iops, count, start);
+    spin_unlock(&data_ptr->qos.lock);
+
+    if(start > now)
+    {
+        waited += start - now;
+        err = throttle_sleep_until(start);
+    }
+
+out:
+    if(waited > 0)
+        stats_account_throttle(data_ptr, waited);
+
+    return err;
+}
+
+/*a file follows the limits of its class, a change of them restarts the file state, called under the file lock*/
+void qos_file_sync(struct pseudo_file *pfile, struct qos_class *class)
+{
+    unsigned int gen = READ_ONCE(class->gen);
+
+    if(pfile->qos_gen == gen)
+        return;
+
+    pfile->qos.bytes_tat = 0;
+    pfile->qos.ios_tat = 0;
+    pfile->qos_gen = gen;
+}
+
+/*move the file to another class, the file state restarts under the limits of the new class*/
+int qos_set_class(struct file *file_ptr, u32 class)
+{
+    struct pseudo_file *pfile = file_ptr->private_data;
+
+    if(class >= PSEUDO_PLF_QOS_CLASSES)
+        return -EINVAL;
+
+    spin_lock(&pfile->qos.lock);
+    WRITE_ONCE(pfile->qos_class, class);
+    pfile->qos.bytes_tat = 0;
+    pfile->qos.ios_tat = 0;
+    pfile->qos_gen = READ_ONCE(pfile->data->qos_classes[class].gen);
+    spin_unlock(&pfile->qos.lock);
+
+    return 0;
+}
+
+/*emulation section*/
+/*the data is copied when the request starts, only the completion is delayed to the emulated time*/
+/*async requests (io_uring, aio) return EIOCBQUEUED and are completed by an hrtimer, so a client */
+/*can keep many of them in flight, sync requests sleep until their completion time              */
+bool emu_enabled(struct dev_priv_data *data_ptr)
+{
+    return READ_ONCE(data_ptr->emu_latency_us) || READ_ONCE(data_ptr->emu_jitter_us) || READ_ONCE(data_ptr->emu_bandwidth);
+}
+
+bool emu_slot_try(struct dev_priv_data *data_ptr, unsigned int depth)
+{
+    int inflight = atomic_read(&data_ptr->emu_inflight);
+
+    do
+    {
+        if(depth && ((unsigned int)inflight >= depth))
+            return false;
+    } while(!atomic_try_cmpxchg(&data_ptr->emu_inflight, &inflight, inflight + 1));
+
+    return true;
+}
+
+/*takes a queue slot when the profile is on, emu tells the caller to complete the request through emu_complete*/
+/*a full queue makes nowait callers retry, io_uring then issues the request again from a worker that can wait*/
+int emu_slot_get(struct dev_priv_data *data_ptr, bool nowait, bool *emu)
+{
+    unsigned int depth = READ_ONCE(data_ptr->emu_queue_depth);
+
+    *emu = false;
+    if(!emu_enabled(data_ptr))
+        return 0;
+
+    if(!emu_slot_try(data_ptr, depth))
+    {
+        if(nowait)
+            return -EAGAIN;
+
+        if(wait_event_interruptible(data_ptr->emu_queue, emu_slot_try(data_ptr, depth)))
+            return -ERESTARTSYS;
+    }
+
+    *emu = true;
+    return 0;
+}
+
+/*called from the timer softirq too*/
+void emu_slot_put(struct dev_priv_data *data_ptr)
+{
+    atomic_dec(&data_ptr->emu_inflight);
+    if(wq_has_sleeper(&data_ptr->emu_queue))
+        wake_up_interruptible(&data_ptr->emu_queue);
+}
+
+/*the requests share one link, a request is transferred when the link is free and completes one*/
+/*latency later, the latency is uniform in [latency - jitter, latency + jitter]                */
+u64 emu_done_time(struct dev_priv_data *data_ptr, size_t bytes, u64 now)
+{
+    u64 latency = READ_ONCE(data_ptr->emu_latency_us) * NSEC_PER_USEC;
+    u64 jitter = READ_ONCE(data_ptr->emu_jitter_us) * NSEC_PER_USEC;
+    u64 bandwidth = READ_ONCE(data_ptr->emu_bandwidth);
+    u64 done = now;
+
+    if(jitter)
+        latency = max_t(s64, latency - jitter + get_random_u32_below((u32)(2 * jitter + 1)), 0);
+
+    /*bytes is at most MAX_RW_COUNT, so bytes * NSEC_PER_SEC fits 64 bits*/
+    if(bandwidth)
+    {
+        spin_lock(&data_ptr->emu_lock);
+        done = max(now, data_ptr->emu_link_free) + div64_u64((u64)bytes * NSEC_PER_SEC, bandwidth);
+        data_ptr->emu_link_free = done;
+        spin_unlock(&data_ptr->emu_lock);
+    }
+
+    return done + latency;
+}
+
+/*errors complete at once, the others complete at done_ns*/
+ssize_t emu_complete(struct kiocb *iocb, struct dev_priv_data *data_ptr, ssize_t ret, u64 done_ns)
+{
+    struct emu_request *req;
+
+    if((ret >= 0) && !is_sync_kiocb(iocb))
+    {
+        /*without memory the request completes like a sync one*/
+        req = kmalloc(sizeof(*req), GFP_KERNEL);
+        if(req != NULL)
+        {
+            data_get(data_ptr);
+            req->iocb = iocb;
+            req->data_ptr = data_ptr;
+            req->ret = ret;
+            hrtimer_init(&req->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS_SOFT);
+            req->timer.function = emu_timer_fn;
+            hrtimer_start(&req->timer, ns_to_ktime(done_ns), HRTIMER_MODE_ABS_SOFT);
+            return -EIOCBQUEUED;
+        }
+    }
+
+    /*the data is already transferred, a signal only ends the wait early*/
+    if(ret >= 0)
+        throttle_sleep_until(done_ns);
+
+    emu_slot_put(data_ptr);
+    return ret;
+}
+
+/*runs in softirq context like a block device completion, io_uring and aio complete from there*/
+/*the slot and the request reference are released first, ki_complete can drop the last*/
+/*reference of the file. the file holds the data until then, so the last put of the   */
+/*data never runs here and data_release can sleep                                      */
+enum hrtimer_restart emu_timer_fn(struct hrtimer *timer)
+{
+    struct emu_request *req = container_of(timer, struct emu_request, timer);
+
+    emu_slot_put(req->data_ptr);
+    data_put(req->data_ptr);
+    req->iocb->ki_complete(req->iocb, req->ret);
+    kfree(req);
+
+    return HRTIMER_NORESTART;
+}
+
+/*snapshot section*/
+/*a snapshot is a new generation of the device, no page is touched when it is created*/
+/*it reads the device pages of older generations, and the writers move a page of an  */
+/*older generation to the snapshot before they replace it, see storage_cow_page      */
+long snapshot_create(struct file *file_ptr, struct dev_priv_data *data_ptr, struct pseudo_plf_snapshot __user *user_snap)
+{
+    struct pseudo_plf_snapshot result;
+    struct pseudo_snapshot *snap;
+    int cpu;
+    int err;
+
+    /*fifo devices and compressed chunks have no pages to share*/
+    if((data_ptr->plf_data.mode == FIFO_MODE) || data_ptr->plf_data.compressed || data_ptr->snapshot)
+        return -EINVAL;
+
+    /*the snapshot exposes the device data, so the caller must be able to read it*/
+    if(!(file_ptr->f_mode & FMODE_READ))
+        return -EBADF;
+
+    snap = kzalloc(sizeof(*snap), GFP_KERNEL);
+    if(snap == NULL)
+        return -ENOMEM;
+
+    snap->data.stats = alloc_percpu(struct dev_stats);
+    if(snap->data.stats == NULL)
+    {
+        kfree(snap);
+        return -ENOMEM;
+    }
+    for_each_possible_cpu(cpu)
+        u64_stats_init(&per_cpu_ptr(snap->data.stats, cpu)->syncp);
+
+    /*the snapshot is a read only sparse view of the device pages*/
+    snap->data.plf_data = data_ptr->plf_data;
+    snap->data.plf_data.permission = RONLY_PERMISSION;
+    snap->data.plf_data.sparse = 1;
+    snap->data.snapshot = true;
+    kref_init(&snap->data.ref);
+    snap->data.cdev = &snap->cdev;
+    xa_init(&snap->data.pages);
+    mutex_init(&snap->data.write_lock);
+    seqcount_mutex_init(&snap->data.mem_seq, &snap->data.write_lock);
+    mutex_init(&snap->data.read_lock);
+    init_waitqueue_head(&snap->data.read_queue);
+    init_waitqueue_head(&snap->data.write_queue);
+    INIT_LIST_HEAD(&snap->data.snapshots);
+    ida_init(&snap->data.snap_ida);
+    spin_lock_init(&snap->data.qos.lock);
+    snap->data.qos_burst_us = QOS_DEFAULT_BURST_US;
+    spin_lock_init(&snap->data.emu_lock);
+    init_waitqueue_head(&snap->data.emu_queue);
+    INIT_LIST_HEAD(&snap->node);
+    snap->id = -1;
+    snap->minor = -1;
+
+    /*the snapshot reads the origin pages, so the origin data lives as long as the snapshot*/
+    data_get(data_ptr);
+    snap->data.origin = data_ptr;
+
+    /*from here the snapshot is freed by the device release*/
+    device_initialize(&snap->dev);
+    snap->dev.class   = drv_data.dev_class;
+    snap->dev.parent  = data_ptr->dev_ptr;
+    snap->dev.groups  = dev_attr_groups;
+    snap->dev.release = snapshot_release;
+    dev_set_drvdata(&snap->dev, &snap->data);
+
+    mutex_lock(&drv_data.snap_lock);
+
+    err = ida_alloc_max(&data_ptr->snap_ida, MAX_SNAPSHOTS - 1, GFP_KERNEL);
+    if(err < 0)
+        goto unlock;
+    snap->id = err;
+
+    err = ida_alloc_max(&drv_data.minor_ida, MINORMASK, GFP_KERNEL);
+    if(err < 0)
+        goto unlock;
+    snap->minor = err;
+
+    snap->data.id = data_ptr->id;
+    snap->data.dev_num = MKDEV(MAJOR(drv_data.dev_num_base), snap->minor);
+    snap->dev.devt = snap->data.dev_num;
+    err = dev_set_name(&snap->dev, "pseudo_char_dev:%d.snap%d", data_ptr->id, snap->id);
+    if(err < 0)
+        goto unlock;
+
+    /*the generation is taken between two writes, so the snapshot is one point in time*/
+    /*the cost does not depend on the device size or on its written pages               */
+    mutex_lock(&data_ptr->write_lock);
+    snap->data.snap_gen = ++data_ptr->snap_gen;
+    list_add_tail(&snap->node, &data_ptr->snapshots);
+    mutex_unlock(&data_ptr->write_lock);
+
+    err = xa_err(xa_store(&drv_data.devs, snap->minor, &snap->data, GFP_KERNEL));
+    if(err < 0)
+        goto unlock;
+
+    cdev_init(&snap->cdev, &pseudo_fops);
+    snap->cdev.owner = THIS_MODULE;
+
+    /*the cdev holds the device, so an open snapshot file keeps the snapshot after it is deleted*/
+    err = cdev_device_add(&snap->cdev, &snap->dev);
+    if(err < 0)
+    {
+        xa_erase(&drv_data.devs, snap->minor);
+        goto unlock;
+    }
+    mutex_unlock(&drv_data.snap_lock);
+
+    pr_info("%s:snapshot %s created, %lu pages shared\n", __func__, dev_name(&snap->dev), READ_ONCE(data_ptr->nr_pages));
+
+    result.id = snap->id;
+    result.minor = MINOR(snap->data.dev_num);
+    if(copy_to_user(user_snap, &result, sizeof(result)))
+        return -EFAULT;
+
+    return 0;
+
+unlock:
+    mutex_unlock(&drv_data.snap_lock);
+    put_device(&snap->dev);
+    return err;
+}
+
+int snapshot_delete(struct dev_priv_data *data_ptr, u32 id)
+{
+    struct pseudo_snapshot *snap;
+
+    mutex_lock(&drv_data.snap_lock);
+    list_for_each_entry(snap, &data_ptr->snapshots, node)
+    {
+        if((snap->id == id) && !snap->deleted)
+        {
+            snap->deleted = true;
+            mutex_unlock(&drv_data.snap_lock);
+
+            snapshot_destroy(snap);
+            return 0;
+        }
+    }
+    mutex_unlock(&drv_data.snap_lock);
+
+    return -ENOENT;
+}
+
+/*the released snapshots leave the list meanwhile, so the walk starts again after every delete*/
+void snapshot_delete_all(struct dev_priv_data *data_ptr)
+{
+    struct pseudo_snapshot *snap;
+    struct pseudo_snapshot *found;
+
+    do
+    {
+        found = NULL;
+
+        mutex_lock(&drv_data.snap_lock);
+        list_for_each_entry(snap, &data_ptr->snapshots, node)
+        {
+            if(!snap->deleted)
+            {
+                snap->deleted = true;
+                found = snap;
+                break;
+            }
+        }
+        mutex_unlock(&drv_data.snap_lock);
+
+        if(found != NULL)
+            snapshot_destroy(found);
+    } while(found != NULL);
+}
+
+/*remove the device file, the last close of an open snapshot file frees the snapshot*/
+void snapshot_destroy(struct pseudo_snapshot *snap)
+{
+    xa_erase(&drv_data.devs, snap->minor);
+    cdev_device_del(&snap->cdev, &snap->dev);
+    data_put(&snap->data);
+}
+
+void snapshot_release(struct device *dev)
+{
+    struct pseudo_snapshot *snap = container_of(dev, struct pseudo_snapshot, dev);
+    struct dev_priv_data *origin = snap->data.origin;
+
+    /*the origin writers stop moving pages to the snapshot, it can be freed after this*/
+    /*the last put of a snapshot is in process context, see data_release             */
+    mutex_lock(&drv_data.snap_lock);
+    mutex_lock(&origin->write_lock);
+    list_del_init(&snap->node);
+    mutex_unlock(&origin->write_lock);
+    mutex_unlock(&drv_data.snap_lock);
+
+    /*drop the references of the pages that the origin moved here*/
+    data_free(&snap->data);
+
+    if(snap->minor >= 0)
+        ida_free(&drv_data.minor_ida, snap->minor);
+    if(snap->id >= 0)
+        ida_free(&origin->snap_ida, snap->id);
+    data_put(origin);
+
+    kfree(snap);
+}
+
+/*minor section*/
+/*the minor is returned by a device managed action, so every probe error path and the remove free it*/
+int minor_alloc(struct device *dev, dev_t *dev_num)
+{
+    int minor;
+
+    /*the ida hands out the lowest free minor, so device churn does not fragment the minor space*/
+    minor = ida_alloc_max(&drv_data.minor_ida, MINORMASK, GFP_KERNEL);
+    if(minor < 0)
+        return minor;
+
+    *dev_num = MKDEV(MAJOR(drv_data.dev_num_base), minor);
+    return devm_add_action_or_reset(dev, minor_release, (void *)(uintptr_t)minor);
+}
+
+void minor_release(void *data)
+{
+    ida_free(&drv_data.minor_ida, (uintptr_t)data);
+}
+
+/*block device section*/
+int blk_dev_create(struct dev_priv_data *data_ptr, int id)
+{
+    struct gendisk *disk;
+    int err;
+
+    /*a disk can not be write only, and a partial last sector can not be addressed*/
+    if(!(data_ptr->plf_data.permission & RONLY_PERMISSION) || (data_ptr->plf_data.size < SECTOR_SIZE))
+        return 0;
+
+    /*one hardware queue per cpu, so submitters on different cpus dont share a queue lock*/
+    /*the write path takes the device mutex and allocates pages, so queue_rq may sleep   */
+    data_ptr->tag_set.ops          = &pseudo_blk_mq_ops;
+    data_ptr->tag_set.nr_hw_queues = nr_cpu_ids;
+    data_ptr->tag_set.queue_depth  = BLK_QUEUE_DEPTH;
+    data_ptr->tag_set.numa_node    = NUMA_NO_NODE;
+    data_ptr->tag_set.flags        = BLK_MQ_F_SHOULD_MERGE | BLK_MQ_F_BLOCKING;
+    data_ptr->tag_set.driver_data  = data_ptr;
+
+    err = blk_mq_alloc_tag_set(&data_ptr->tag_set);
+    if(err < 0)
+        return err;
+
+    disk = blk_mq_alloc_disk(&data_ptr->tag_set, data_ptr);
+    if(IS_ERR(disk))
+    {
+        err = PTR_ERR(disk);
+        goto free_tag_set;
+    }
+
+    disk->major        = drv_data.blk_major;
+    disk->first_minor  = MINOR(data_ptr->dev_num);
+    disk->minors       = 1;
+    disk->fops         = &pseudo_blk_fops;
+    disk->private_data = data_ptr;
+    snprintf(disk->disk_name, DISK_NAME_LEN, "pseudo_blk%d", id);
+    set_capacity(disk, data_ptr->plf_data.size >> SECTOR_SHIFT);
+
+    /*the memory has no seek penalty, and writes are done in page units*/
+    blk_queue_flag_set(QUEUE_FLAG_NONROT, disk->queue);
+    blk_queue_physical_block_size(disk->queue, PAGE_SIZE);
+
+    if(!(data_ptr->plf_data.permission & WONLY_PERMISSION))
+        set_disk_ro(disk, true);
+
+    err = add_disk(disk);
+    if(err < 0)
+        goto put_disk;
+
+    data_ptr->disk = disk;
+    return 0;
+
+put_disk:
+    put_disk(disk);
+
+free_tag_set:
+    blk_mq_free_tag_set(&data_ptr->tag_set);
+    return err;
+}
+
+void blk_dev_destroy(struct dev_priv_data *data_ptr)
+{
+    del_gendisk(data_ptr->disk);
+    put_disk(data_ptr->disk);
+    blk_mq_free_tag_set(&data_ptr->tag_set);
+    data_ptr->disk = NULL;
+}
+
+blk_status_t pseudo_blk_queue_rq(struct blk_mq_hw_ctx *hctx, const struct blk_mq_queue_data *bd)
+{
+    struct request *rq = bd->rq;
+    struct dev_priv_data *data_ptr = rq->q->queuedata;
+    loff_t pos = (loff_t)blk_rq_pos(rq) << SECTOR_SHIFT;
+    blk_status_t status = BLK_STS_OK;
+    struct req_iterator rq_iter;
+    struct iov_iter iter;
+    struct bio_vec bvec;
+    ssize_t ret;
+
+    blk_mq_start_request(rq);
+
+    switch(req_op(rq))
+    {
+        case REQ_OP_READ:
+        case REQ_OP_WRITE:
         break;
+
+        /*there is no volatile cache in front of the memory*/
+        case REQ_OP_FLUSH:
+            goto done;
+
+        default:
+            status = BLK_STS_NOTSUPP;
+            goto done;
+    }
+
+    /*the segments go through the same helpers as the char device, so block readers are lockless*/
+    /*too and block writers are serialized with the char device writers by the device write lock */
+    rq_for_each_segment(bvec, rq, rq_iter)
+    {
+        if(rq_data_dir(rq) == READ)
+        {
+            iov_iter_bvec(&iter, ITER_DEST, &bvec, 1, bvec.bv_len);
+            ret = copy_mem_to_iter(data_ptr, &iter, pos, bvec.bv_len, false);
+        }
+        else
+        {
+            iov_iter_bvec(&iter, ITER_SOURCE, &bvec, 1, bvec.bv_len);
+            ret = copy_mem_from_iter(data_ptr, &iter, pos, bvec.bv_len, false);
+        }
+
+        if(ret != bvec.bv_len)
+        {
+            status = errno_to_blk_status((ret < 0) ? ret : -EIO);
+            break;
+        }
+        pos += bvec.bv_len;
     }
-    pr_info("new f_pos:%lld\n", file_ptr->f_pos);
-	return file_ptr->f_pos;
+
+done:
+    blk_mq_end_request(rq, status);
+    return BLK_STS_OK;
+}
+
+__poll_t pseudo_poll (struct file *file_ptr, struct poll_table_struct *wait)
+{
+    struct dev_priv_data *data_ptr = pseudo_file_data(file_ptr);
+    size_t size = data_ptr->plf_data.size;
+    unsigned int len;
+    __poll_t mask = 0;
+
+    /*flat memory devices never block*/
+    if(data_ptr->plf_data.mode != FIFO_MODE)
+        return EPOLLIN | EPOLLRDNORM | EPOLLOUT | EPOLLWRNORM;
+
+    poll_wait(file_ptr, &data_ptr->read_queue, wait);
+    poll_wait(file_ptr, &data_ptr->write_queue, wait);
+
+    len = fifo_len(&data_ptr->fifo);
+    if(len != 0)
+        mask |= EPOLLIN | EPOLLRDNORM;
+    if(len != size)
+        mask |= EPOLLOUT | EPOLLWRNORM;
+
+    return mask;
 }
 
 int check_file_permission(int device_permission, fmode_t request_mode)
@@ -0,0 +1,34 @@
+#ifndef  __PSEUDO_PLF_IOCTL_
+#define  __PSEUDO_PLF_IOCTL_
+
+/*ioctl interface of the pseudo platform driver, shared by the driver and user space*/
+/*the structures use fixed size fields only, so 32 bit processes on a 64 bit kernel  */
+/*use the same layout and compat_ptr_ioctl is enough                                 */
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define PSEUDO_PLF_IOC_MAGIC    'q'
+
+/*filled by the driver, the snapshot device file is pseudo_char_dev:<origin id>.snap<id>*/
+struct pseudo_plf_snapshot{
+    __u32 id;
+    __u32 minor;
+};
+
+/*create a read only snapshot of a flat page backed device, the file must be open for reading*/
+/*the snapshot shares the device pages, a page is copied only when the device writes it later*/
+/*a device has at most 16 snapshots, ENOSPC when they are all used                           */
+#define PSEUDO_PLF_IOC_SNAPSHOT     _IOR(PSEUDO_PLF_IOC_MAGIC, 1, struct pseudo_plf_snapshot)
+
+/*delete a snapshot of the device by its id, open snapshot files keep working until closed*/
+#define PSEUDO_PLF_IOC_SNAP_DELETE  _IOW(PSEUDO_PLF_IOC_MAGIC, 2, __u32)
+
+/*qos classes of a device, the per file limits of class n are the qos/class<n>_file_* sysfs files*/
+/*of the device, class 0 uses qos/file_bytes_per_sec and qos/file_iops                           */
+#define PSEUDO_PLF_QOS_CLASSES      4
+
+/*move the open file to a qos class, a new file is in class 0, EINVAL for an unknown class*/
+#define PSEUDO_PLF_IOC_QOS_CLASS    _IOW(PSEUDO_PLF_IOC_MAGIC, 3, __u32)
+
+#endif